@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QElapsedTimer>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+#include "randrcrtc.h"
+#include "randrconfig.h"
+
+static bool counting = false;
+static qint64 allocations = 0;
+static qint64 allocatedBytes = 0;
+
+#ifdef __GLIBC__
+/* Count every allocation of the process, including the ones Qt does with
+ * qMalloc(), by replacing malloc() and friends with wrappers around the
+ * glibc implementation. operator new ends up here too. */
+extern "C"
+{
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    if (counting)
+    {
+        ++allocations;
+        allocatedBytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (counting)
+    {
+        ++allocations;
+        allocatedBytes += n * size;
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+    {
+        ++allocations;
+        allocatedBytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+}
+#define COUNTS_ALLOCATIONS 1
+#endif
+
+static void startCounting()
+{
+    allocations = 0;
+    allocatedBytes = 0;
+    counting = true;
+}
+
+static void report(const char *what, int iterations, qint64 nsecs)
+{
+    counting = false;
+#ifdef COUNTS_ALLOCATIONS
+    printf("%-24s %12.1f %12.0f %12.3f\n", what, (double)allocations / iterations,
+           (double)allocatedBytes / iterations, nsecs / 1000000.0 / iterations);
+#else
+    printf("%-24s %12s %12s %12.3f\n", what, "n/a", "n/a", nsecs / 1000000.0 / iterations);
+#endif
+}
+
+/* The read-only queries the dialog does for every output, they should not
+ * allocate at all */
+static void queryModel(RandRScreen *screen)
+{
+    foreach(RandROutput *output, screen->outputs())
+    {
+        const SizeList &sizes = output->sizes();
+        foreach(const QSize &size, sizes)
+            output->refreshRates(size);
+        output->modes();
+        if (output->crtc())
+            output->crtc()->modes();
+    }
+    foreach(RandRCrtc *crtc, screen->crtcs())
+        crtc->modes();
+    screen->modes();
+}
+
+bool allocBench(int iterations)
+{
+#ifdef HAS_RANDR_1_2
+    RandRDisplay display;
+    if (!display.isValid() || !display.has_1_2())
+    {
+        printf("alloc: skipped, RandR 1.2 is not available on this display\n");
+        return true;
+    }
+
+    RandRScreen *screen = display.currentScreen();
+    RandRConfig config(0, &display);
+    // the first load creates everything that is only created once
+    config.load();
+    queryModel(screen);
+
+    printf("alloc: %d iterations, %d outputs\n", iterations, screen->outputs().count());
+    printf("%-24s %12s %12s %12s\n", "", "allocs", "bytes", "ms");
+
+    QElapsedTimer timer;
+    startCounting();
+    timer.start();
+    for (int n = 0; n < iterations; ++n)
+        queryModel(screen);
+    report("model queries", iterations, timer.nsecsElapsed());
+
+    startCounting();
+    timer.restart();
+    for (int n = 0; n < iterations; ++n)
+        config.load();
+    report("RandRConfig::load()", iterations, timer.nsecsElapsed());
+#else
+    Q_UNUSED(iterations);
+    printf("alloc: skipped, built without RandR 1.2\n");
+#endif
+    return true;
+}
@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+class QString;
+
+/* Every benchmark prints its results to stdout and returns false if the
+ * code under test gave wrong results. */
+bool gammaBench(int iterations);
+/* Needs a QApplication and an X display */
+bool allocBench(int iterations);
+/* Runs the model on simulated display walls of 1 to 64 outputs, the
+ * dialog parts only if there is an X display. @p format is text, csv or
+ * json */
+bool scaleBench(int iterations, const QString &format);
+/* Checks that a screen that is not persistent, like the ones of the other
+ * displays of RandRDisplayGroup, leaves the saved layouts alone */
+bool persistBench();
+
+#endif // BENCH_H
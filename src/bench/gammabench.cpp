@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+#include <stdio.h>
+#include <strings.h>
+#include <math.h>
+
+#include "bench.h"
+#include "randrgammalut.h"
+
+static double dmin(double x, double y)
+{
+    return x < y ? x : y;
+}
+
+/* The loop set_gamma() used before RandRGammaLut, kept as reference */
+static void referenceRamp(unsigned short *ramp, int size, float brightness, float red, float green, float blue)
+{
+    int shift = 16 - (ffs(size) - 1);
+    float gamma[3] = { 1.0f / red, 1.0f / green, 1.0f / blue };
+
+    for (int c = 0; c < 3; ++c)
+    {
+        unsigned short *channel = ramp + c * size;
+        for (int i = 0; i < size; i++)
+        {
+            if (gamma[c] == 1.0 && brightness == 1.0)
+                channel[i] = i;
+            else
+                channel[i] = dmin(pow((double)i/(double)(size - 1), gamma[c]) * brightness,
+                                  1.0) * (double)(size - 1);
+            channel[i] <<= shift;
+        }
+    }
+}
+
+static int maxDifference(const unsigned short *a, const unsigned short *b, int count)
+{
+    int diff = 0;
+    for (int i = 0; i < count; ++i)
+        diff = qMax(diff, qAbs((int)a[i] - (int)b[i]));
+    return diff;
+}
+
+bool gammaBench(int iterations)
+{
+    static const int sizes[] = { 256, 1024, 4096 };
+    // brightness, red, green, blue
+    static const float settings[][4] = {
+        { 1.0f, 1.0f, 1.0f, 1.0f },
+        { 0.7f, 1.0f, 1.0f, 1.0f },
+        { 1.0f, 0.8f, 0.8f, 0.8f },
+        { 0.9f, 1.1f, 0.9f, 0.6f }
+    };
+    static const int nsettings = sizeof(settings) / sizeof(settings[0]);
+
+    bool ok = true;
+    printf("gamma: %d iterations\n", iterations);
+    printf("%6s %12s %12s %12s %8s\n", "size", "pow (us)", "fill (us)", "cached (us)", "maxdiff");
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        const int size = sizes[s];
+        QVector<unsigned short> reference(3 * size);
+        QVector<unsigned short> filled(3 * size);
+        int diff = 0;
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int n = 0; n < iterations; ++n)
+            for (int k = 0; k < nsettings; ++k)
+                referenceRamp(reference.data(), size, settings[k][0], settings[k][1], settings[k][2], settings[k][3]);
+        qint64 powTime = timer.nsecsElapsed();
+
+        RandRGammaLut::clearCache();
+        timer.restart();
+        for (int n = 0; n < iterations; ++n)
+            for (int k = 0; k < nsettings; ++k)
+                for (int c = 0; c < 3; ++c)
+                    RandRGammaLut::fill(filled.data() + c * size, size, settings[k][0], 1.0f / settings[k][c + 1]);
+        qint64 fillTime = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int n = 0; n < iterations; ++n)
+            for (int k = 0; k < nsettings; ++k)
+                RandRGammaLut::ramp(size, settings[k][0], settings[k][1], settings[k][2], settings[k][3]);
+        qint64 cachedTime = timer.nsecsElapsed();
+
+        for (int k = 0; k < nsettings; ++k)
+        {
+            referenceRamp(reference.data(), size, settings[k][0], settings[k][1], settings[k][2], settings[k][3]);
+            QVector<unsigned short> ramp = RandRGammaLut::ramp(size, settings[k][0], settings[k][1],
+                                                               settings[k][2], settings[k][3]);
+            diff = qMax(diff, maxDifference(reference.constData(), ramp.constData(), 3 * size));
+        }
+
+        const double calls = (double)iterations * nsettings * 1000.0;
+        printf("%6d %12.2f %12.2f %12.2f %8d\n", size, powTime / calls, fillTime / calls,
+               cachedTime / calls, diff);
+
+        // RandRGammaLut falls back to pow() where exp(g * ln(x)) could round
+        // to another level, the ramps have to be the same
+        if (diff != 0)
+        {
+            printf("gamma: size %d differs from the reference by %d\n", size, diff);
+            ok = false;
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QStringList>
+#include <QtGui/QApplication>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [options] [benchmark...]\n", name);
+    printf("  -n, --iterations <n>  Repeat every measurement n times (default 200)\n");
+    printf("  -f, --format <format> Output of the scale benchmark: text, csv or json\n");
+    printf("  -h, --help            Show this help\n");
+    printf("Benchmarks: gamma, alloc (needs an X display), scale, persist\n");
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = 200;
+    QString format = "text";
+    QStringList benches;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        QString arg = QString::fromLocal8Bit(argv[i]);
+        if ((arg == "-n" || arg == "--iterations") && i + 1 < argc)
+            iterations = qMax(1, atoi(argv[++i]));
+        else if ((arg == "-f" || arg == "--format") && i + 1 < argc)
+        {
+            format = QString::fromLocal8Bit(argv[++i]);
+            if (format != "text" && format != "csv" && format != "json")
+            {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (arg == "-h" || arg == "--help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (arg.startsWith("-"))
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            benches << arg;
+    }
+
+    if (benches.isEmpty())
+        benches << "gamma";
+
+    // only the benchmarks that use the model need an application, and
+    // only the ones with widgets a connection to X
+    QApplication *app = 0;
+    bool gui = getenv("DISPLAY") != 0;
+    if (benches.contains("alloc") || benches.contains("scale") || benches.contains("persist"))
+        app = new QApplication(argc, argv, gui);
+
+    bool ok = true;
+    foreach(QString bench, benches)
+    {
+        if (bench == "gamma")
+            ok = gammaBench(iterations) && ok;
+        else if (bench == "alloc")
+        {
+            if (gui)
+                ok = allocBench(iterations) && ok;
+            else
+                printf("alloc: skipped, no X display\n");
+        }
+        else if (bench == "scale")
+            ok = scaleBench(iterations, format) && ok;
+        else if (bench == "persist")
+            ok = persistBench() && ok;
+        else
+        {
+            printf("Unknown benchmark %s\n", qPrintable(bench));
+            ok = false;
+        }
+    }
+
+    delete app;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "randrsimbackend.h"
+#include "randrlayoutstore.h"
+#include "randrapplyplan.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+
+static QByteArray readFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QByteArray();
+    return file.readAll();
+}
+
+/* Put the connected outputs of @p screen side by side, or all of them on
+ * top of each other */
+static void proposeLayout(RandRScreen *screen, const QSize &size, bool mirror)
+{
+    int index = 0;
+    foreach(RandROutput *output, screen->outputs())
+    {
+        if (!output->isConnected())
+            continue;
+        QPoint pos = mirror ? QPoint(0, 0) : QPoint(index++ * size.width(), 0);
+        output->proposeRect(QRect(pos, size));
+    }
+}
+
+/* Apply the proposed layout, then report the changes the way the server's
+ * events would, which saves the layout of a persistent screen */
+static bool apply(RandRScreen *screen)
+{
+    bool ok = screen->applyProposed(false);
+    screen->loadSettings(true);
+    return ok;
+}
+
+static bool runPersist()
+{
+    RandRSimBackend sim;
+    sim.setScreenSizeRange(QSize(320, 200), QSize(8192, 8192));
+    ModeList modes;
+    modes << sim.addMode(1920, 1080) << sim.addMode(1280, 1024);
+    CrtcList crtcs;
+    crtcs << sim.addCrtc() << sim.addCrtc();
+    OutputList outputs;
+    outputs << sim.addOutput("DP-0", crtcs, modes, true, 1, "persist-0")
+            << sim.addOutput("DP-1", crtcs, modes, true, 1, "persist-1");
+
+    Window root = sim.rootWindow(0);
+    sim.setScreenSize(root, QSize(3840, 1080), QSize(1016, 286));
+    XRRScreenResources *res = sim.screenResources(root, false);
+    sim.setCrtcConfig(res, crtcs.at(0), QPoint(0, 0), modes.at(0), RR_Rotate_0, OutputList() << outputs.at(0));
+    sim.setCrtcConfig(res, crtcs.at(1), QPoint(1920, 0), modes.at(0), RR_Rotate_0, OutputList() << outputs.at(1));
+    sim.freeScreenResources(res);
+
+    RandRBackend::setInstance(&sim);
+    bool ok = true;
+    {
+        RandRDisplay display;
+        RandRScreen *screen = display.currentScreen();
+
+        // the display of the session saves what it applies
+        proposeLayout(screen, QSize(1280, 1024), false);
+        if (!apply(screen))
+        {
+            printf("persist: applying on the persistent screen failed\n");
+            ok = false;
+        }
+        QByteArray layouts = readFile(RandRLayoutStore::defaultFileName());
+        QByteArray plan = readFile(RandRApplyPlan::defaultFileName());
+        if (layouts.isEmpty() || plan.isEmpty())
+        {
+            printf("persist: the persistent screen saved nothing\n");
+            ok = false;
+        }
+
+        // the other displays leave the store and the plan alone
+        screen->setPersistent(false);
+        proposeLayout(screen, QSize(1920, 1080), true);
+        if (!apply(screen))
+        {
+            printf("persist: applying on the screen that is not persistent failed\n");
+            ok = false;
+        }
+        else if (screen->outputs().value(outputs.at(1))->rect().topLeft() != QPoint(0, 0))
+        {
+            printf("persist: the layout was not applied\n");
+            ok = false;
+        }
+        if (readFile(RandRLayoutStore::defaultFileName()) != layouts)
+        {
+            printf("persist: the screen that is not persistent changed the layout store\n");
+            ok = false;
+        }
+        if (readFile(RandRApplyPlan::defaultFileName()) != plan)
+        {
+            printf("persist: the screen that is not persistent changed the startup plan\n");
+            ok = false;
+        }
+    }
+    RandRBackend::setInstance(0);
+    return ok;
+}
+
+bool persistBench()
+{
+#ifdef HAS_RANDR_1_2
+    // keep the saved layouts away from the ones of the user
+    QString configDir = QDir::tempPath() + QString("/lxqt-config-randr-persist-%1").arg(getpid());
+    QByteArray previousConfigHome = qgetenv("XDG_CONFIG_HOME");
+    QDir().mkpath(configDir);
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(configDir));
+
+    bool ok = runPersist();
+    printf("persist: %s\n", ok ? "ok" : "failed");
+
+    QString layouts = RandRLayoutStore::defaultFileName();
+    QFile::remove(layouts);
+    QFile::remove(RandRApplyPlan::defaultFileName());
+    QDir().rmdir(QFileInfo(layouts).path());
+    QDir().rmdir(configDir);
+    qputenv("XDG_CONFIG_HOME", previousConfigHome);
+    return ok;
+#else
+    printf("persist: skipped, built without RandR 1.2\n");
+    return true;
+#endif
+}
@@ -0,0 +1,316 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtGui/QApplication>
+#include <QtGui/QGraphicsScene>
+#include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "randrsimbackend.h"
+#include "randrlayoutstore.h"
+#include "randrapplyplan.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+#include "randrconfig.h"
+#include "outputconfig.h"
+#include "outputgraphicsitem.h"
+#include "layoutmanager.h"
+
+namespace
+{
+    struct Result
+    {
+        const char *bench;
+        int outputs;
+        int iterations;
+        double ms;
+        double requests;
+        double roundTrips;
+    };
+
+    // outputs of a display wall, each group of them on its own GPU
+    const int wallSizes[] = { 1, 4, 16, 64 };
+    const int crtcsPerGpu = 4;
+    const QSize tileSize(1920, 1080);
+    const QSize smallTileSize(1280, 1024);
+}
+
+static QtMsgHandler previousHandler = 0;
+
+/* The model is chatty, the debug output would be most of what is timed */
+static void quietHandler(QtMsgType type, const char *message)
+{
+    if (type == QtDebugMsg)
+        return;
+    if (previousHandler)
+        previousHandler(type, message);
+    else
+        fprintf(stderr, "%s\n", message);
+}
+
+/* Where the tile @p index of a wall of @p count outputs goes */
+static QRect tileRect(int index, int count, const QSize &size)
+{
+    int columns = (int) ceil(sqrt((double) count));
+    return QRect(QPoint((index % columns) * size.width(), (index / columns) * size.height()), size);
+}
+
+/* A server with @p count connected outputs showing a grid of tiles */
+static RandRSimBackend *createWall(int count)
+{
+    RandRSimBackend *sim = new RandRSimBackend;
+    sim->setScreenSizeRange(QSize(320, 200), QSize(32767, 32767));
+
+    ModeList modes;
+    modes << sim->addMode(tileSize.width(), tileSize.height(), 60.0)
+          << sim->addMode(smallTileSize.width(), smallTileSize.height(), 60.0)
+          << sim->addMode(1024, 768, 60.0)
+          << sim->addMode(tileSize.width(), tileSize.height(), 50.0);
+
+    CrtcList crtcs;
+    for (int i = 0; i < count; ++i)
+        crtcs << sim->addCrtc();
+
+    OutputList outputs;
+    for (int i = 0; i < count; ++i)
+    {
+        int gpu = i / crtcsPerGpu;
+        CrtcList possible = crtcs.mid(gpu * crtcsPerGpu, crtcsPerGpu);
+        QByteArray edid = QString("bench-%1").arg(i).toLatin1();
+        outputs << sim->addOutput(QString("DP-%1-%2").arg(gpu).arg(i % crtcsPerGpu),
+                                  possible, modes, true, 1, edid);
+    }
+
+    QRect bounds;
+    for (int i = 0; i < count; ++i)
+        bounds |= tileRect(i, count, tileSize);
+    Window root = sim->rootWindow(0);
+    sim->setScreenSize(root, bounds.size(),
+                       QSize(bounds.width() * 254 / 960, bounds.height() * 254 / 960));
+
+    XRRScreenResources *res = sim->screenResources(root, false);
+    for (int i = 0; i < count; ++i)
+    {
+        sim->setCrtcConfig(res, crtcs.at(i), tileRect(i, count, tileSize).topLeft(),
+                           modes.first(), RR_Rotate_0, OutputList() << outputs.at(i));
+    }
+    sim->freeScreenResources(res);
+    return sim;
+}
+
+/* Propose a grid of @p size tiles, or all of them on top of each other */
+static void proposeLayout(RandRScreen *screen, const QSize &size, bool mirror)
+{
+    int index = 0;
+    int count = screen->connectedCount();
+    foreach(RandROutput *output, screen->outputs())
+    {
+        if (!output->isConnected())
+            continue;
+        QRect rect = mirror ? QRect(QPoint(0, 0), size) : tileRect(index++, count, size);
+        output->proposeRect(rect);
+    }
+}
+
+static Result result(const char *bench, int outputs, int iterations, qint64 nsecs,
+                     const RandRSimBackend *sim)
+{
+    Result r;
+    r.bench = bench;
+    r.outputs = outputs;
+    r.iterations = iterations;
+    r.ms = nsecs / 1000000.0 / iterations;
+    r.requests = (double) sim->requests() / iterations;
+    r.roundTrips = (double) sim->roundTrips() / iterations;
+    return r;
+}
+
+static bool runWall(int count, int iterations, bool gui, QList<Result> &results)
+{
+    RandRSimBackend *sim = createWall(count);
+    RandRBackend::setInstance(sim);
+
+    bool ok = true;
+    {
+        RandRDisplay display;
+        RandRScreen *screen = display.currentScreen();
+        if (screen->connectedCount() != count || screen->activeCount() != count)
+        {
+            printf("scale: %d outputs: the model sees %d connected, %d active\n",
+                   count, screen->connectedCount(), screen->activeCount());
+            ok = false;
+        }
+
+        QElapsedTimer timer;
+        sim->resetCounters();
+        timer.start();
+        for (int n = 0; n < iterations; ++n)
+            screen->loadSettings();
+        results << result("RandRScreen::loadSettings()", count, iterations, timer.nsecsElapsed(), sim);
+
+        sim->resetCounters();
+        timer.restart();
+        for (int n = 0; n < iterations; ++n)
+            screen->unifiedSizes();
+        results << result("RandRScreen::unifiedSizes()", count, iterations, timer.nsecsElapsed(), sim);
+
+        // every iteration switches to the other layout
+        sim->resetCounters();
+        timer.restart();
+        for (int n = 0; n < iterations && ok; ++n)
+        {
+            proposeLayout(screen, tileSize, n % 2 == 0);
+            ok = screen->applyProposed(false);
+        }
+        results << result("applyProposed() grid/mirror", count, iterations, timer.nsecsElapsed(), sim);
+
+        sim->resetCounters();
+        timer.restart();
+        for (int n = 0; n < iterations && ok; ++n)
+        {
+            proposeLayout(screen, n % 2 == 0 ? smallTileSize : tileSize, false);
+            ok = screen->applyProposed(false);
+        }
+        results << result("applyProposed() mode switch", count, iterations, timer.nsecsElapsed(), sim);
+        if (!ok)
+            printf("scale: %d outputs: applyProposed() failed\n", count);
+
+        if (gui)
+        {
+            RandRConfig config(0, &display);
+            sim->resetCounters();
+            timer.restart();
+            for (int n = 0; n < iterations; ++n)
+                config.load();
+            results << result("RandRConfig::load()", count, iterations, timer.nsecsElapsed(), sim);
+
+            QGraphicsScene scene;
+            LayoutManager manager(screen, &scene);
+            OutputConfigList configs;
+            QList<OutputGraphicsItem *> items;
+            foreach(RandROutput *output, screen->outputs())
+            {
+                OutputConfig *outputConfig = new OutputConfig(0, output, configs, false);
+                configs << outputConfig;
+                OutputGraphicsItem *item = new OutputGraphicsItem(outputConfig);
+                scene.addItem(item);
+                items << item;
+            }
+
+            sim->resetCounters();
+            timer.restart();
+            for (int n = 0; n < iterations; ++n)
+                manager.slotAdjustOutput(items.at(n % items.count()));
+            results << result("LayoutManager::slotAdjustOutput()", count, iterations,
+                              timer.nsecsElapsed(), sim);
+
+            scene.clear();
+            qDeleteAll(configs);
+        }
+    }
+
+    RandRBackend::setInstance(0);
+    delete sim;
+    return ok;
+}
+
+static void printResults(const QList<Result> &results, const QString &format)
+{
+    if (format == "csv")
+    {
+        printf("benchmark,outputs,iterations,ms,requests,round_trips\n");
+        foreach(const Result &r, results)
+        {
+            printf("\"%s\",%d,%d,%.4f,%.1f,%.1f\n", r.bench, r.outputs, r.iterations,
+                   r.ms, r.requests, r.roundTrips);
+        }
+    }
+    else if (format == "json")
+    {
+        printf("[\n");
+        for (int i = 0; i < results.count(); ++i)
+        {
+            const Result &r = results.at(i);
+            printf("  {\"benchmark\": \"%s\", \"outputs\": %d, \"iterations\": %d, \"ms\": %.4f, "
+                   "\"requests\": %.1f, \"round_trips\": %.1f}%s\n", r.bench, r.outputs,
+                   r.iterations, r.ms, r.requests, r.roundTrips,
+                   i + 1 < results.count() ? "," : "");
+        }
+        printf("]\n");
+    }
+    else
+    {
+        printf("%-36s %8s %12s %10s %12s\n", "", "outputs", "ms", "requests", "round trips");
+        foreach(const Result &r, results)
+        {
+            printf("%-36s %8d %12.3f %10.1f %12.1f\n", r.bench, r.outputs, r.ms,
+                   r.requests, r.roundTrips);
+        }
+    }
+}
+
+bool scaleBench(int iterations, const QString &format)
+{
+#ifdef HAS_RANDR_1_2
+    // applyProposed() saves the layouts and the startup plan, keep them
+    // away from the ones of the user
+    QString configDir = QDir::tempPath() + QString("/lxqt-config-randr-bench-%1").arg(getpid());
+    QByteArray previousConfigHome = qgetenv("XDG_CONFIG_HOME");
+    QDir().mkpath(configDir);
+    qputenv("XDG_CONFIG_HOME", QFile::encodeName(configDir));
+
+    // the dialog benchmarks need widgets, the model runs without X
+    bool gui = QApplication::type() != QApplication::Tty;
+    if (format == "text")
+    {
+        printf("scale: %d iterations, simulated server%s\n", iterations,
+               gui ? "" : ", no X display for the dialog benchmarks");
+    }
+
+    previousHandler = qInstallMsgHandler(quietHandler);
+    bool ok = true;
+    QList<Result> results;
+    for (unsigned int i = 0; i < sizeof(wallSizes) / sizeof(wallSizes[0]); ++i)
+        ok = runWall(wallSizes[i], iterations, gui, results) && ok;
+    qInstallMsgHandler(previousHandler);
+
+    printResults(results, format);
+
+    QString layouts = RandRLayoutStore::defaultFileName();
+    QFile::remove(layouts);
+    QFile::remove(RandRApplyPlan::defaultFileName());
+    QDir().rmdir(QFileInfo(layouts).path());
+    QDir().rmdir(configDir);
+    qputenv("XDG_CONFIG_HOME", previousConfigHome);
+    return ok;
+#else
+    Q_UNUSED(iterations);
+    Q_UNUSED(format);
+    printf("scale: skipped, built without RandR 1.2\n");
+    return true;
+#endif
+}
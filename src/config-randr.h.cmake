@@ -1,2 +1,3 @@
 #cmakedefine HAS_RANDR_1_2 1
 #cmakedefine HAS_RANDR_1_3 1
+#cmakedefine HAS_XCB_RANDR 1
@@ -17,23 +17,36 @@
  */
 
 #include <QtGui/QApplication>
+#include <QtCore/QCoreApplication>
 #include <QtCore/QSettings>
 #include <QtCore/QFile>
 #include <QtCore/QDebug>
+#include <X11/Xlib.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "razorrandrconfiguration.h"
-#include "loaderconfiglogin.h"
+#include "randrstartup.h"
+#include "randrdisplaygroup.h"
+#include "randrconnectionpool.h"
+#include "randr.h"
+#include "randrstats.h"
+#include "randrtrace.h"
 
 #define out
 
-const char* const short_options = "vhs";
+const char* const short_options = "vhsrd";
 
 const struct option long_options[] = {
     {"version", 0, NULL, 'v'},
     {"help",    0, NULL, 'h'},
     {"startup", 0, NULL, 's'},
+    {"reprobe", 0, NULL, 'r'},
+    {"daemon",  0, NULL, 'd'},
+    {"displays", 1, NULL, 'D'},
+    {"stats",   2, NULL, 'S'},
+    {"trace",   1, NULL, 'T'},
     {NULL,      0, NULL,  0}
 };
 
@@ -42,6 +55,13 @@ void print_usage_and_exit(int code)
     printf("LXQt Randr Configuration %s\n", STR_VERSION);
     puts("Usage: lxqt-config-randr [OPTION]...\n");
     puts("  -s,  --startup            Apply configuration from the saved settings");
+    puts("  -r,  --reprobe            Poll all outputs instead of using the server's cached state");
+    puts("  -d,  --daemon             Stay running and apply the saved layouts when monitors are plugged");
+    puts("       --displays=LIST      Apply the saved layouts to every display of LIST, like :0,:1,:2,");
+    puts("                            all at once, and print the result of each (with -d, keep running)");
+    puts("       --stats[=FILE]       Print the requests sent to the server at exit, or write them to FILE");
+    puts("       --trace=FILE         Write a Chrome/Perfetto trace of the changes to FILE at exit");
+    puts("                            (LXQT_RANDR_TRACE=FILE does the same)");
     puts("  -h,  --help               Print this help");
     puts("  -v,  --version            Prints application version and exits");
     puts("\nHomepage: <https://github.com/zballina/lxqt-config-randr>");
@@ -55,10 +75,14 @@ void print_version_and_exit(int code=0)
     exit(code);
 }
 
-void parse_args(int argc, char* argv[], out bool& startup)
+void parse_args(int argc, char* argv[], out bool& startup, out bool& reprobe, out bool& daemon,
+                out QStringList& displays)
 {
     int next_option;
     startup = false;
+    reprobe = false;
+    daemon = false;
+    displays.clear();
     do{
         next_option = getopt_long(argc, argv, short_options, long_options, NULL);
         switch(next_option)
@@ -68,6 +92,19 @@ void parse_args(int argc, char* argv[], out bool& startup)
             case 's':
                 startup = true;
                 break;
+            case 'r':
+                reprobe = true;
+                break;
+            case 'd':
+                daemon = true;
+                break;
+            case 'D':
+                displays = RandRDisplayGroup::parseNames(QString::fromLocal8Bit(optarg));
+                break;
+            case 'S':
+            case 'T':
+                // already handled by RandRStats and RandRTrace
+                break;
             case '?':
                 print_usage_and_exit(1);
             case 'v':
@@ -77,38 +114,98 @@ void parse_args(int argc, char* argv[], out bool& startup)
     while(next_option != -1);
 }
 
-int main(int argc, char *argv[])
+// --startup is looked for before QApplication parses its own options, so
+// that the login path does not pay for QtGui
+bool startup_requested(int argc, char* argv[])
 {
-    Q_INIT_RESOURCE(lxqtconfigrandr);
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--startup"))
+            return true;
+    }
+    return false;
+}
 
+// --daemon and --displays have no window, they run without QtGui on the
+// connections of the RandRConnectionPool
+bool headless_requested(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--daemon") ||
+            !strcmp(argv[i], "--displays") || !strncmp(argv[i], "--displays=", 11))
+            return true;
+    }
+    return false;
+}
+
+// apply the saved layouts to every display of @p displays, and keep
+// applying them on hotplug with @p daemon
+int run_displays(QCoreApplication &a, const QStringList &displays, bool daemon)
+{
+    int code;
+    {
+        RandRDisplayGroup group;
+        if (!group.open(displays))
+            return 1;
+        if (daemon)
+            group.follow();
+        else
+        {
+            // applyLayouts() may be over before the event loop starts
+            QObject::connect(&group, SIGNAL(finished()), &a, SLOT(quit()), Qt::QueuedConnection);
+        }
+        group.applyLayouts();
+        code = a.exec();
+        if (!group.succeeded())
+            code = 1;
+    }
+    RandRConnectionPool::instance()->closeAll();
+    return code;
+}
+
+int main(int argc, char *argv[])
+{
     QApplication::setApplicationName("lxqt-config-randr");
 #ifdef STR_VERSION
     QApplication::setApplicationVersion(QString("%1").arg(STR_VERSION));
 #endif
     QApplication::setOrganizationDomain("lxqt");
     QSettings::setDefaultFormat(QSettings::NativeFormat);
+    RandRStats::parseArguments(argc, argv);
+    RandRTrace::parseArguments(argc, argv);
+
+    if(startup_requested(argc, argv))
+        return RandRStartup::run(RandRStartup::reprobeRequested(argc, argv));
+
+    // before Qt opens the display: the RandR worker thread has its own
+    // connection
+    RandR::threads = XInitThreads();
+
+    bool startup, reprobe, daemon;
+    QStringList displays;
+    if(headless_requested(argc, argv))
+    {
+        QCoreApplication a(argc, argv);
+        parse_args(argc, argv, startup, reprobe, daemon, displays);
+        RandR::reprobe = reprobe;
 
+        // the daemon alone follows $DISPLAY
+        if(displays.isEmpty())
+            displays.append(QString::fromLocal8Bit(XDisplayName(0)));
+        return run_displays(a, displays, daemon);
+    }
+
+    Q_INIT_RESOURCE(lxqtconfigrandr);
     QApplication a(argc, argv);
 
-    bool startup;
-    parse_args(argc, argv, startup);
+    parse_args(argc, argv, startup, reprobe, daemon, displays);
+    RandR::reprobe = reprobe;
 
     if(startup)
     {
-        QSettings config;
-        QFile fileconfig(config.fileName());
-        if(fileconfig.exists())
-        {
-            LoaderConfigLogin loader;
-            loader.execute();
-        }
-        else
-        {
-            qDebug() << "File config not exist: " << config.fileName();
-            qDebug() << "Not load config. Exit without change";
-        }
-
-        exit(0);
+        // combined with other short options
+        exit(RandRStartup::run(reprobe));
     }
     else
     {
@@ -26,6 +26,7 @@
 #include "randrcrtc.h"
 #include <QtCore/QDebug>
 #include <QMessageBox>
+#include <QtGui/QIcon>
 
 OutputConfig::OutputConfig(QWidget* parent, RandROutput* output, OutputConfigList preceding, bool unified)
     : QWidget(parent)
@@ -158,13 +159,7 @@ float OutputConfig::refreshRate(void) const
         return 0;
     float rate = float(refreshCombo->itemData(refreshCombo->currentIndex()).toDouble());
     if(rate == 0.0f)
-    {
-        RateList rates = m_output->refreshRates(resolution());
-        if (!rates.isEmpty())
-        {
-            return rates.first();
-        }
-    }
+        return m_output->modeCatalog().defaultRate(resolution());
     return rate;
 }
 
@@ -399,9 +394,8 @@ void OutputConfig::updateVirtualModeResolution(void)
 void OutputConfig::enableVirtualMode(int state)
 {
     bool enable = (state == Qt::Checked);
-     int major, minor;
-    XRRQueryVersion (QX11Info::display(), &major, &minor);
-    if (major > 1 || (major == 1 && minor >= 3))
+    // the version was queried by RandRDisplay
+    if (RandR::has_1_3)
     {
         //virtualXModeSpinBox->setEnabled(enable);
         //virtualYModeSpinBox->setEnabled(enable);
@@ -634,21 +628,14 @@ void OutputConfig::updateRateList(int resolutionIndex)
         return;
     }
 
-    ModeList modeList = m_output->modes();
+    RateList rates = m_output->modeCatalog().rates(resolution);
 
     refreshCombo->clear();
     refreshCombo->addItem(tr("Auto"), 0.0f);
     refreshCombo->setEnabled(true);
     rateLabel->setEnabled(true);
-    foreach(RRMode m, modeList)
-    {
-        RandRMode outMode = m_output->screen()->mode(m);
-        if(outMode.isValid() && outMode.size() == resolution)
-        {
-            float rate = outMode.refreshRate();
-            refreshCombo->addItem(QString("%1 Hz").arg(rate));
-        }
-    }
+    foreach(float rate, rates)
+        refreshCombo->addItem(QString("%1 Hz").arg(rate), rate);
 }
 
 void OutputConfig::updateRateList()
@@ -45,12 +45,26 @@ QTimerConfirmDialog::~QTimerConfirmDialog()
 
 int QTimerConfirmDialog::exec()
 {
-    qDebug() << "Mostrando e iniciando los temporizadores";
-    mTotalTimer->start(mSecTotal);
-    mUpdateTimer->start(mUpdateInterval);
+    // the timers are started by setVisible()
     return QDialog::exec();
 }
 
+void QTimerConfirmDialog::setVisible( bool visible )
+{
+    if ( visible && !isVisible() )
+    {
+        qDebug() << "Mostrando e iniciando los temporizadores";
+        mTotalTimer->start(mSecTotal);
+        mUpdateTimer->start(mUpdateInterval);
+    }
+    else if ( !visible )
+    {
+        mTotalTimer->stop();
+        mUpdateTimer->stop();
+    }
+    QDialog::setVisible( visible );
+}
+
 void QTimerConfirmDialog::setRefreshInterval( int milisec )
 {
     mUpdateInterval = milisec;
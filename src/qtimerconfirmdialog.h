@@ -30,9 +30,10 @@ public:
     ~QTimerConfirmDialog();
 
     /**
-     * Execute the dialog modelessly - see @see QDialog .
+     * Show or hide the dialog, the timers run while it is visible.
+     * show() runs it modelessly - see @see QDialog .
      */
-//   virtual void setVisible( bool visible );
+    virtual void setVisible( bool visible );
     /**
      * Set the refresh interval for the timer progress. Defaults to one second.
      */
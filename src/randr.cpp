@@ -19,12 +19,15 @@
  */
 
 #include <QtGui/QIcon>
+#include <QtGui/QPixmap>
 #include "qtimerconfirmdialog.h"
 #include "randr.h"
+#include "randrtrace.h"
 
 bool RandR::has_1_2 = true;
 bool RandR::has_1_3 = true;
-Time RandR::timestamp = 0;
+bool RandR::reprobe = false;
+bool RandR::threads = false;
 
 QString RandR::rotationName(int rotation, bool pastTense, bool capitalised)
 {
@@ -124,6 +127,7 @@ QPixmap RandR::rotationIcon(int rotation, int currentRotation)
 bool RandR::confirm(const QRect &rect)
 {
     Q_UNUSED(rect);
+    RandRTrace::Span span("confirm");
 
     qDebug() << "Confirm the changes";
     QTimerConfirmDialog acceptDialog(15000, QObject::tr("Your screen configuration has been "
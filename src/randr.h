@@ -23,12 +23,18 @@
 #define RANDR_H
 
 #include <QtCore/QDebug>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
 #include <QtCore/QString>
-#include <QtGui/QPixmap>
 #include <config-randr.h>
 
 #include <X11/extensions/Xrandr.h>
 
+// QtCore only, the startup program uses the typedefs without QtGui
+class QPixmap;
+
 #ifdef HAS_RANDR_1_2
 class RandRScreen;
 class RandRCrtc;
@@ -58,7 +64,12 @@ class RandR
 public:
     static bool has_1_2;
     static bool has_1_3;
-    static Time timestamp;
+    /** When set, every screen probe asks the server to poll the hardware
+     * (XRRGetScreenResources) instead of using its cached state. */
+    static bool reprobe;
+    /** Set once XInitThreads() was called. The displays then probe and
+     * apply on a RandRWorker thread while the event loop runs. */
+    static bool threads;
 
     static const int OrientationCount = 6;
     static const int RotationCount    = 4;
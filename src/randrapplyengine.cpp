@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QSet>
+#include <string.h>
+
+#include "randrapplyengine.h"
+#include "randrtrace.h"
+
+RandRApplyEngine::CrtcConfig::CrtcConfig()
+    : mode(None),
+      rotation(RR_Rotate_0)
+{
+}
+
+bool RandRApplyEngine::CrtcConfig::operator==(const CrtcConfig &other) const
+{
+    if (mode == None || other.mode == None)
+        return mode == other.mode;
+
+    return mode == other.mode && pos == other.pos && rotation == other.rotation &&
+           outputs.toSet() == other.outputs.toSet();
+}
+
+bool RandRApplyEngine::CrtcConfig::operator!=(const CrtcConfig &other) const
+{
+    return !(*this == other);
+}
+
+RandRApplyEngine::RandRApplyEngine(RandRBackend *backend, Window root, XRRScreenResources *resources)
+    : m_backend(backend),
+      m_root(root),
+      m_resources(resources),
+      m_progress(0),
+      m_modesets(0),
+      m_resizes(0),
+      m_invalidConfigTime(false)
+{
+    Q_ASSERT(m_backend && m_resources);
+    for (int i = 0; i < m_resources->nmode; ++i)
+        m_modes.insert(m_resources->modes[i].id, &m_resources->modes[i]);
+}
+
+XRRScreenResources *RandRApplyEngine::readResources(RandRBackend *backend, Window root, bool has_1_3,
+                                                    bool poll)
+{
+    XRRScreenResources *resources = 0;
+#ifdef HAS_RANDR_1_3
+    // like RandRSnapshot, don't make the server poll the outputs unless
+    // it has never done so
+    if (has_1_3 && !poll)
+    {
+        resources = backend->screenResources(root, false);
+        if (resources && !resources->nmode)
+        {
+            backend->freeScreenResources(resources);
+            resources = 0;
+        }
+    }
+#else
+    Q_UNUSED(has_1_3);
+    Q_UNUSED(poll);
+#endif
+    if (!resources)
+        resources = backend->screenResources(root, true);
+    return resources;
+}
+
+void RandRApplyEngine::readCrtcs(ConfigMap &configs, const CrtcList &crtcs) const
+{
+    CrtcList ids = crtcs;
+    if (ids.isEmpty())
+    {
+        for (int i = 0; i < m_resources->ncrtc; ++i)
+            ids.append(m_resources->crtcs[i]);
+    }
+
+    foreach(RRCrtc id, ids)
+    {
+        RandRCrtcInfo info;
+        if (!m_backend->crtcInfo(m_resources, id, info))
+            continue;
+
+        CrtcConfig config;
+        config.mode = info.mode;
+        config.pos = info.rect.topLeft();
+        config.rotation = info.rotation;
+        config.outputs = info.outputs;
+        config.extents = info.rect;
+        configs.insert(id, config);
+    }
+}
+
+QSize RandRApplyEngine::screenSize(const ConfigMap &configs)
+{
+    QRect bounds;
+    foreach(const CrtcConfig &config, configs)
+    {
+        if (config.mode != None)
+            bounds |= config.extents;
+    }
+    return bounds.isValid() ? QRect(QPoint(0, 0), bounds.bottomRight()).size() : QSize(0, 0);
+}
+
+QSize RandRApplyEngine::sizeMM(const QSize &size, const QSize &currentSize, const QSize &currentSizeMM)
+{
+    if (currentSizeMM.height() <= 0)
+        return currentSizeMM;
+
+    /* values taken from xrandr */
+    float dpi = (25.4 * currentSize.height()) / currentSizeMM.height();
+    return QSize((int) ((25.4 * size.width()) / dpi), (int) ((25.4 * size.height()) / dpi));
+}
+
+XTransform RandRApplyEngine::scale(double x, double y)
+{
+    XTransform transform;
+    memset(&transform, 0, sizeof(transform));
+    transform.matrix[0][0] = XDoubleToFixed(x);
+    transform.matrix[1][1] = XDoubleToFixed(y);
+    transform.matrix[2][2] = XDoubleToFixed(1.0);
+    return transform;
+}
+
+const XRRModeInfo *RandRApplyEngine::modeInfo(RRMode mode) const
+{
+    return m_modes.value(mode);
+}
+
+QSize RandRApplyEngine::modeSize(RRMode mode, int rotation) const
+{
+    const XRRModeInfo *info = m_modes.value(mode);
+    if (!info)
+        return QSize();
+
+    if (rotation & (RR_Rotate_90 | RR_Rotate_270))
+        return QSize(info->height, info->width);
+    return QSize(info->width, info->height);
+}
+
+void RandRApplyEngine::setState(const ConfigMap &state, const QSize &size, const QSize &sizeMM)
+{
+    m_state = state;
+    m_stateSize = size;
+    m_stateSizeMM = sizeMM;
+    m_previousTransforms.clear();
+    m_changed.clear();
+    m_modesets = 0;
+    m_resizes = 0;
+    m_invalidConfigTime = false;
+}
+
+void RandRApplyEngine::setTransforms(const QMap<RRCrtc, XTransform> &transforms)
+{
+    m_transforms = transforms;
+}
+
+void RandRApplyEngine::setProgress(Progress *progress)
+{
+    m_progress = progress;
+}
+
+const RandRApplyEngine::ConfigMap &RandRApplyEngine::state() const
+{
+    return m_state;
+}
+
+QSize RandRApplyEngine::stateSize() const
+{
+    return m_stateSize;
+}
+
+const CrtcList &RandRApplyEngine::changed() const
+{
+    return m_changed;
+}
+
+int RandRApplyEngine::modesets() const
+{
+    return m_modesets;
+}
+
+int RandRApplyEngine::resizes() const
+{
+    return m_resizes;
+}
+
+bool RandRApplyEngine::invalidConfigTime() const
+{
+    return m_invalidConfigTime;
+}
+
+void RandRApplyEngine::step()
+{
+    if (m_progress)
+        m_progress->step();
+}
+
+bool RandRApplyEngine::setCrtcConfig(RRCrtc id, const CrtcConfig &config)
+{
+    RandRTrace::Span span("crtc", id);
+    // the timestamp is CurrentTime because every request changes the
+    // configuration time; the configTimestamp of the resources still
+    // protects against changes made by other clients
+    Status s = m_backend->setCrtcConfig(m_resources, id, config.pos, config.mode,
+                                        config.mode != None ? config.rotation : (int) RR_Rotate_0,
+                                        config.mode != None ? config.outputs : OutputList());
+    m_modesets++;
+
+    if (s != RRSetConfigSuccess)
+    {
+        qDebug() << "Failed to set configuration of CRTC" << id << "status" << s;
+        if (s == RRSetConfigInvalidConfigTime)
+            m_invalidConfigTime = true;
+        return false;
+    }
+
+    m_state[id] = config;
+    if (!m_changed.contains(id))
+        m_changed.append(id);
+    return true;
+}
+
+void RandRApplyEngine::setCrtcTransform(RRCrtc id, const XTransform &transform)
+{
+    if (!m_previousTransforms.contains(id))
+    {
+        Transform previous;
+        if (m_backend->crtcTransform(id, previous.matrix, previous.filter))
+            m_previousTransforms.insert(id, previous);
+    }
+
+    XTransform matrix = transform;
+    m_backend->setCrtcTransform(id, &matrix, "bilinear");
+}
+
+void RandRApplyEngine::restoreTransforms(const ConfigMap &original)
+{
+    QMap<RRCrtc, Transform>::const_iterator it;
+    for (it = m_previousTransforms.constBegin(); it != m_previousTransforms.constEnd(); ++it)
+    {
+        XTransform matrix = it.value().matrix;
+        m_backend->setCrtcTransform(it.key(), &matrix,
+                                    it.value().filter.isEmpty() ? 0 : it.value().filter.constData());
+        const CrtcConfig config = original.value(it.key());
+        if (config.mode != None)
+            setCrtcConfig(it.key(), config);
+    }
+    m_previousTransforms.clear();
+}
+
+bool RandRApplyEngine::execute(const ConfigMap &target, const QSize &size, const QSize &sizeMM)
+{
+    QRect screen(QPoint(0, 0), size);
+
+    // disable the crtcs that are turned off, change their outputs, or would
+    // not fit in the new screen size
+    const ConfigMap state = m_state;
+    ConfigMap::const_iterator it;
+    for (it = state.constBegin(); it != state.constEnd(); ++it)
+    {
+        const CrtcConfig &current = it.value();
+        if (current.mode == None || !target.contains(it.key()))
+            continue;
+
+        const CrtcConfig &wanted = target[it.key()];
+        if (current == wanted)
+            continue;
+
+        if (wanted.mode == None || wanted.outputs.toSet() != current.outputs.toSet() ||
+            !screen.contains(current.extents))
+        {
+            if (!setCrtcConfig(it.key(), CrtcConfig()))
+                return false;
+            if (wanted.mode == None)
+                step();
+        }
+    }
+
+    if (size != m_stateSize)
+    {
+        RandRTrace::Span span("resize");
+        m_backend->setScreenSize(m_root, size, sizeMM);
+        m_stateSize = size;
+        m_stateSizeMM = sizeMM;
+        m_resizes++;
+        step();
+    }
+
+    // now set every crtc to its final configuration
+    for (it = target.constBegin(); it != target.constEnd(); ++it)
+    {
+        if (it.value().mode == None || m_state.value(it.key()) == it.value())
+            continue;
+
+        if (m_transforms.contains(it.key()))
+            setCrtcTransform(it.key(), m_transforms.value(it.key()));
+
+        if (!setCrtcConfig(it.key(), it.value()))
+            return false;
+        step();
+    }
+
+    return true;
+}
+
+bool RandRApplyEngine::apply(const ConfigMap &target, const QSize &size, const QSize &sizeMM, bool revert)
+{
+    // crtcs that were off are turned off again
+    ConfigMap original = m_state;
+    foreach(RRCrtc id, target.keys())
+    {
+        if (!original.contains(id))
+            original.insert(id, CrtcConfig());
+    }
+    QSize originalSize = m_stateSize;
+    QSize originalSizeMM = m_stateSizeMM;
+
+    m_backend->grabServer();
+    bool succeed = execute(target, size, sizeMM);
+    if (!succeed && revert)
+    {
+        qDebug() << "Reverting to the previous configuration";
+        Progress *progress = m_progress;
+        QMap<RRCrtc, XTransform> transforms = m_transforms;
+        m_progress = 0;
+        m_transforms.clear();
+        execute(original, originalSize, originalSizeMM);
+        restoreTransforms(original);
+        m_progress = progress;
+        m_transforms = transforms;
+    }
+    m_backend->ungrabServer();
+    m_backend->sync();
+    return succeed;
+}
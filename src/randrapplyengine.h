@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRAPPLYENGINE_H
+#define RANDRAPPLYENGINE_H
+
+#include <QtCore/QMap>
+#include <QtCore/QPoint>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+
+#include "randrbackend.h"
+
+/** Moves the CRTCs of a screen from one configuration to another.
+ *
+ * RandRTransaction, RandRStartup and RandRApplyPlan all change the
+ * configuration the same way, only what they start from differs: CRTCs
+ * that are turned off, change their outputs or would not fit are
+ * disabled, the screen is resized once and the other CRTCs are set to
+ * their final configuration. apply() does this under a server grab and
+ * goes back to the configuration it started from if the server refuses
+ * any step.
+ *
+ * It only uses QtCore and a RandRBackend, so that the startup program can
+ * share it with the model. */
+class RandRApplyEngine
+{
+public:
+    struct CrtcConfig
+    {
+        CrtcConfig();
+        /** The outputs are compared as a set, the server may list them in
+         * another order. */
+        bool operator==(const CrtcConfig &other) const;
+        bool operator!=(const CrtcConfig &other) const;
+
+        RRMode mode;
+        QPoint pos;
+        int rotation;
+        OutputList outputs;
+        /** The area of the screen covered by the CRTC */
+        QRect extents;
+    };
+    typedef QMap<RRCrtc, CrtcConfig> ConfigMap;
+
+    /** Told about each CRTC, and the screen size, that reached its final
+     * configuration while apply() moves to the target. */
+    class Progress
+    {
+    public:
+        virtual ~Progress() {}
+        virtual void step() = 0;
+    };
+
+    /** @p resources are those the requests are sent with, they belong to
+     * the caller. */
+    RandRApplyEngine(RandRBackend *backend, Window root, XRRScreenResources *resources);
+
+    /** The resources of @p root. Unless @p poll is set, the configuration
+     * the server knows is used if it has ever probed the outputs. */
+    static XRRScreenResources *readResources(RandRBackend *backend, Window root, bool has_1_3,
+                                             bool poll = false);
+    /** Read the configuration of @p crtcs, every CRTC of the resources if
+     * it is empty. The CRTCs that cannot be read are left out. */
+    void readCrtcs(ConfigMap &configs, const CrtcList &crtcs = CrtcList()) const;
+
+    /** The size of the screen holding every enabled CRTC of @p configs,
+     * which always starts at the origin. Empty if every CRTC is off. */
+    static QSize screenSize(const ConfigMap &configs);
+    /** The physical size of a screen of @p size with the resolution of
+     * the current one, like xrandr computes it. */
+    static QSize sizeMM(const QSize &size, const QSize &currentSize, const QSize &currentSizeMM);
+    /** A transform scaling by @p x and @p y. */
+    static XTransform scale(double x, double y);
+
+    /** The size of @p mode once rotated, empty if the resources do not
+     * have the mode. */
+    QSize modeSize(RRMode mode, int rotation) const;
+    const XRRModeInfo *modeInfo(RRMode mode) const;
+
+    /** The configuration the server has. The transforms the CRTCs had
+     * before this engine changed them are forgotten. */
+    void setState(const ConfigMap &state, const QSize &size, const QSize &sizeMM);
+    /** The transform set before a CRTC gets its target configuration. */
+    void setTransforms(const QMap<RRCrtc, XTransform> &transforms);
+    void setProgress(Progress *progress);
+
+    /** Move from the state to @p target without grabbing the server. The
+     * CRTCs that are not in @p target keep their configuration. Stops at
+     * the first request the server refuses. */
+    bool execute(const ConfigMap &target, const QSize &size, const QSize &sizeMM);
+    /** execute() under a server grab. If it fails and @p revert is set,
+     * the state it started from is restored before the grab is released,
+     * the transforms that were replaced included. Waits until the server
+     * handled every request. */
+    bool apply(const ConfigMap &target, const QSize &size, const QSize &sizeMM, bool revert = true);
+
+    const ConfigMap &state() const;
+    QSize stateSize() const;
+    /** The CRTCs that were set, in order */
+    const CrtcList &changed() const;
+    int modesets() const;
+    int resizes() const;
+    /** The server refused a request because the outputs or modes changed
+     * since the resources were read. */
+    bool invalidConfigTime() const;
+
+private:
+    struct Transform
+    {
+        XTransform matrix;
+        QByteArray filter;
+    };
+
+    bool setCrtcConfig(RRCrtc id, const CrtcConfig &config);
+    /** Send the transform of @p id, after reading the one it replaces. */
+    void setCrtcTransform(RRCrtc id, const XTransform &transform);
+    /** Send the transforms read by setCrtcTransform() again. They only
+     * take effect with the next configuration of their CRTC, the ones
+     * that are on are set again to @p original. */
+    void restoreTransforms(const ConfigMap &original);
+    void step();
+
+    RandRBackend *m_backend;
+    Window m_root;
+    XRRScreenResources *m_resources;
+    QMap<RRMode, const XRRModeInfo*> m_modes;
+
+    ConfigMap m_state;
+    QSize m_stateSize;
+    QSize m_stateSizeMM;
+    QMap<RRCrtc, XTransform> m_transforms;
+    /** What the CRTCs scanned out with before their transform was sent */
+    QMap<RRCrtc, Transform> m_previousTransforms;
+    Progress *m_progress;
+    CrtcList m_changed;
+    int m_modesets;
+    int m_resizes;
+    bool m_invalidConfigTime;
+};
+
+#endif // RANDRAPPLYENGINE_H
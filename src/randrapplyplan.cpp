@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <string.h>
+
+#include "randrapplyplan.h"
+#include "randrlayoutstore.h"
+#include "randrgammalut.h"
+
+int RandRApplyPlan::s_errors = 0;
+
+RandRApplyPlan::ScreenState::ScreenState()
+    : setsPrimary(false),
+      primary(None)
+{
+}
+
+RandRApplyPlan::RandRApplyPlan()
+{
+}
+
+QString RandRApplyPlan::defaultFileName()
+{
+    return RandRLayoutStore::configFileName(".plan");
+}
+
+bool RandRApplyPlan::load(const QString &fileName)
+{
+    m_operations.clear();
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    // a plan is a few kilobytes at most, it is read in one go
+    QByteArray data = file.readAll();
+    const Header *header = (const Header*) data.constData();
+    if (data.size() < (int) sizeof(Header) || header->magic != Magic ||
+        header->version != Version || header->operationSize != sizeof(Operation) ||
+        data.size() != (int) (sizeof(Header) + header->count * sizeof(Operation)))
+    {
+        qDebug() << "Ignoring the invalid apply plan" << fileName;
+        return false;
+    }
+
+    m_operations.resize(header->count);
+    memcpy(m_operations.data(), data.constData() + sizeof(Header), header->count * sizeof(Operation));
+    return true;
+}
+
+bool RandRApplyPlan::save(const QString &fileName) const
+{
+    Header header;
+    header.magic = Magic;
+    header.version = Version;
+    header.operationSize = sizeof(Operation);
+    header.count = m_operations.count();
+
+    if (!RandRLayoutStore::writeFile(fileName, &header, sizeof(header), m_operations.constData(),
+                                     m_operations.count() * sizeof(Operation)))
+    {
+        qDebug() << "Cannot save the apply plan" << fileName;
+        return false;
+    }
+    return true;
+}
+
+bool RandRApplyPlan::isEmpty() const
+{
+    return m_operations.isEmpty();
+}
+
+const QVector<RandRApplyPlan::Operation> &RandRApplyPlan::operations() const
+{
+    return m_operations;
+}
+
+void RandRApplyPlan::removeScreen(int screen)
+{
+    QVector<Operation> operations;
+    foreach(const Operation &op, m_operations)
+    {
+        if (op.screen != screen)
+            operations.append(op);
+    }
+    m_operations = operations;
+}
+
+void RandRApplyPlan::append(const Operation &operation)
+{
+    m_operations.append(operation);
+}
+
+RandRApplyPlan::Operation RandRApplyPlan::operation(OperationType type, int screen, quint32 id)
+{
+    Operation op;
+    memset(&op, 0, sizeof(op));
+    op.type = type;
+    op.screen = screen;
+    op.id = id;
+    op.rotation = RR_Rotate_0;
+    return op;
+}
+
+int RandRApplyPlan::errorHandler(Display *dpy, XErrorEvent *event)
+{
+    Q_UNUSED(dpy);
+    qDebug() << "X error" << event->error_code << "for request" << event->request_code
+             << "minor" << event->minor_code << "while executing the apply plan";
+    ++s_errors;
+    return 0;
+}
+
+bool RandRApplyPlan::checkConfig(RandRBackend *backend, QVector<XRRScreenResources*> &resources, bool poll) const
+{
+    bool has_1_3 = backend->has_1_3();
+
+    foreach(const Operation &op, m_operations)
+    {
+        if (op.type != CheckConfig)
+            continue;
+        if (op.screen < 0 || op.screen >= resources.count())
+        {
+            qDebug() << "The apply plan is for screen" << op.screen << "which does not exist";
+            return false;
+        }
+
+        // the current resources are enough unless a poll was asked for,
+        // the plan has to be thrown away anyway if the outputs changed
+        XRRScreenResources *r = backend->screenResources(backend->rootWindow(op.screen), poll || !has_1_3);
+        if (!r)
+            return false;
+        resources[op.screen] = r;
+
+        if (r->configTimestamp != op.timestamp)
+        {
+            qDebug() << "The configuration of screen" << op.screen << "changed since the apply plan was compiled"
+                     << "(config timestamp" << r->configTimestamp << "instead of" << op.timestamp << ")";
+            return false;
+        }
+    }
+
+    // every operation must be on a checked screen
+    foreach(const Operation &op, m_operations)
+    {
+        if (op.screen < 0 || op.screen >= resources.count() || !resources.at(op.screen))
+            return false;
+    }
+    return true;
+}
+
+template <class T>
+static bool contains(const T *ids, int count, T id)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        if (ids[i] == id)
+            return true;
+    }
+    return false;
+}
+
+static bool containsMode(const XRRScreenResources *resources, RRMode mode)
+{
+    for (int i = 0; i < resources->nmode; ++i)
+    {
+        if (resources->modes[i].id == mode)
+            return true;
+    }
+    return false;
+}
+
+bool RandRApplyPlan::checkOperations(const QVector<XRRScreenResources*> &resources) const
+{
+    foreach(const Operation &op, m_operations)
+    {
+        const XRRScreenResources *r = resources.at(op.screen);
+        bool valid = true;
+        switch (op.type)
+        {
+        case CheckConfig:
+            break;
+
+        case GrowScreen:
+        case SetScreenSize:
+            valid = op.geometry[0] > 0 && op.geometry[1] > 0;
+            break;
+
+        case SetCrtc:
+            valid = op.outputCount <= (quint32) MaxOutputs && containsMode(r, op.mode);
+            for (quint32 i = 0; valid && i < op.outputCount; ++i)
+                valid = contains<RROutput>(r->outputs, r->noutput, op.outputs[i]);
+            // fall through, the crtc is checked too
+        case DisableCrtc:
+        case SetTransform:
+        case SetPanning:
+        case SetGamma:
+            valid = valid && contains<RRCrtc>(r->crtcs, r->ncrtc, op.id);
+            break;
+
+        case SetPrimary:
+            valid = op.id == None || contains<RROutput>(r->outputs, r->noutput, op.id);
+            break;
+
+        default:
+            valid = false;
+        }
+
+        if (!valid)
+        {
+            qDebug() << "Operation" << op.type << "for" << op.id << "of the apply plan does not match"
+                     << "the resources of screen" << op.screen;
+            return false;
+        }
+    }
+    return true;
+}
+
+void RandRApplyPlan::saveState(RandRBackend *backend, const QVector<XRRScreenResources*> &resources,
+                               QVector<ScreenState> &states) const
+{
+    states.resize(resources.count());
+    foreach(const Operation &op, m_operations)
+    {
+        if (op.type == SetPrimary)
+            states[op.screen].setsPrimary = true;
+    }
+
+    for (int screen = 0; screen < resources.count(); ++screen)
+    {
+        if (!resources.at(screen))
+            continue;
+
+        ScreenState &state = states[screen];
+        Window root = backend->rootWindow(screen);
+        RandRApplyEngine(backend, root, resources.at(screen)).readCrtcs(state.crtcs);
+        state.size = backend->screenSize(screen);
+        state.sizeMM = backend->screenSizeMM(screen);
+        if (state.setsPrimary)
+            state.primary = backend->outputPrimary(root);
+    }
+}
+
+void RandRApplyPlan::restoreState(RandRBackend *backend, const QVector<XRRScreenResources*> &resources,
+                                  const QVector<ScreenState> &states) const
+{
+    for (int screen = 0; screen < resources.count(); ++screen)
+    {
+        if (!resources.at(screen))
+            continue;
+
+        qDebug() << "Restoring the previous configuration of screen" << screen;
+        const ScreenState &state = states.at(screen);
+        Window root = backend->rootWindow(screen);
+        RandRApplyEngine engine(backend, root, resources.at(screen));
+
+        // the server is still grabbed, what it has now is what is undone.
+        // Xlib does not know the sizes the plan set, the size is sent again
+        RandRApplyEngine::ConfigMap current;
+        engine.readCrtcs(current);
+        engine.setState(current, QSize(), QSize());
+        if (!engine.execute(state.crtcs, state.size, state.sizeMM))
+            qDebug() << "Cannot restore the previous configuration of screen" << screen;
+
+        if (state.setsPrimary)
+            backend->setOutputPrimary(root, state.primary);
+    }
+}
+
+RandRApplyPlan::Result RandRApplyPlan::execute(RandRBackend *backend, bool poll) const
+{
+    if (m_operations.isEmpty())
+        return Outdated;
+
+    QVector<XRRScreenResources*> resources(backend->screenCount(), 0);
+    Result result = Outdated;
+    if (checkConfig(backend, resources, poll) && checkOperations(resources))
+    {
+        // the requests are not checked one by one, the errors are counted
+        // once the server has handled all of them
+        Display *dpy = backend->display();
+        XErrorHandler previous = 0;
+        s_errors = 0;
+        if (dpy)
+            previous = XSetErrorHandler(errorHandler);
+        backend->grabServer();
+
+        QVector<ScreenState> states;
+        saveState(backend, resources, states);
+
+        result = Applied;
+        foreach(const Operation &op, m_operations)
+        {
+            if (!executeOperation(backend, resources.at(op.screen), op))
+            {
+                result = Failed;
+                break;
+            }
+        }
+
+        // the server is only released once it is known whether it took
+        // every request, so that no client sees a half configured screen
+        backend->sync();
+        if (s_errors)
+            result = Failed;
+        if (result == Failed)
+            restoreState(backend, resources, states);
+
+        backend->ungrabServer();
+        backend->sync();
+        if (dpy)
+            XSetErrorHandler(previous);
+    }
+
+    foreach(XRRScreenResources *r, resources)
+    {
+        if (r)
+            backend->freeScreenResources(r);
+    }
+    return result;
+}
+
+bool RandRApplyPlan::executeOperation(RandRBackend *backend, XRRScreenResources *resources,
+                                      const Operation &op) const
+{
+    switch (op.type)
+    {
+    case CheckConfig:
+        return true;
+
+    case DisableCrtc:
+        return backend->setCrtcConfig(resources, op.id, QPoint(0, 0), None, RR_Rotate_0,
+                                      OutputList()) == RRSetConfigSuccess;
+
+    case GrowScreen:
+    case SetScreenSize:
+    {
+        // Xlib only learns about the new size from the notify events, the
+        // final size is sent even if growing the screen already set it
+        QSize current = backend->screenSize(op.screen);
+        QSize size(op.geometry[0], op.geometry[1]);
+        if (op.type == GrowScreen)
+        {
+            size = size.expandedTo(current);
+            if (size == current)
+                return true;
+        }
+        else if (size == current)
+            return true;
+
+        int widthMM = op.geometry[0] ? op.geometry[2] * size.width() / op.geometry[0] : 0;
+        int heightMM = op.geometry[1] ? op.geometry[3] * size.height() / op.geometry[1] : 0;
+        backend->setScreenSize(backend->rootWindow(op.screen), size, QSize(widthMM, heightMM));
+        return true;
+    }
+
+    case SetTransform:
+    {
+        XTransform transform;
+        memset(&transform, 0, sizeof(transform));
+        transform.matrix[0][0] = op.geometry[0];
+        transform.matrix[1][1] = op.geometry[1];
+        transform.matrix[2][2] = XDoubleToFixed(1.0);
+        backend->setCrtcTransform(op.id, &transform, "bilinear");
+        return true;
+    }
+
+    case SetCrtc:
+    {
+        OutputList outputs;
+        int count = qMin((int) op.outputCount, (int) MaxOutputs);
+        for (int i = 0; i < count; ++i)
+            outputs.append(op.outputs[i]);
+
+        Status s = backend->setCrtcConfig(resources, op.id, QPoint(op.geometry[0], op.geometry[1]),
+                                          op.mode, op.rotation, outputs);
+        if (s != RRSetConfigSuccess)
+        {
+            qDebug() << "Failed to set configuration of CRTC" << op.id << "status" << s;
+            return false;
+        }
+        return true;
+    }
+
+    case SetPanning:
+    {
+        QRect area(op.geometry[0], op.geometry[1], op.geometry[2], op.geometry[3]);
+        if (backend->setPanning(resources, op.id, area) != RRSetConfigSuccess)
+            qDebug() << "Failed to set the panning of CRTC" << op.id;
+        return true;
+    }
+
+    case SetGamma:
+    {
+        int size = backend->crtcGammaSize(op.id);
+        QVector<unsigned short> ramp = RandRGammaLut::ramp(size, op.gamma[0], op.gamma[1],
+                                                           op.gamma[2], op.gamma[3]);
+        if (!ramp.isEmpty())
+            backend->setCrtcGamma(op.id, size, ramp.constData());
+        return true;
+    }
+
+    case SetPrimary:
+        backend->setOutputPrimary(backend->rootWindow(op.screen), op.id);
+        return true;
+    }
+
+    qDebug() << "Unknown operation" << op.type << "in the apply plan";
+    return false;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRAPPLYPLAN_H
+#define RANDRAPPLYPLAN_H
+
+#include <QtCore/QMap>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <config-randr.h>
+
+#include "randrapplyengine.h"
+
+/** The configuration of the screens compiled into the requests that set it.
+ *
+ * Applying the saved layouts means reading every output and CRTC to find
+ * out which settings and modes to use. A plan is compiled once the user
+ * applied a layout (see RandRScreen::compilePlan()) and stores the result:
+ * an ordered list of CRTC, mode, position, rotation, screen size and gamma
+ * operations that execute() sends as they are.
+ *
+ * The ids in a plan are only meaningful while the outputs and modes of the
+ * server stay the same, that is while the config timestamp of its screen
+ * resources does not change. Each screen starts with a CheckConfig
+ * operation and nothing is sent unless every screen passes its check and
+ * every CRTC, output and mode of the plan is in its resources. If the
+ * server refuses a request, the CRTCs and screen sizes they had are
+ * restored before the server is released. */
+class RandRApplyPlan
+{
+public:
+    enum OperationType
+    {
+        /** Compare the config timestamp of the screen */
+        CheckConfig = 1,
+        DisableCrtc = 2,
+        /** Make the screen at least as large as the new configuration,
+         * before the CRTCs are moved */
+        GrowScreen = 3,
+        /** Set the final size of the screen, once the CRTCs are set */
+        SetScreenSize = 4,
+        SetTransform = 5,
+        SetCrtc = 6,
+        SetPanning = 7,
+        SetGamma = 8,
+        /** The output is the id, None for no primary output */
+        SetPrimary = 9
+    };
+
+    enum Result
+    {
+        Applied,
+        /** The server configuration changed since the plan was compiled,
+         * or the plan does not match it: nothing has been sent */
+        Outdated,
+        Failed
+    };
+
+    static const quint32 Magic = 0x504c584c; // "LXLP"
+    static const quint32 Version = 1;
+    /** The most outputs a CRTC can drive in a plan */
+    static const int MaxOutputs = 8;
+
+    /** One request. Its layout is the file format. */
+    struct Operation
+    {
+        quint32 type;
+        qint32 screen;
+        /** The CRTC, or the output of SetPrimary */
+        quint32 id;
+        quint32 mode;
+        quint32 rotation;
+        /** The config timestamp checked by CheckConfig */
+        quint32 timestamp;
+        /** SetCrtc: the position. GrowScreen and SetScreenSize: the size in
+         * pixels and in millimeters. SetPanning: the panning area.
+         * SetTransform: the horizontal and vertical scale as XFixed */
+        qint32 geometry[4];
+        /** SetGamma: brightness, red, green and blue */
+        float gamma[4];
+        quint32 outputCount;
+        quint32 outputs[MaxOutputs];
+    };
+
+    RandRApplyPlan();
+
+    /** The plan next to the layout store. */
+    static QString defaultFileName();
+
+    bool load(const QString &fileName = defaultFileName());
+    bool save(const QString &fileName = defaultFileName()) const;
+
+    bool isEmpty() const;
+    const QVector<Operation> &operations() const;
+
+    /** Drop the operations of @p screen. */
+    void removeScreen(int screen);
+    void append(const Operation &operation);
+
+    /** An empty operation. */
+    static Operation operation(OperationType type, int screen, quint32 id = None);
+
+    /** Send the operations through @p backend under a server grab. With
+     * @p poll the outputs are polled first, so that the plan is found out
+     * of date if the monitors changed without the server noticing. */
+    Result execute(RandRBackend *backend, bool poll = false) const;
+
+private:
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 operationSize;
+        quint32 count;
+    };
+
+    /** What a screen had before the plan was executed */
+    struct ScreenState
+    {
+        ScreenState();
+
+        QMap<RRCrtc, RandRApplyEngine::CrtcConfig> crtcs;
+        QSize size;
+        QSize sizeMM;
+        /** Only restored if the plan sets the primary output */
+        bool setsPrimary;
+        RROutput primary;
+    };
+
+    bool checkConfig(RandRBackend *backend, QVector<XRRScreenResources*> &resources, bool poll) const;
+    /** Whether the CRTCs, outputs and modes of every operation are in
+     * @p resources. */
+    bool checkOperations(const QVector<XRRScreenResources*> &resources) const;
+    void saveState(RandRBackend *backend, const QVector<XRRScreenResources*> &resources,
+                   QVector<ScreenState> &states) const;
+    void restoreState(RandRBackend *backend, const QVector<XRRScreenResources*> &resources,
+                      const QVector<ScreenState> &states) const;
+    bool executeOperation(RandRBackend *backend, XRRScreenResources *resources, const Operation &op) const;
+    static int errorHandler(Display *dpy, XErrorEvent *event);
+
+    QVector<Operation> m_operations;
+
+    static int s_errors;
+};
+
+#endif // RANDRAPPLYPLAN_H
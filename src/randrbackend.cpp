@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtGui/QX11Info>
+
+#include "randrbackend.h"
+#include "randrxlibbackend.h"
+
+RandRBackend *RandRBackend::s_instance = 0;
+RandRBackend *RandRBackend::s_xlib = 0;
+
+RandRBackend *RandRBackend::instance()
+{
+    if (s_instance)
+        return s_instance;
+
+    if (!s_xlib)
+        s_xlib = new RandRXlibBackend(QX11Info::display());
+    return s_xlib;
+}
+
+void RandRBackend::setInstance(RandRBackend *backend)
+{
+    s_instance = backend;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRBACKEND_H
+#define RANDRBACKEND_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QPoint>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+
+#include "randrprobe.h"
+
+/** What RandRScreen, RandRCrtc, RandROutput and the classes they use ask
+ * from the RandR server.
+ *
+ * The model goes through instance(), which is RandRXlibBackend on the X
+ * display of the application unless another backend was installed with
+ * setInstance(). RandRSimBackend simulates a server in the process, so the
+ * model can be run and timed without an X server.
+ *
+ * The methods follow the Xlib calls they replace; the screen resources
+ * are returned as an XRRScreenResources that has to be released with
+ * freeScreenResources() of the same backend. */
+class RandRBackend
+{
+public:
+    // inline, the startup program uses the Xlib backend without instance()
+    RandRBackend() : m_major(-1), m_minor(-1) {}
+    virtual ~RandRBackend() {}
+
+    static RandRBackend *instance();
+    /** Use @p backend from now on. The caller keeps its ownership and has
+     * to reset it before deleting it. 0 goes back to the Xlib backend. */
+    static void setInstance(RandRBackend *backend);
+
+    /** The Xlib connection, 0 if the backend does not talk to an X
+     * server. RandRProbe uses it to pipeline its requests. */
+    virtual Display *display() const = 0;
+
+    virtual bool queryExtension(int &eventBase, int &errorBase) = 0;
+    virtual bool queryVersion(int &major, int &minor) = 0;
+
+    /** Whether the server of this backend speaks RandR 1.2 or 1.3. The
+     * version is asked once; every display of a process can run another
+     * server, so it is not kept in RandR::has_1_2 and RandR::has_1_3. */
+    bool has_1_2();
+    bool has_1_3();
+
+    virtual int screenCount() = 0;
+    virtual int defaultScreen() = 0;
+    virtual Window rootWindow(int screen) = 0;
+    /** The size of the screen in pixels and in millimeters. */
+    virtual QSize screenSize(int screen) = 0;
+    virtual QSize screenSizeMM(int screen) = 0;
+    virtual bool screenSizeRange(Window root, QSize &minSize, QSize &maxSize) = 0;
+    virtual void setScreenSize(Window root, const QSize &size, const QSize &sizeMM) = 0;
+    virtual void selectInput(Window root, int mask) = 0;
+
+    /** With @p poll the server probes the outputs again
+     * (XRRGetScreenResources), otherwise it returns the configuration it
+     * knows (XRRGetScreenResourcesCurrent). */
+    virtual XRRScreenResources *screenResources(Window root, bool poll) = 0;
+    virtual void freeScreenResources(XRRScreenResources *resources) = 0;
+
+    virtual bool crtcInfo(XRRScreenResources *resources, RRCrtc crtc, RandRCrtcInfo &info) = 0;
+    virtual bool crtcPanning(XRRScreenResources *resources, RRCrtc crtc, QRect &panning) = 0;
+    /** The transform and filter @p crtc currently scans out with. */
+    virtual bool crtcTransform(RRCrtc crtc, XTransform &transform, QByteArray &filter) = 0;
+    /** Read the gamma ramps of @p crtc into @p info. */
+    virtual bool crtcGamma(RRCrtc crtc, RandRCrtcInfo &info) = 0;
+    virtual int crtcGammaSize(RRCrtc crtc) = 0;
+    virtual bool outputInfo(XRRScreenResources *resources, RROutput output, RandROutputInfo &info) = 0;
+    /** The EDID of the monitor connected to @p output, see RandREdid. */
+    virtual QByteArray edid(RROutput output) = 0;
+    virtual bool isEdidProperty(Atom property) = 0;
+    virtual RROutput outputPrimary(Window root) = 0;
+
+    virtual Status setCrtcConfig(XRRScreenResources *resources, RRCrtc crtc, const QPoint &pos,
+                                 RRMode mode, int rotation, const OutputList &outputs) = 0;
+    virtual void setCrtcTransform(RRCrtc crtc, XTransform *transform, const char *filter) = 0;
+    virtual Status setPanning(XRRScreenResources *resources, RRCrtc crtc, const QRect &area) = 0;
+    /** @p ramps holds the red, green and blue ramps one after the other. */
+    virtual void setCrtcGamma(RRCrtc crtc, int size, const unsigned short *ramps) = 0;
+    virtual void setOutputPrimary(Window root, RROutput output) = 0;
+
+    virtual void grabServer() = 0;
+    virtual void ungrabServer() = 0;
+    /** Wait until the server handled every request sent so far. */
+    virtual void sync() = 0;
+    virtual void flush() = 0;
+    /** Wait at most @p timeout ms for the server to report the change of
+     * every CRTC in @p crtcs. */
+    virtual void waitForCrtcChanges(const CrtcList &crtcs, int timeout) = 0;
+
+private:
+    void readVersion();
+
+    static RandRBackend *s_instance;
+    static RandRBackend *s_xlib;
+
+    int m_major;
+    int m_minor;
+};
+
+inline void RandRBackend::readVersion()
+{
+    if (m_major >= 0)
+        return;
+    if (!queryVersion(m_major, m_minor))
+    {
+        m_major = 0;
+        m_minor = 0;
+    }
+}
+
+inline bool RandRBackend::has_1_2()
+{
+    readVersion();
+    return m_major > 1 || (m_major == 1 && m_minor >= 2);
+}
+
+inline bool RandRBackend::has_1_3()
+{
+    readVersion();
+    return m_major > 1 || (m_major == 1 && m_minor >= 3);
+}
+
+#endif // RANDRBACKEND_H
@@ -17,6 +17,7 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include <QtGui/QApplication>
 #include <QtGui/QMessageBox>
 #include <QtGui/QMenu>
 
@@ -28,6 +29,7 @@
 #include "randroutput.h"
 #include "randrdisplay.h"
 #include "randrscreen.h"
+#include "randrlayoutstore.h"
 
 RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
     : QWidget(parent), Ui::RandRConfigBase()
@@ -48,6 +50,9 @@ RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
     connect( &identifyTimer, SIGNAL(timeout()), SLOT(clearIndicators()));
     connect( &compressUpdateViewTimer, SIGNAL(timeout()), SLOT(slotDelayedUpdateView()));
     connect(unifyOutputs, SIGNAL(toggled(bool)), SLOT(unifiedOutputChanged(bool)));
+    connect(m_display->currentScreen(), SIGNAL(changed(RandRChangeSet)),
+            SLOT(slotScreenChanged(RandRChangeSet)));
+    connect(m_display->currentScreen(), SIGNAL(applied(bool)), SLOT(slotApplied(bool)));
 
     identifyTimer.setSingleShot( true );
     compressUpdateViewTimer.setSingleShot( true );
@@ -75,12 +80,8 @@ RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
         label->setVisible(false);
     }
 
-    QSettings config;
-    config.beginGroup("Screen_0");
-    bool outputunified = config.value("OutputsUnified", false).toBool();
-    config.endGroup();
-
-    if (outputunified)
+    // the screen has read its saved settings when it was created
+    if (m_display->currentScreen()->outputsUnified())
     {
         unifyOutputs->setChecked(true);
     }
@@ -116,7 +117,7 @@ void RandRConfig::load(void)
     m_outputList.clear();
     m_configs.clear(); // objects deleted above
 
-    OutputMap outputs = m_display->currentScreen()->outputs();
+    const OutputMap &outputs = m_display->currentScreen()->outputs();
 #ifdef HAS_RANDR_1_3
     RandROutput *primary = m_display->currentScreen()->primaryOutput();
     if (RandR::has_1_3)
@@ -195,10 +196,14 @@ void RandRConfig::save()
     if (!m_display->isValid())
         return;
 
-    QSettings config;
-    config.beginGroup("Screen_0");
-    config.setValue("OutputsUnified", unifyOutputs->isChecked());
-    config.endGroup();
+    RandRLayoutStore store;
+    store.open();
+    const RandRLayoutStore::Record *saved = store.find(RandRLayoutStore::ScreenRecord, QString(), 0);
+    RandRLayoutStore::Record screen = saved ? *saved
+        : RandRLayoutStore::record(RandRLayoutStore::ScreenRecord, QString(), 0);
+    screen.setFlag(RandRLayoutStore::OutputsUnified, unifyOutputs->isChecked());
+    store.insert(screen);
+    store.save();
 
     apply();
 }
@@ -262,12 +267,8 @@ void RandRConfig::apply()
                      << ", rate =" << config->refreshRate()
                      << ", brightness " << config->brightness();
 
-            // Break the connection with the previous CRTC for changed outputs, since
-            // otherwise the code could try to use the same CRTC for two different outputs.
-            // This is probably rather hackish and may not always work, but I don't see
-            // a better way with this codebase, definitely not with the time I have now.
-            output->disconnectFromCrtc();
-
+            // the outputs keep their CRTC, RandRScreen::assignCrtcs() moves
+            // them only if another output could not be driven otherwise
             output->proposeRect(configuredRect.translated( normalizePos ));
             output->proposeRotation(config->rotation());
             output->proposeRefreshRate(config->refreshRate());
@@ -278,7 +279,7 @@ void RandRConfig::apply()
         } else // user wants to disable this output
         {
             qDebug() << "Disabling" << output->name();
-            output->slotDisable();
+            output->proposeDisable();
         }
     }
 #ifdef HAS_RANDR_1_3
@@ -298,9 +299,31 @@ void RandRConfig::apply()
     }
 #endif //HAS_RANDR_1_3
     m_display->applyProposed();
+    if (m_display->isApplying())
+    {
+        // the changes are sent by the worker thread, nothing can be
+        // edited until slotApplied()
+        setEnabled(false);
+        QApplication::setOverrideCursor(Qt::BusyCursor);
+    }
     update();
 }
 
+bool RandRConfig::isApplying() const
+{
+    return m_display->isApplying();
+}
+
+void RandRConfig::slotApplied(bool succeeded)
+{
+    if (!isEnabled())
+    {
+        setEnabled(true);
+        QApplication::restoreOverrideCursor();
+    }
+    emit applied(succeeded);
+}
+
 void RandRConfig::updatePrimaryDisplay()
 {
     QString primary=primaryDisplayBox->currentText();
@@ -399,7 +422,7 @@ void RandRConfig::identifyOutputs()
     identifyTimer.stop();
     clearIndicators();
     QHash< QPoint, QStringList > ids; // outputs at centers of screens (can be more in case of clone mode)
-    OutputMap outputs = m_display->currentScreen()->outputs();
+    const OutputMap &outputs = m_display->currentScreen()->outputs();
     foreach(RandROutput *output, outputs)
     {
         if( !output->isConnected() || output->rect().isEmpty())
@@ -443,6 +466,16 @@ void RandRConfig::insufficientVirtualSize()
     message.show();
 }
 
+void RandRConfig::slotScreenChanged(const RandRChangeSet &changes)
+{
+    // outputs that appeared or went away need their widgets rebuilt, any
+    // other change is picked up by the outputs' own widgets
+    if (!changes.added.isEmpty() || !changes.removed.isEmpty())
+        load();
+    else
+        slotUpdateView();
+}
+
 bool RandRConfig::x11Event(XEvent* e)
 {
     return QWidget::x11Event(e);
@@ -33,6 +33,7 @@ class RandRDisplay;
 class OutputGraphicsItem;
 class LayoutManager;
 class OutputConfig;
+struct RandRChangeSet;
 
 typedef QList<OutputConfig*> OutputConfigList;
 
@@ -48,6 +49,8 @@ public:
     void defaults(void);
 
     void apply();
+    /** Whether the changes of apply() are still being sent. */
+    bool isApplying() const;
     void update();
 
     virtual bool x11Event(XEvent* e);
@@ -63,9 +66,13 @@ protected slots:
     void clearIndicators();
     void unifiedOutputChanged(bool checked);
     void outputConnectedChanged(bool);
+    void slotScreenChanged(const RandRChangeSet &changes);
+    void slotApplied(bool succeeded);
 
 signals:
     void changed(bool change=true);
+    /** The changes of apply() are in place, or were refused. */
+    void applied(bool succeeded);
 
 protected:
     virtual bool eventFilter(QObject *obj, QEvent *event);
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+
+#include "randrconfirmation.h"
+#include "qtimerconfirmdialog.h"
+#include "randrtrace.h"
+
+RandRConfirmation::RandRConfirmation(const RandRTransaction &transaction, QObject *parent)
+    : QObject(parent),
+      m_transaction(transaction),
+      m_dialog(0),
+      m_pending(false)
+{
+    m_deadline.setSingleShot(true);
+    m_deadline.setInterval(Timeout);
+    connect(&m_deadline, SIGNAL(timeout()), this, SLOT(reject()));
+}
+
+RandRConfirmation::~RandRConfirmation()
+{
+    delete m_dialog;
+}
+
+void RandRConfirmation::start()
+{
+    qDebug() << "Confirm the changes";
+    m_dialog = new QTimerConfirmDialog(Timeout, tr("Your screen configuration has been "
+                                                   "changed to the requested settings.\n"
+                                                   "Please indicate whether you wish to keep "
+                                                   "this configuration.\nIn 15 seconds the "
+                                                   "display will revert to your previous "
+                                                   "settings."),
+                                       tr("Confirm Display Setting Change"),
+                                       false, QTimerConfirmDialog::CountDown, "mainKTimerDialog");
+    connect(m_dialog, SIGNAL(accepted()), this, SLOT(accept()));
+    connect(m_dialog, SIGNAL(rejected()), this, SLOT(reject()));
+
+    m_pending = true;
+    m_deadline.start();
+    m_dialog->show();
+}
+
+bool RandRConfirmation::isPending() const
+{
+    return m_pending;
+}
+
+void RandRConfirmation::accept()
+{
+    finish(true);
+}
+
+void RandRConfirmation::reject()
+{
+    finish(false);
+}
+
+void RandRConfirmation::finish(bool accepted)
+{
+    if (!m_pending)
+        return;
+    m_pending = false;
+    m_deadline.stop();
+
+    RandRTrace::Span span(accepted ? "confirm accepted" : "confirm rejected");
+    if (m_dialog)
+    {
+        m_dialog->disconnect(this);
+        m_dialog->hide();
+        m_dialog->deleteLater();
+        m_dialog = 0;
+    }
+
+    if (!accepted)
+    {
+        qDebug() << "Changes canceled, reverting to original setup.";
+        m_transaction.rollback();
+    }
+
+    emit finished(accepted);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRCONFIRMATION_H
+#define RANDRCONFIRMATION_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+#include "randrtransaction.h"
+
+class QTimerConfirmDialog;
+
+/** The confirmation phase of a committed change.
+ *
+ * The new configuration is already on the screen and the transaction that
+ * set it keeps the previous one. A non modal dialog asks whether to keep
+ * it; if the user refuses or does not answer before the deadline, the
+ * previous configuration is restored by a single rollback of the
+ * transaction. The event loop keeps running in the meantime, so RandR
+ * events are still handled. */
+class RandRConfirmation : public QObject
+{
+    Q_OBJECT
+
+public:
+    /** Time to answer, in ms */
+    static const int Timeout = 15000;
+
+    RandRConfirmation(const RandRTransaction &transaction, QObject *parent = 0);
+    ~RandRConfirmation();
+
+    /** Show the dialog and start the deadline. */
+    void start();
+    /** Whether the user has not answered yet. */
+    bool isPending() const;
+
+public slots:
+    /** Keep the new configuration. */
+    void accept();
+    /** Restore the previous configuration. */
+    void reject();
+
+signals:
+    /** Emitted once, after the configuration was kept or restored. */
+    void finished(bool accepted);
+
+private:
+    void finish(bool accepted);
+
+    RandRTransaction m_transaction;
+    QTimerConfirmDialog *m_dialog;
+    QTimer m_deadline;
+    bool m_pending;
+};
+
+#endif // RANDRCONFIRMATION_H
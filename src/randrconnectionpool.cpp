@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QMutexLocker>
+
+#include "randrconnectionpool.h"
+#include "randrxlibbackend.h"
+
+RandRConnectionPool *RandRConnectionPool::s_instance = 0;
+QMutex RandRConnectionPool::s_instanceMutex;
+
+RandRConnectionPool::RandRConnectionPool()
+{
+}
+
+RandRConnectionPool *RandRConnectionPool::instance()
+{
+    // RandRDisplayGroup opens its displays from several threads at once
+    QMutexLocker locker(&s_instanceMutex);
+    if (!s_instance)
+        s_instance = new RandRConnectionPool;
+    return s_instance;
+}
+
+RandRBackend *RandRConnectionPool::backend(const QByteArray &displayName)
+{
+    QMutexLocker locker(&m_mutex);
+    RandRXlibBackend *backend = m_backends.value(displayName);
+    if (backend)
+        return backend;
+
+    Display *dpy = XOpenDisplay(displayName.constData());
+    if (!dpy)
+    {
+        qDebug() << "Can't open display" << displayName;
+        return 0;
+    }
+
+    backend = new RandRXlibBackend(dpy);
+    m_backends.insert(displayName, backend);
+    return backend;
+}
+
+Display *RandRConnectionPool::acquire(const QByteArray &displayName)
+{
+    QMutexLocker locker(&m_mutex);
+    Display *dpy = 0;
+    QList<Display*> &idle = m_idle[displayName];
+    if (!idle.isEmpty())
+        dpy = idle.takeLast();
+    else
+        dpy = XOpenDisplay(displayName.constData());
+
+    if (!dpy)
+    {
+        qDebug() << "Can't open display" << displayName;
+        return 0;
+    }
+
+    m_acquired.insert(dpy, displayName);
+    return dpy;
+}
+
+void RandRConnectionPool::release(Display *dpy)
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(m_acquired.contains(dpy));
+    if (!m_acquired.contains(dpy))
+        return;
+
+    m_idle[m_acquired.take(dpy)].append(dpy);
+}
+
+void RandRConnectionPool::closeAll()
+{
+    QMutexLocker locker(&m_mutex);
+    Q_ASSERT(m_acquired.isEmpty());
+
+    foreach(RandRXlibBackend *backend, m_backends)
+    {
+        Display *dpy = backend->display();
+        delete backend;
+        XCloseDisplay(dpy);
+    }
+    m_backends.clear();
+
+    foreach(const QList<Display*> &idle, m_idle)
+    {
+        foreach(Display *dpy, idle)
+            XCloseDisplay(dpy);
+    }
+    m_idle.clear();
+}
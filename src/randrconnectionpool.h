@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRCONNECTIONPOOL_H
+#define RANDRCONNECTIONPOOL_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QMutex>
+#include <X11/Xlib.h>
+
+class RandRBackend;
+class RandRXlibBackend;
+
+/** The connections to the X displays the process works with.
+ *
+ * Every display gets one shared connection, used through backend() by the
+ * RandRDisplay of that display. The workers take a private connection
+ * with acquire() and give it back with release(); it is kept open for the
+ * next worker, so building the model of a display again does not connect
+ * to it again. Display names are those of XOpenDisplay(), an empty name
+ * stands for $DISPLAY. Every method, instance() included, may be called
+ * from any thread. */
+class RandRConnectionPool
+{
+public:
+    static RandRConnectionPool *instance();
+
+    /** The backend on the shared connection to @p displayName, opened on
+     * first use. 0 if the display can't be opened. The pool keeps its
+     * ownership. */
+    RandRBackend *backend(const QByteArray &displayName);
+
+    /** A connection to @p displayName that only the caller uses until it
+     * calls release(). 0 if the display can't be opened. */
+    Display *acquire(const QByteArray &displayName);
+    void release(Display *dpy);
+
+    /** Close every connection. None of them may be in use. */
+    void closeAll();
+
+private:
+    RandRConnectionPool();
+
+    static RandRConnectionPool *s_instance;
+    static QMutex s_instanceMutex;
+
+    QMutex m_mutex;
+    QMap<QByteArray, RandRXlibBackend*> m_backends;
+    /** The released connections, by display name */
+    QMap<QByteArray, QList<Display*> > m_idle;
+    /** The display names of the acquired connections */
+    QMap<Display*, QByteArray> m_acquired;
+};
+
+#endif // RANDRCONNECTIONPOOL_H
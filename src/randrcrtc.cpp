@@ -22,6 +22,12 @@
 #include "randroutput.h"
 #include "randrmode.h"
 #include "randrgammainfo.h"
+#include "randrgammalut.h"
+#include "randrprobe.h"
+#include "randrtransaction.h"
+#include "randrbackend.h"
+#include "randrstats.h"
+#include "randrtrace.h"
 
 RandRCrtc::RandRCrtc(RandRScreen *parent, RRCrtc id)
     : QObject(parent),
@@ -39,7 +45,12 @@ RandRCrtc::RandRCrtc(RandRScreen *parent, RRCrtc id)
     m_currentRotation = m_originalRotation = m_proposedRotation = RandR::Rotate0;
     m_currentRate = m_originalRate = m_proposedRate = 0;
     m_currentMode = 0;
-    m_originalBrightness = 1.0;
+    m_currentBrightness = m_originalBrightness = 1.0;
+    m_currentRed = m_currentGreen = m_currentBlue = red = green = blue = 1.0;
+    m_gammaSize = 0;
+    m_modesGeneration = -1;
+    m_gammaValid = false;
+    m_gammaTimestamp = CurrentTime;
     m_rotations = RandR::Rotate0;
     m_currentTracking = m_originalTracking = m_proposedTracking = true;
     m_currentVirtualModeEnabled = m_originalVirtualModeEnabled = m_proposedVirtualModeEnabled = false;
@@ -102,14 +113,27 @@ void RandRCrtc::loadSettings(bool notify)
 
     qDebug() << "Querying information about CRTC" << m_id;
 
-    int changes = 0;
-    XRRCrtcInfo *info = XRRGetCrtcInfo(QX11Info::display(), m_screen->resources(), m_id);
+    RandRProbe probe(m_screen->resources(), m_screen->backend());
+    addToProbe(probe);
+    probe.run();
+
+    const RandRCrtcInfo *info = probe.crtc(m_id);
     Q_ASSERT(info);
+    if (info)
+        loadSettings(*info, notify);
+}
+
+void RandRCrtc::loadSettings(const RandRCrtcInfo &info, bool notify)
+{
+    if(m_id == None)
+        return;
+
+    int changes = 0;
 
-    if (RandR::timestamp != info->timestamp)
-        RandR::timestamp = info->timestamp;
+    if (m_screen->timestamp() != info.timestamp)
+        m_screen->setTimestamp(info.timestamp);
 
-    QRect rect = QRect(info->x, info->y, info->width, info->height);
+    QRect rect = info.rect;
     if (rect != m_currentRect)
     {
         m_currentRect = rect;
@@ -117,25 +141,43 @@ void RandRCrtc::loadSettings(bool notify)
     }
     
     // Get panning
-    XRRPanning  *panning_info = XRRGetPanning(QX11Info::display(), m_screen->resources(), m_id);
-    rect = QRect(panning_info->left, panning_info->top, panning_info->width, panning_info->height);
-    if(rect != m_currentVirtualRect)
-    {
-        m_currentVirtualRect = rect;
-        changes |= RandR::ChangeVirtualRect;
-    }
-    if( rect.width() != info->width || rect.height() != info->height )
+    if (info.hasPanning)
     {
-        m_currentTracking = true;
-        changes |= RandR::ChangeVirtualRect;
+        rect = info.panning;
+        if(rect != m_currentVirtualRect)
+        {
+            m_currentVirtualRect = rect;
+            changes |= RandR::ChangeVirtualRect;
+        }
+        if( rect.size() != info.rect.size() )
+        {
+            m_currentTracking = true;
+            changes |= RandR::ChangeVirtualRect;
+        }
+        else
+           m_currentTracking = false;
     }
-    else
-       m_currentTracking = false;
-    XRRFreePanning(panning_info);
     
     // Get red, blue, green and brightness
-    float _brightness;
-    get_gamma_info(QX11Info::display(), m_screen->resources(), m_id, &_brightness, &red, &blue, &green);
+    float _brightness = m_currentBrightness;
+    if (!info.red.isEmpty())
+    {
+        gamma_info_from_ramps(info.red.size(), info.red.constData(), info.green.constData(),
+                              info.blue.constData(), &_brightness, &red, &blue, &green);
+        m_gammaSize = info.red.size();
+        m_gammaRamp = info.red + info.green + info.blue;
+        m_gammaValid = true;
+    }
+    else if (info.mode == None)
+    {
+        // the driver may reset the ramps when the crtc is enabled again
+        m_gammaValid = false;
+    }
+
+    // the probe only skips the ramps of an active crtc if they were
+    // current at this timestamp, or if they were just set by us
+    if (m_gammaValid)
+        m_gammaTimestamp = info.timestamp;
     
     if(_brightness != m_currentBrightness)
     {
@@ -145,42 +187,33 @@ void RandRCrtc::loadSettings(bool notify)
 
     // get all connected outputs
     // and create a list of modes that are available in all connected outputs
-    OutputList outputs;
-
-    for (int i = 0; i < info->noutput; ++i) {
-        outputs.append(info->outputs[i]);
-    }
-
     // check if the list changed from the original one
-    if (outputs != m_connectedOutputs)
+    if (info.outputs != m_connectedOutputs)
     {
         changes |= RandR::ChangeOutputs;
-        m_connectedOutputs = outputs;
+        m_connectedOutputs = info.outputs;
     }
+    m_currentOutputs = info.outputs;
 
     // get all outputs this crtc can be connected to
-    outputs.clear();
-    for (int i = 0; i < info->npossible; ++i)
-        outputs.append(info->possible[i]);
-
-    if (outputs != m_possibleOutputs)
+    if (info.possible != m_possibleOutputs)
     {
         changes |= RandR::ChangeOutputs;
-        m_possibleOutputs = outputs;
+        m_possibleOutputs = info.possible;
     }
 
     // get all rotations
-    m_rotations = info->rotations;
-    if (m_currentRotation != info->rotation)
+    m_rotations = info.rotations;
+    if (m_currentRotation != info.rotation)
     {
-        m_currentRotation = info->rotation;
+        m_currentRotation = info.rotation;
         changes |= RandR::ChangeRotation;
     }
 
     // check if the current mode has changed
-    if (m_currentMode != info->mode)
+    if (m_currentMode != info.mode)
     {
-        m_currentMode = info->mode;
+        m_currentMode = info.mode;
         changes |= RandR::ChangeMode;
     }
 
@@ -226,13 +259,25 @@ void RandRCrtc::loadSettings(bool notify)
     m_proposedTracking = m_currentTracking;
     m_proposedVirtualModeEnabled = m_currentVirtualModeEnabled;
 
-    // free the info
-    XRRFreeCrtcInfo(info);
-
     if (changes && notify)
         emit crtcChanged(m_id, changes);
 }
 
+void RandRCrtc::addToProbe(RandRProbe &probe) const
+{
+    probe.addCrtc(m_id, true, gammaTimestamp());
+}
+
+Time RandRCrtc::gammaTimestamp() const
+{
+    return m_gammaValid ? m_gammaTimestamp : CurrentTime;
+}
+
+void RandRCrtc::invalidateGamma()
+{
+    m_gammaValid = false;
+}
+
 void RandRCrtc::handleEvent(XRRCrtcChangeNotifyEvent *event)
 {
     qDebug() << "[CRTC] Event...";
@@ -267,8 +312,14 @@ void RandRCrtc::handleEvent(XRRCrtcChangeNotifyEvent *event)
         //Do NOT use event->width and event->height here, as it is being returned wrongly
     }
 
+    // our own changes are already in m_current* when their events arrive,
+    // so this was done by another client, which may have touched the
+    // gamma ramps too
     if (changed)
+    {
+        invalidateGamma();
         emit crtcChanged(m_id, changed);
+    }
 }
 
 RandRMode RandRCrtc::mode() const
@@ -286,226 +337,182 @@ float RandRCrtc::refreshRate() const
     return m_currentRate;
 }
 
-bool RandRCrtc::applyProposed()
+RandRMode RandRCrtc::proposedMode() const
 {
-    qDebug() << "Applying proposed changes for CRTC" << m_id << "...";
-    qDebug() << "       Current Screen rect:" << m_screen->rect();
-    qDebug() << "       Current CRTC rect:" << m_currentRect;
-    qDebug() << "       Current rotation:" << m_currentRotation;
-    qDebug() << "       Proposed CRTC rect:" << m_proposedRect;
-    qDebug() << "       Proposed rotation:" << m_proposedRotation;
-    qDebug() << "       Proposed refresh rate:" << m_proposedRate;
-    qDebug() << "       Proposed brightness:" << m_proposedBrightness;
-    qDebug() << "       Enabled outputs:";
-    if (m_connectedOutputs.isEmpty())
-        qDebug() << "          - none";
-    for (int i = 0; i < m_connectedOutputs.count(); ++i)
-        qDebug() << "          -" << m_screen->output(m_connectedOutputs.at(i))->name();
-
-    RandRMode mode;
-    if (m_proposedRect.size() == m_currentRect.size() && m_proposedRate == m_currentRate)
+    // if no output was connected, set the mode to None
+    if (!m_connectedOutputs.count())
+        return RandRMode();
+
+    RandRMode mode = m_screen->mode(m_currentMode);
+    if (mode.isValid() && m_proposedRect.size() == m_currentRect.size() && m_proposedRate == m_currentRate)
+        return mode;
+
+    // find a mode that has the desired size and is supported by all
+    // connected outputs. The first output's catalog gives the candidates,
+    // the others only have to list the same mode
+    QList<const RandRModeCatalog *> catalogs;
+    foreach(RROutput o, m_connectedOutputs)
     {
-        mode = m_screen->mode(m_currentMode);
+        RandROutput *output = m_screen->output(o);
+        if (output)
+            catalogs.append(&output->modeCatalog());
     }
-    else
+    if (catalogs.isEmpty())
+        return RandRMode();
+    const RandRModeCatalog *catalog = catalogs.takeFirst();
+
+    // the usual case, the exact mode is known to every output
+    RRMode exact = catalog->mode(m_proposedRect.size(), m_proposedRate);
+    if (exact != None && sharedMode(exact, catalogs))
+        return m_screen->mode(exact);
+
+    // if no matching modes were found, disable output
+    // else set the mode to the first mode in the list. If no refresh rate was given
+    // or no mode was found matching the given refresh rate, the first mode of the
+    // list will be used
+    mode = RandRMode();
+    foreach(RRMode m, catalog->modes(m_proposedRect.size()))
     {
-        // find a mode that has the desired size and is supported
-        // by all connected outputs
-        ModeList modeList = modes();
-        ModeList matchModes;
-
-        foreach(RRMode m, modeList)
-        {
-            RandRMode mode = m_screen->mode(m);
-            if (mode.size() == m_proposedRect.size())
-                matchModes.append(m);
-        }
+        if (!sharedMode(m, catalogs))
+            continue;
+
+        RandRMode testMode = m_screen->mode(m);
+        if (testMode.refreshRate() == m_proposedRate)
+            return testMode;
+        if (!mode.isValid())
+            mode = testMode;
+    }
 
-        // if no matching modes were found, disable output
-        // else set the mode to the first mode in the list. If no refresh rate was given
-        // or no mode was found matching the given refresh rate, the first mode of the
-        // list will be used
-        if (!matchModes.count())
-            mode = RandRMode();
-        else
-            mode = m_screen->mode(matchModes.first());
+    return mode;
+}
 
-        foreach(RRMode m, matchModes)
-        {
-            RandRMode testMode = m_screen->mode(m);
-            if (testMode.refreshRate() == m_proposedRate)
-            {
-                mode = testMode;
-                break;
-            }
-        }
-    }
+bool RandRCrtc::sharedMode(RRMode mode, const QList<const RandRModeCatalog *> &catalogs)
+{
+    foreach(const RandRModeCatalog *catalog, catalogs)
+        if (!catalog->contains(mode))
+            return false;
+    return true;
+}
 
-    // if no output was connected, set the mode to None
-    if (!m_connectedOutputs.count())
-        mode = RandRMode();
-    else if (!mode.isValid())
-        return false;
+QRect RandRCrtc::proposedRect() const
+{
+    return m_proposedRect;
+}
 
-    if (mode.isValid())
-    {
-        if (m_currentRotation == m_proposedRotation ||
-            (m_currentRotation == RandR::Rotate0 && m_proposedRotation == RandR::Rotate180) ||
-            (m_currentRotation == RandR::Rotate180 && m_proposedRotation == RandR::Rotate0) ||
-            (m_currentRotation == RandR::Rotate90 && m_proposedRotation == RandR::Rotate270) ||
-            (m_currentRotation == RandR::Rotate270 && m_proposedRotation == RandR::Rotate90))
-        {
-            QRect r = QRect(0,0,0,0).united(m_proposedRect);
-            if (r.width() > m_screen->maxSize().width() || r.height() > m_screen->maxSize().height())
-                return false;
-
-            // if the desired mode is bigger than the current screen size, first change the
-            // screen size, and then the crtc size
-            if (!m_screen->rect().contains(r))
-            {
-                // try to adjust the screen size
-                if (!m_screen->adjustSize(r))
-                    return false;
-            }
+int RandRCrtc::proposedRotation() const
+{
+    return m_proposedRotation;
+}
 
-        }
-        else
-        {
+QRect RandRCrtc::proposedVirtualRect() const
+{
+    return m_proposedVirtualRect;
+}
 
-            QRect r(m_proposedRect.topLeft(), QSize(m_proposedRect.height(), m_proposedRect.width()));
-            if (!m_screen->rect().contains(r))
-            {
-                // check if the rotated rect is smaller than the max screen size
-                r = m_screen->rect().united(r);
-                if (r.width() > m_screen->maxSize().width() || r.height() > m_screen->maxSize().height())
-                    return false;
-
-                // adjust the screen size
-                r = r.united(m_currentRect);
-                if (!m_screen->adjustSize(r))
-                    return false;
-            }
-        }
-    }
+bool RandRCrtc::proposedVirtualModeEnabled() const
+{
+    return m_proposedVirtualModeEnabled;
+}
 
+bool RandRCrtc::applyProposed()
+{
+    qDebug() << "Applying proposed changes for CRTC" << m_id << "...";
 
+    RandRTransaction transaction(m_screen);
+    transaction.addCrtc(this);
+    return transaction.commit();
+}
 
-    if(m_proposedVirtualModeEnabled)
+XTransform RandRCrtc::proposedTransform() const
+{
+    XTransform transform;
+    memset(&transform, '\0', sizeof(transform));
+    float width;
+    float height;
+    if(m_proposedTracking || !m_proposedVirtualModeEnabled)
+        width = height = 1.0;
+    else
     {
-        /////////////////////////////////////
-        // Changing Size "--fb"
-        m_screen->setSize( m_proposedVirtualRect.size() );
-        /////////////////////////////////////
-
-        if(m_proposedTracking)
-        {/*
-            s = XRRSetCrtcConfig(QX11Info::display(), m_screen->resources(), m_id,
-                        RandR::timestamp, m_proposedVirtualRect.width(), m_proposedVirtualRect.height(),  mode.id(),
-                        m_proposedRotation, outputs, m_connectedOutputs.count());*/
-        }
+        width = (float)m_proposedVirtualRect.size().width() / (float)m_proposedRect.size().width();
+        height = (float)m_proposedVirtualRect.size().height() / (float)m_proposedRect.size().height();
     }
+    transform.matrix[0][0] = XDoubleToFixed (width);
+    transform.matrix[1][1] = XDoubleToFixed (height);
+    transform.matrix[2][2] = XDoubleToFixed (1.0);
+    return transform;
+}
 
-    { // Set scale
-        int major, minor; // Chack XRandr version. Xrandr 1.3 needed.
-        XRRQueryVersion (QX11Info::display(), &major, &minor);
-        if (major > 1 || (major == 1 && minor >= 3))
-        {
-            int nparams = 0;
-            XFixed *params = NULL;
-            memset (&m_transform, '\0', sizeof (m_transform));
-            float width;
-            float height;
-            if(m_proposedTracking || !m_proposedVirtualModeEnabled)
-                width = height = 1.0;
-            else
-            {
-                width = (float)m_proposedVirtualRect.size().width() / (float)m_proposedRect.size().width();
-                height = (float)m_proposedVirtualRect.size().height() / (float)m_proposedRect.size().height();
-            }
-            m_transform.matrix[0][0] = XDoubleToFixed (width);
-            m_transform.matrix[1][1] = XDoubleToFixed (height);
-            m_transform.matrix[2][2] = XDoubleToFixed (1.0);
-            XRRSetCrtcTransform (QX11Info::display(), m_id, &m_transform, m_filter, params, nparams);
-            qDebug() << "[RandRCrtc::applyProposed] scale width" << width << "height=" << height;
-        }
-    }
-
-
-    RROutput *outputs = new RROutput[m_connectedOutputs.count()];
-    for (int i = 0; i < m_connectedOutputs.count(); ++i)
-        outputs[i] = m_connectedOutputs.at(i);
-
-    Status s;
-    s = XRRSetCrtcConfig(QX11Info::display(), m_screen->resources(), m_id,
-                RandR::timestamp, m_proposedRect.x(), m_proposedRect.y(), mode.id(),
-                m_proposedRotation, outputs, m_connectedOutputs.count());
+void RandRCrtc::applyProposedTransform()
+{
+    // Set scale. Xrandr 1.3 needed.
+    if (!m_screen->backend()->has_1_3())
+        return;
 
-    delete[] outputs;
+    m_transform = proposedTransform();
+    m_screen->backend()->setCrtcTransform(m_id, &m_transform, m_filter);
+    qDebug() << "[RandRCrtc::applyProposedTransform] scale width" << XFixedToDouble(m_transform.matrix[0][0])
+             << "height=" << XFixedToDouble(m_transform.matrix[1][1]);
+}
 
-    // Set panning
-    if(m_proposedVirtualModeEnabled)
+void RandRCrtc::applyProposedGamma()
+{
+    RandRStats::Scope scope(RandRStats::Gamma);
+    RandRTrace::Span span("gamma", m_id);
+    // Set gamma. The crtc configuration must already have been confirmed
+    // by the server (see RandRTransaction), so it is applied only once.
+    qDebug() << "[RandRCrtc::applyProposedGamma] m_proposedBrightness" << m_proposedBrightness;
+    if (!m_gammaSize)
+        m_gammaSize = m_screen->backend()->crtcGammaSize(m_id);
+
+    QVector<unsigned short> ramp = RandRGammaLut::ramp(m_gammaSize, m_proposedBrightness, red, green, blue);
+    if (ramp.isEmpty())
     {
-        /////////////////////////////////////
-        XRRPanning *panning = XRRGetPanning  (QX11Info::display(),m_screen->resources(), m_id);
-        panning->left = panning->top = 0;
-        panning->width = m_proposedVirtualRect.width();
-        panning->height = m_proposedVirtualRect.height();
-        panning->track_width = 0;
-        panning->track_height = 0;
-        panning->track_left = panning->track_top = 0;
-        panning->timestamp = RandR::timestamp;
-        {
-        	Status s = XRRSetPanning (QX11Info::display(), m_screen->resources(), m_id, panning);
-        	if (s == RRSetConfigSuccess)
-        		qDebug() << "[RandRCrtc::applyProposed] Panning changed";
-        	else
-        		qDebug() << "[RandRCrtc::applyProposed] Panning doesn't changed";
-        }
-        XRRFreePanning(panning);
-        /////////////////////////////////////
+        qDebug() << "[RandRCrtc::applyProposedGamma] Unsupported gamma size" << m_gammaSize;
+        return;
     }
-    
-    // Set gamma
-    //Gamma is applied twice
-    qDebug() << "[RandRCrtc::applyProposed] m_proposedBrightness" << m_proposedBrightness;
-    // Wait for set gamma. Wait for Xrandr setting brightness when virtual size is changed
-    sleep(3);
-    //XFlush(QX11Info::display());
-    //XSync(QX11Info::display(), False);
-    //Gamma is applied twice
-    set_gamma(QX11Info::display(), m_screen->resources(), m_id, m_proposedBrightness, red, blue, green);
-    set_gamma(QX11Info::display(), m_screen->resources(), m_id, m_proposedBrightness, red, blue, green);
-    m_currentBrightness = m_proposedBrightness;
-    
-    
 
-    bool ret;
-    if (s == RRSetConfigSuccess)
+    // most changes don't touch the colors at all, don't upload the same
+    // ramps again
+    if (!m_gammaValid || ramp != m_gammaRamp)
     {
-        qDebug() << "Changes for CRTC" << m_id << "successfully applied.";
-        m_currentMode = mode.id();
-        m_currentRotation = m_proposedRotation;
-        m_currentRect = m_proposedRect;
-        m_currentRate = mode.refreshRate();
-        m_currentVirtualRect = m_proposedVirtualRect;
-        m_currentTracking = m_proposedTracking;
-        m_currentVirtualModeEnabled = m_proposedVirtualModeEnabled;
-        
-        emit crtcChanged(m_id, RandR::ChangeMode);
-        ret = true;
+        m_screen->backend()->setCrtcGamma(m_id, m_gammaSize, ramp.constData());
+        m_gammaRamp = ramp;
     }
     else
+        qDebug() << "[RandRCrtc::applyProposedGamma] Gamma ramps unchanged";
+    m_gammaValid = true;
+    m_currentBrightness = m_proposedBrightness;
+}
+
+void RandRCrtc::commitProposed(RRMode mode)
+{
+    qDebug() << "Changes for CRTC" << m_id << "successfully applied.";
+    m_currentMode = mode;
+    m_currentRotation = m_proposedRotation;
+    m_currentRect = (mode != None) ? m_proposedRect : QRect(0, 0, 0, 0);
+    m_currentRate = m_screen->mode(mode).refreshRate();
+    m_currentVirtualRect = m_proposedVirtualRect;
+    m_currentTracking = m_proposedTracking;
+    m_currentVirtualModeEnabled = m_proposedVirtualModeEnabled;
+    m_currentOutputs = m_connectedOutputs;
+
+    if (mode != None)
     {
-        qDebug() << "Failed to apply changes for CRTC" << m_id;
-        ret = false;
-        // Invalidate the XRRScreenResources cache
-        if(s == RRSetConfigInvalidConfigTime)
-            m_screen->loadSettings(true);
+        // Set panning
+        if(m_proposedVirtualModeEnabled && m_screen->backend()->has_1_3())
+        {
+            Status s = m_screen->backend()->setPanning(m_screen->resources(), m_id,
+                                                            QRect(QPoint(0, 0), m_proposedVirtualRect.size()));
+            if (s == RRSetConfigSuccess)
+                qDebug() << "[RandRCrtc::commitProposed] Panning changed";
+            else
+                qDebug() << "[RandRCrtc::commitProposed] Panning doesn't changed";
+        }
+
+        applyProposedGamma();
     }
 
-    if(!m_proposedVirtualModeEnabled)
-        m_screen->adjustSize();
-    return ret;
+    emit crtcChanged(m_id, RandR::ChangeMode);
 }
 
 bool RandRCrtc::proposeSize(const QSize &s)
@@ -586,7 +593,8 @@ void RandRCrtc::setOriginal()
 
 bool RandRCrtc::proposedChanged()
 {
-    return (m_proposedRotation != m_currentRotation ||
+    return (m_connectedOutputs != m_currentOutputs ||
+        m_proposedRotation != m_currentRotation ||
         m_proposedRect != m_currentRect ||
         m_proposedRate != m_currentRate ||
         m_proposedBrightness != m_currentBrightness ||
@@ -631,29 +639,19 @@ OutputList RandRCrtc::connectedOutputs() const
     return m_connectedOutputs;
 }
 
-ModeList RandRCrtc::modes() const
+OutputList RandRCrtc::currentOutputs() const
 {
-    ModeList modeList;
-
-    bool first = true;
+    return m_currentOutputs;
+}
 
-    foreach(RROutput o, m_connectedOutputs)
+const ModeList &RandRCrtc::modes() const
+{
+    const RandRModeMatrix &matrix = m_screen->modeMatrix();
+    if (m_modesGeneration != matrix.generation() || m_modesOutputs != m_connectedOutputs)
     {
-        RandROutput *output = m_screen->output(o);
-        if (first)
-        {
-            modeList = output->modes();
-            first = false;
-        }
-        else
-        {
-            foreach(RRMode m, modeList)
-            {
-                if (output->modes().indexOf(m) == -1)
-                    modeList.removeAll(m);
-            }
-        }
+        m_modes = matrix.sharedModes(m_connectedOutputs);
+        m_modesOutputs = m_connectedOutputs;
+        m_modesGeneration = matrix.generation();
     }
-
-    return modeList;
+    return m_modes;
 }
@@ -23,9 +23,14 @@
 #include <QtGui/QX11Info>
 #include <QtCore/QObject>
 #include <QtCore/QRect>
+#include <QtCore/QVector>
 
 #include "randr.h"
 
+struct RandRCrtcInfo;
+class RandRProbe;
+class RandRModeCatalog;
+
 /** Class representing a CRT controller. */
 class RandRCrtc : public QObject
 {
@@ -40,6 +45,17 @@ public:
     int rotation() const;
 
     void loadSettings(bool notify = false);
+    /** Update the CRTC from an already probed state. */
+    void loadSettings(const RandRCrtcInfo &info, bool notify = false);
+    /** Queue the CRTC in @p probe, asking for the gamma ramps only if the
+     * cached ones may be out of date. */
+    void addToProbe(RandRProbe &probe) const;
+    /** The time at which the cached gamma ramps were current, CurrentTime
+     * if they have to be read again. */
+    Time gammaTimestamp() const;
+    /** Forget the cached gamma ramps, they are read again by the next
+     * probe of the CRTC while it is active. */
+    void invalidateGamma();
     void handleEvent(XRRCrtcChangeNotifyEvent *event);
 
     bool isValid(void) const;
@@ -62,11 +78,33 @@ public:
     void setOriginal();
     bool proposedChanged();
 
+    /** The mode matching the proposed size and refresh rate, supported by
+     * all connected outputs. Invalid if there is none or no output is
+     * connected. */
+    RandRMode proposedMode() const;
+    QRect proposedRect() const;
+    int proposedRotation() const;
+    QRect proposedVirtualRect() const;
+    bool proposedVirtualModeEnabled() const;
+
+    /** The scaling transform of the proposed virtual size. */
+    XTransform proposedTransform() const;
+    /** Set the proposed scaling transform. It takes effect with the next
+     * crtc configuration change. */
+    void applyProposedTransform();
+    void applyProposedGamma();
+    /** Called once the server accepted the proposed configuration. */
+    void commitProposed(RRMode mode);
+
     bool addOutput(RROutput output, const QSize &size = QSize());
     bool removeOutput(RROutput output);
+    /** Outputs this crtc is proposed to drive. */
     OutputList connectedOutputs() const;
+    /** Outputs this crtc is currently driving. */
+    OutputList currentOutputs() const;
 
-    ModeList modes() const;
+    /** The modes supported by all connected outputs. */
+    const ModeList &modes() const;
     
     //Gamma vaules
     float red, blue, green;
@@ -81,6 +119,9 @@ signals:
     void crtcChanged(RRCrtc c, int changes);
 
 private:
+    /** Whether every catalog in @p catalogs lists @p mode. */
+    static bool sharedMode(RRMode mode, const QList<const RandRModeCatalog *> &catalogs);
+
     RRCrtc m_id;
     RRMode m_currentMode;
 
@@ -115,7 +156,22 @@ private:
     bool m_proposedTracking;
     bool m_proposedVirtualModeEnabled;
 
+    /** The ramps last read from or sent to the server, red, green and blue
+     * one after the other */
+    QVector<unsigned short> m_gammaRamp;
+    int m_gammaSize;
+    /** Whether m_gammaRamp is known to match the server, and the crtc
+     * timestamp it was last confirmed at */
+    bool m_gammaValid;
+    Time m_gammaTimestamp;
+
     OutputList m_connectedOutputs;
+    /** modes() for m_modesOutputs, as of generation m_modesGeneration of
+     * the screen's mode matrix */
+    mutable ModeList m_modes;
+    mutable OutputList m_modesOutputs;
+    mutable int m_modesGeneration;
+    OutputList m_currentOutputs;
     OutputList m_possibleOutputs;
     int m_rotations;
     
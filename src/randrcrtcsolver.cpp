@@ -0,0 +1,175 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include "randrcrtcsolver.h"
+
+RandRCrtcSolver::RandRCrtcSolver()
+{
+}
+
+void RandRCrtcSolver::addCrtc(RRCrtc crtc, bool lit)
+{
+    m_crtcs.append(crtc);
+    m_lit.append(lit);
+}
+
+void RandRCrtcSolver::addOutput(RROutput output, const QList<RRCrtc> &possible,
+                                const QList<RROutput> &clones, RRCrtc current, int group)
+{
+    Output o;
+    o.id = output;
+    o.possible = possible;
+    o.clones = clones;
+    o.current = current;
+    o.group = group;
+    m_outputs.append(o);
+}
+
+int RandRCrtcSolver::crtcIndex(RRCrtc crtc) const
+{
+    return m_crtcs.indexOf(crtc);
+}
+
+bool RandRCrtcSolver::solve()
+{
+    m_crtcOutput.fill(-1, m_crtcs.count());
+    m_outputCrtc.fill(-1, m_outputs.count());
+
+    // the current crtc first, then the idle ones, then the lit ones
+    for (int i = 0; i < m_outputs.count(); ++i)
+    {
+        Output &o = m_outputs[i];
+        o.candidates.clear();
+        int current = crtcIndex(o.current);
+        if (current != -1 && o.possible.contains(o.current))
+            o.candidates.append(current);
+        for (int pass = 0; pass < 2; ++pass)
+        {
+            foreach(RRCrtc crtc, o.possible)
+            {
+                int c = crtcIndex(crtc);
+                if (c != -1 && c != current && m_lit.at(c) == (pass == 1) && !o.candidates.contains(c))
+                    o.candidates.append(c);
+            }
+        }
+    }
+
+    // outputs that keep their crtc don't need a modeset
+    for (int i = 0; i < m_outputs.count(); ++i)
+    {
+        const Output &o = m_outputs.at(i);
+        if (o.candidates.isEmpty())
+            continue;
+        int c = o.candidates.first();
+        if (m_crtcs.at(c) == o.current && m_crtcOutput.at(c) == -1)
+        {
+            m_crtcOutput[c] = i;
+            m_outputCrtc[i] = c;
+        }
+    }
+
+    for (int i = 0; i < m_outputs.count(); ++i)
+    {
+        if (m_outputCrtc.at(i) != -1)
+            continue;
+        QVector<bool> visited(m_crtcs.count(), false);
+        augment(i, visited);
+    }
+
+    // outputs without a crtc of their own may drive the one of a clone
+    bool succeed = true;
+    for (int i = 0; i < m_outputs.count(); ++i)
+    {
+        if (m_outputCrtc.at(i) != -1)
+            continue;
+        for (int j = 0; j < m_outputs.count(); ++j)
+        {
+            int c = m_crtcOutput.indexOf(j);
+            if (c != -1 && canShare(i, j) && m_outputs.at(i).candidates.contains(c))
+            {
+                m_outputCrtc[i] = c;
+                break;
+            }
+        }
+        if (m_outputCrtc.at(i) == -1)
+            succeed = false;
+    }
+    return succeed;
+}
+
+bool RandRCrtcSolver::augment(int output, QVector<bool> &visited)
+{
+    const QList<int> &candidates = m_outputs.at(output).candidates;
+
+    // a free crtc does not move anybody
+    foreach(int c, candidates)
+    {
+        if (!visited.at(c) && m_crtcOutput.at(c) == -1)
+        {
+            visited[c] = true;
+            m_crtcOutput[c] = output;
+            m_outputCrtc[output] = c;
+            return true;
+        }
+    }
+
+    foreach(int c, candidates)
+    {
+        if (visited.at(c))
+            continue;
+        visited[c] = true;
+        if (augment(m_crtcOutput.at(c), visited))
+        {
+            m_crtcOutput[c] = output;
+            m_outputCrtc[output] = c;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool RandRCrtcSolver::canShare(int output, int other) const
+{
+    const Output &a = m_outputs.at(output);
+    const Output &b = m_outputs.at(other);
+    return output != other && a.group >= 0 && a.group == b.group &&
+           a.clones.contains(b.id) && b.clones.contains(a.id);
+}
+
+RRCrtc RandRCrtcSolver::crtc(RROutput output) const
+{
+    for (int i = 0; i < m_outputs.count() && i < m_outputCrtc.count(); ++i)
+    {
+        if (m_outputs.at(i).id == output)
+            return m_outputCrtc.at(i) != -1 ? m_crtcs.at(m_outputCrtc.at(i)) : (RRCrtc) None;
+    }
+    return None;
+}
+
+QList<RROutput> RandRCrtcSolver::unassigned() const
+{
+    QList<RROutput> outputs;
+    for (int i = 0; i < m_outputs.count() && i < m_outputCrtc.count(); ++i)
+    {
+        if (m_outputCrtc.at(i) == -1)
+            outputs.append(m_outputs.at(i).id);
+    }
+    return outputs;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRCRTCSOLVER_H
+#define RANDRCRTCSOLVER_H
+
+#include <QtCore/QList>
+#include <QtCore/QVector>
+#include <X11/extensions/Xrandr.h>
+
+/** Assigns CRTCs to outputs before anything is sent to the server.
+ *
+ * Each output can only be driven by the CRTCs the server lists as possible
+ * for it, so taking the first free one may leave another output without a
+ * CRTC although an assignment exists. The solver finds a maximum bipartite
+ * matching with augmenting paths (Kuhn's algorithm). Outputs are kept on
+ * the CRTC they already use, since that needs no modeset, and idle CRTCs
+ * are preferred over lit ones so that the other outputs are not disturbed.
+ *
+ * Outputs that are still left over share the CRTC of a clone that wants
+ * the same configuration, see addOutput(). It only needs QtCore. */
+class RandRCrtcSolver
+{
+public:
+    RandRCrtcSolver();
+
+    /** @p lit if the CRTC currently drives an output. */
+    void addCrtc(RRCrtc crtc, bool lit);
+
+    /** An output that needs a CRTC.
+     * @p current is the CRTC driving it now, None if it is off.
+     * Outputs in the same @p group want the same mode, position and
+     * rotation, so they can share a CRTC if they are clones of each
+     * other. -1 for an output that cannot share. */
+    void addOutput(RROutput output, const QList<RRCrtc> &possible,
+                   const QList<RROutput> &clones = QList<RROutput>(),
+                   RRCrtc current = None, int group = -1);
+
+    /** Find the assignment. Returns false if some outputs got no CRTC,
+     * the others are assigned anyway. */
+    bool solve();
+
+    /** The CRTC assigned to @p output, None if there is none. */
+    RRCrtc crtc(RROutput output) const;
+
+    /** The outputs solve() found no CRTC for. */
+    QList<RROutput> unassigned() const;
+
+private:
+    struct Output
+    {
+        RROutput id;
+        QList<RRCrtc> possible;
+        QList<RROutput> clones;
+        RRCrtc current;
+        int group;
+        /** Indexes of the possible crtcs, in order of preference */
+        QList<int> candidates;
+    };
+
+    int crtcIndex(RRCrtc crtc) const;
+    bool augment(int output, QVector<bool> &visited);
+    bool canShare(int output, int other) const;
+
+    QList<RRCrtc> m_crtcs;
+    QList<bool> m_lit;
+    QList<Output> m_outputs;
+
+    /** The output matched to each crtc, -1 if none */
+    QVector<int> m_crtcOutput;
+    /** The crtc assigned to each output, -1 if none */
+    QVector<int> m_outputCrtc;
+};
+
+#endif // RANDRCRTCSOLVER_H
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <QtCore/QDebug>
+
+#include "randrdaemon.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randrlayoutstore.h"
+
+RandRDaemon::RandRDaemon(QObject *parent)
+    : QObject(parent),
+      m_display(new RandRDisplay()),
+      m_ownsDisplay(true)
+{
+    watchScreens();
+}
+
+RandRDaemon::RandRDaemon(RandRDisplay *display, QObject *parent)
+    : QObject(parent),
+      m_display(display),
+      m_ownsDisplay(false)
+{
+    watchScreens();
+}
+
+RandRDaemon::~RandRDaemon()
+{
+    if (m_ownsDisplay)
+        delete m_display;
+}
+
+void RandRDaemon::watchScreens()
+{
+    if (!isValid())
+    {
+        qDebug() << "RandR 1.2 is not available, hotplug is not supported.";
+        return;
+    }
+
+    for (int i = 0; i < m_display->numScreens(); ++i)
+    {
+        RandRScreen *screen = m_display->screen(i);
+        // the layouts may have been applied already, only a change of the
+        // connected outputs is a hotplug
+        m_layouts[screen] = screen->layoutName();
+        connect(screen, SIGNAL(changed(RandRChangeSet)),
+                SLOT(slotScreenChanged(RandRChangeSet)));
+    }
+}
+
+bool RandRDaemon::isValid() const
+{
+#ifdef HAS_RANDR_1_2
+    return m_display->isValid() && m_display->has_1_2();
+#else
+    return false;
+#endif
+}
+
+void RandRDaemon::applyLayouts()
+{
+    if (!isValid())
+        return;
+
+    for (int i = 0; i < m_display->numScreens(); ++i)
+    {
+        RandRScreen *screen = m_display->screen(i);
+        m_layouts[screen] = screen->layoutName();
+        applyLayout(screen);
+    }
+}
+
+void RandRDaemon::slotScreenChanged(const RandRChangeSet &changes)
+{
+    RandRScreen *screen = qobject_cast<RandRScreen*>(sender());
+    if (!screen)
+        return;
+
+    // our own changes and anything not caused by a hotplug come back
+    // with the same set of connected outputs
+    QString layout = screen->layoutName();
+    if (layout == m_layouts.value(screen))
+        return;
+
+    qDebug() << "Outputs connected to screen" << screen->index() << "changed:"
+             << m_layouts.value(screen) << "->" << layout;
+    m_layouts[screen] = layout;
+
+    bool applied = applyLayout(screen);
+    if (!changes.since.isValid())
+        return;
+
+    qDebug() << "Hotplug on screen" << screen->index() << (applied ? "applied" : "settled")
+             << "in" << changes.since.elapsed() << "ms";
+}
+
+bool RandRDaemon::applyLayout(RandRScreen *screen)
+{
+    RandRLayoutStore store;
+    store.open();
+    if (!screen->loadLayout(store))
+    {
+        qDebug() << "No layout saved for" << screen->layoutName() << ", leaving the screen as it is.";
+        return false;
+    }
+
+    qDebug() << "Applying layout" << screen->layoutName() << "to screen" << screen->index();
+    return screen->applyProposed(false);
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef RANDRDAEMON_H
+#define RANDRDAEMON_H
+
+#include <QtCore/QObject>
+#include <QtCore/QMap>
+#include <QtCore/QString>
+
+#include "randr.h"
+
+class RandRDisplay;
+struct RandRChangeSet;
+
+/** Applies the saved layouts while monitors get plugged and unplugged.
+ *
+ * Every time the set of connected outputs of a screen changes, the layout
+ * saved for that set is loaded and applied without confirmation. The time
+ * from the first event of the hotplug until the layout is in place is
+ * logged for every change. */
+class RandRDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RandRDaemon(QObject *parent = 0);
+    /** Follow the hotplugs of @p display, which the caller keeps. */
+    explicit RandRDaemon(RandRDisplay *display, QObject *parent = 0);
+    ~RandRDaemon();
+
+    bool isValid() const;
+
+    /** Apply the layouts saved for the outputs connected right now. */
+    void applyLayouts();
+
+private slots:
+    void slotScreenChanged(const RandRChangeSet &changes);
+
+private:
+    void watchScreens();
+    bool applyLayout(RandRScreen *screen);
+
+    RandRDisplay *m_display;
+    bool m_ownsDisplay;
+    /** The last layout seen on each screen */
+    QMap<RandRScreen*, QString> m_layouts;
+};
+
+#endif // RANDRDAEMON_H
@@ -20,6 +20,9 @@
  */
 
 #include <QtCore/QDebug>
+#include <QtCore/QFile>
+#include <QtCore/QFuture>
+#include <QtCore/QtConcurrentRun>
 #include <QtGui/QApplication>
 #include <QtGui/QDesktopWidget>
 #include <QtGui/QX11Info>
@@ -27,35 +30,83 @@
 #include "randrdisplay.h"
 #ifdef HAS_RANDR_1_2
 #include "randrscreen.h"
+#include "randrlayoutstore.h"
+#include "randrapplyplan.h"
+#include "randrworker.h"
 #endif
 #include "legacyrandrscreen.h"
+#include "randrbackend.h"
+#include "randrtrace.h"
 
-RandRDisplay::RandRDisplay()
-    : m_valid(true)
+RandRDisplay *RandRDisplay::s_eventDisplay = 0;
+QCoreApplication::EventFilter RandRDisplay::s_previousFilter = 0;
+
+RandRDisplay::RandRDisplay(RandRBackend *backend)
+    : m_backend(backend ? backend : RandRBackend::instance()),
+      m_valid(true)
+{
+    if (!init())
+        return;
+
+#ifdef HAS_RANDR_1_2
+    QList<RandRSnapshot> snapshots;
+    if (m_has_1_2)
+    {
+        startWorkers();
+        snapshots = probeScreens();
+    }
+    createScreens(snapshots);
+#else
+    createScreens();
+#endif
+}
+
+#ifdef HAS_RANDR_1_2
+RandRDisplay::RandRDisplay(RandRBackend *backend, const QList<RandRSnapshot> &snapshots)
+    : m_backend(backend ? backend : RandRBackend::instance()),
+      m_valid(true)
 {
+    if (!init())
+        return;
+
+    if (m_has_1_2)
+        startWorkers();
+    createScreens(snapshots);
+}
+#endif
 
-    //m_dpy = XOpenDisplay(NULL);
-    m_dpy = QX11Info::display();
+bool RandRDisplay::init()
+{
+    m_dpy = m_backend->display();
+    m_has_1_2 = false;
+    m_has_1_3 = false;
 
     // Check extension
-    if(XRRQueryExtension(m_dpy, &m_eventBase, &m_errorBase) == False) {
+    if(!m_backend->queryExtension(m_eventBase, m_errorBase)) {
         m_valid = false;
-        return;
+        return false;
     }
 
     int major_version, minor_version;
-    XRRQueryVersion(m_dpy, &major_version, &minor_version);
+    m_backend->queryVersion(major_version, minor_version);
 
     m_version = QObject::tr("X Resize and Rotate extension version %1.%2").arg(major_version).arg(minor_version);
 
     qDebug() << major_version << minor_version << m_version;
     // check if we have the new version of the XRandR extension
-    RandR::has_1_2 = (major_version > 1 || (major_version == 1 && minor_version >= 2));
-    RandR::has_1_3 = (major_version > 1 || (major_version == 1 && minor_version >= 3));
+    m_has_1_2 = m_backend->has_1_2();
+    m_has_1_3 = m_backend->has_1_3();
 
-    if(RandR::has_1_3)
+    // the dialogs only show the display of the application
+    if (!m_dpy || m_dpy == QX11Info::display())
+    {
+        RandR::has_1_2 = m_has_1_2;
+        RandR::has_1_3 = m_has_1_3;
+    }
+
+    if(m_has_1_3)
         qDebug() << "Using XRANDR extension 1.3 or greater.";
-    else if(RandR::has_1_2)
+    else if(m_has_1_2)
         qDebug() << "Using XRANDR extension 1.2.";
     else
         qDebug() << "Using legacy XRANDR extension (1.1 or earlier).";
@@ -63,22 +114,33 @@ RandRDisplay::RandRDisplay()
     qDebug() << "XRANDR error base: " << m_errorBase;
 
     qDebug() << m_dpy;
-    m_numScreens = ScreenCount(m_dpy);
+    m_numScreens = m_backend->screenCount();
 
 //    m_numScreens = m_dpy->nscreens;
     m_currentScreenIndex = 0;
 
-    // set the timestamp to 0
-    RandR::timestamp = 0;
-
     // This assumption is WRONG with Xinerama
     // Q_ASSERT(QApplication::desktop()->numScreens() == ScreenCount(QX11Info::display()));
+    return true;
+}
 
+#ifdef HAS_RANDR_1_2
+void RandRDisplay::createScreens(const QList<RandRSnapshot> &snapshots)
+#else
+void RandRDisplay::createScreens()
+#endif
+{
     for (int i = 0; i < m_numScreens; i++)
     {
 #ifdef HAS_RANDR_1_2
-        if (RandR::has_1_2)
-            m_screens.append(new RandRScreen(i));
+        if (m_has_1_2)
+        {
+            RandRScreen *screen = new RandRScreen(i, m_backend, snapshots.value(i));
+            if (i < m_workers.count())
+                screen->setWorker(m_workers.at(i));
+            m_screens.append(screen);
+            m_rootScreens.insert(screen->rootWindow(), screen);
+        }
         else
 #endif
             m_legacyScreens.append(new LegacyRandRScreen(i));
@@ -86,7 +148,7 @@ RandRDisplay::RandRDisplay()
 #if 0
 //#ifdef HAS_RANDR_1_2
     // check if we have more than one output, if no, revert to the legacy behavior
-    if (RandR::has_1_2)
+    if (m_has_1_2)
     {
         int count = 0;
         foreach(RandRScreen *screen, m_screens)
@@ -94,7 +156,7 @@ RandRDisplay::RandRDisplay()
 
         if (count < 2)
         {
-            RandR::has_1_2 = false;
+            m_has_1_2 = false;
             for (int i = 0; i < m_numScreens; ++i)
             {
                 delete m_screens[i];
@@ -104,22 +166,94 @@ RandRDisplay::RandRDisplay()
         }
     }
 #endif
-    setCurrentScreen(DefaultScreen(QX11Info::display()));
+    setCurrentScreen(m_backend->defaultScreen());
+
+    // keep the model in sync with the server while the event loop runs,
+    // the application only receives the events of its own display
+    if (qApp && (!m_dpy || m_dpy == QX11Info::display()))
+    {
+        if (!s_eventDisplay)
+            s_previousFilter = qApp->setEventFilter(eventFilter);
+        s_eventDisplay = this;
+    }
 }
 
 RandRDisplay::~RandRDisplay()
 {
+        if (s_eventDisplay == this)
+        {
+            qApp->setEventFilter(s_previousFilter);
+            s_eventDisplay = 0;
+            s_previousFilter = 0;
+        }
+
         qDeleteAll(m_legacyScreens);
 #ifdef HAS_RANDR_1_2
+        // waits for what the workers are doing for the screens
+        qDeleteAll(m_workers);
         qDeleteAll(m_screens);
 #endif
 }
 
+#ifdef HAS_RANDR_1_2
+void RandRDisplay::startWorkers()
+{
+    // the slow probes and the changes of every screen are done on a
+    // connection of its own, so the screens don't wait for each other
+    if (!RandR::threads || !m_dpy || !qApp)
+        return;
+
+    for (int i = 0; i < m_numScreens; ++i)
+    {
+        RandRWorker *worker = new RandRWorker;
+        if (!worker->start(DisplayString(m_dpy)))
+        {
+            delete worker;
+            qDeleteAll(m_workers);
+            m_workers.clear();
+            return;
+        }
+        m_workers.append(worker);
+    }
+}
+
+QList<RandRSnapshot> RandRDisplay::probeScreens()
+{
+    QList<RandRSnapshot> snapshots;
+    if (m_workers.count() < 2)
+        return snapshots;
+
+    RandRTrace::Span span("probe screens");
+    QList<QFuture<RandRSnapshot> > futures;
+    for (int i = 0; i < m_workers.count(); ++i)
+        futures.append(QtConcurrent::run(m_workers.at(i), &RandRWorker::snapshot, i, RandR::reprobe));
+
+    foreach(const QFuture<RandRSnapshot> &future, futures)
+        snapshots.append(future.result());
+    return snapshots;
+}
+#endif
+
 bool RandRDisplay::isValid() const
 {
     return m_valid;
 }
 
+RandRBackend *RandRDisplay::backend() const
+{
+    return m_backend;
+}
+
+bool RandRDisplay::has_1_2() const
+{
+    return m_has_1_2;
+}
+
+bool RandRDisplay::has_1_3() const
+{
+    return m_has_1_3;
+}
+
 const QString& RandRDisplay::errorCode() const
 {
     return m_errorCode;
@@ -142,7 +276,7 @@ const QString& RandRDisplay::version() const
 
 void RandRDisplay::setCurrentScreen(int index)
 {
-    Q_ASSERT(index < ScreenCount(m_dpy));
+    Q_ASSERT(index < m_numScreens);
     m_currentScreenIndex = index;
 }
 
@@ -168,17 +302,28 @@ int RandRDisplay::currentScreenIndex() const
 
 bool RandRDisplay::needsRefresh() const
 {
+    // only the Xlib backend has a server to ask
+    if (!m_dpy)
+        return false;
+
     Time time, config_timestamp;
     time = XRRTimes(m_dpy, m_currentScreenIndex, &config_timestamp);
 
-    qDebug() << "Cache:" << RandR::timestamp << "Server:" << time << "Config:" << config_timestamp;
-    return (RandR::timestamp < time);
+    // every screen keeps the timestamp of its own configuration
+    Time cached = 0;
+#ifdef HAS_RANDR_1_2
+    if (m_has_1_2)
+        cached = m_screens.at(m_currentScreenIndex)->timestamp();
+#endif
+
+    qDebug() << "Cache:" << cached << "Server:" << time << "Config:" << config_timestamp;
+    return (cached < time);
 }
 
 void RandRDisplay::refresh()
 {
 #ifdef HAS_RANDR_1_2
-    if (RandR::has_1_2)
+    if (m_has_1_2)
     {
         for (int i = 0; i < m_screens.count(); ++i)
         {
@@ -208,21 +353,31 @@ bool RandRDisplay::canHandle(const XEvent *e) const
 }
 
 
+bool RandRDisplay::eventFilter(void *message, long *result)
+{
+    XEvent *e = (XEvent*)message;
+    if (s_eventDisplay && s_eventDisplay->canHandle(e))
+        s_eventDisplay->handleEvent(e);
+
+    // Qt needs to see the screen changes as well
+    if (s_previousFilter)
+        return s_previousFilter(message, result);
+    return false;
+}
+
 void RandRDisplay::handleEvent(XEvent *e)
 {
+    // the screens only take note of the events, the model is updated once
+    // the whole burst has been received
     if (e->type == m_eventBase + RRScreenChangeNotify)
     {
 #ifdef HAS_RANDR_1_2
-        if (RandR::has_1_2)
+        if (m_has_1_2)
         {
             XRRScreenChangeNotifyEvent *event = (XRRScreenChangeNotifyEvent*)(e);
-            for (int i=0; i < m_screens.count(); ++i)
-            {
-                RandRScreen *screen = m_screens.at(i);
-                if (screen->rootWindow() == event->root)
-                    screen->handleEvent(event);
-            }
-
+            RandRScreen *screen = m_rootScreens.value(event->root);
+            if (screen)
+                screen->handleEvent(event);
         }
         else
 #endif
@@ -235,21 +390,16 @@ void RandRDisplay::handleEvent(XEvent *e)
     {
         //forward the event to the right screen
         XRRNotifyEvent *event = (XRRNotifyEvent*)e;
-        for (int i=0; i < m_screens.count(); ++i)
-        {
-            RandRScreen *screen = m_screens.at(i);
-            if ( screen->rootWindow() == event->window )
-            {
-                screen->handleRandREvent(event);
-            }
-        }
+        RandRScreen *screen = m_rootScreens.value(event->window);
+        if (screen)
+            screen->handleRandREvent(event);
     }
 #endif
 }
 
 int RandRDisplay::numScreens() const
 {
-    Q_ASSERT(ScreenCount(XOpenDisplay(NULL)) == m_numScreens);
+    Q_ASSERT(!m_dpy || ScreenCount(m_dpy) == m_numScreens);
     return m_numScreens;
 }
 
@@ -280,10 +430,12 @@ bool RandRDisplay::loadDisplay(QSettings &config, bool loadScreens)
     if (loadScreens)
     {
 #ifdef HAS_RANDR_1_2
-        if (RandR::has_1_2)
+        if (m_has_1_2)
         {
+            RandRLayoutStore store;
+            store.open();
             foreach(RandRScreen *s, m_screens)
-                s->load(config);
+                s->load(store);
 
         }
         else
@@ -314,15 +466,19 @@ bool RandRDisplay::syncTrayApp(QSettings &config)
 
 void RandRDisplay::saveDisplay(QSettings &config, bool syncTrayApp)
 {
+    RandRTrace::Span span("persist");
     config.beginGroup("Display");
     config.setValue("SyncTrayApp", syncTrayApp);
     config.endGroup();
 
 #ifdef HAS_RANDR_1_2
-    if (RandR::has_1_2)
+    if (m_has_1_2)
     {
+        RandRLayoutStore store;
+        store.open();
         foreach(RandRScreen *s, m_screens)
-            s->save(config);
+            s->save(store);
+        store.save();
     }
     else
 #endif
@@ -332,28 +488,31 @@ void RandRDisplay::saveDisplay(QSettings &config, bool syncTrayApp)
     }
 }
 
-// to be used during desktop startup, make all screens provide the shell commands
-// (using xrandr cli tool), save them here and a script will perform these commands
-// early during desktop startup
+// to be used during desktop startup. The RandR 1.2 screens compile their
+// configuration into the apply plan that --startup executes, legacy screens
+// provide the shell commands (using xrandr cli tool) for a script to run
 void RandRDisplay::saveStartup(QSettings &config)
 {
+    RandRTrace::Span span("persist startup");
     config.beginGroup("Display");
     config.setValue("ApplyOnStartup", true);
 
-    QStringList commands;
 #ifdef HAS_RANDR_1_2
-    if (RandR::has_1_2)
+    if (m_has_1_2)
     {
+        RandRApplyPlan plan;
         foreach(RandRScreen *s, m_screens)
-            commands += s->startupCommands();
+            s->compilePlan(plan);
+        plan.save();
     }
     else
 #endif
     {
+        QStringList commands;
         foreach(LegacyRandRScreen *s, m_legacyScreens)
             commands += s->startupCommands();
+        config.setValue( "StartupCommands", commands.join( "\n" ));
     }
-    config.setValue( "StartupCommands", commands.join( "\n" ));
     config.endGroup();
 }
 
@@ -363,14 +522,17 @@ void RandRDisplay::disableStartup(QSettings &config)
     config.setValue("ApplyOnStartup", false);
     config.remove("StartupCommands");
     config.endGroup();
+#ifdef HAS_RANDR_1_2
+    QFile::remove(RandRApplyPlan::defaultFileName());
+#endif
 }
 
 void RandRDisplay::applyProposed(bool confirm)
 {
 #ifdef HAS_RANDR_1_2
-    if (RandR::has_1_2)
+    if (m_has_1_2)
         foreach(RandRScreen *s, m_screens)
-            s->applyProposed(confirm);
+            s->applyProposedAsync(confirm);
     else
 #endif
     {
@@ -389,3 +551,15 @@ void RandRDisplay::applyProposed(bool confirm)
         }
     }
 }
+
+bool RandRDisplay::isApplying() const
+{
+#ifdef HAS_RANDR_1_2
+    foreach(RandRScreen *s, m_screens)
+    {
+        if (s->isApplying())
+            return true;
+    }
+#endif
+    return false;
+}
@@ -22,19 +22,38 @@
 #define RANDRDISPLAY_H
 
 #include <QtGui/QWidget>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QHash>
 #include <QtCore/QSettings>
 #include <X11/Xlib.h>
 #include <config-randr.h>
 
 #include "randr.h"
 
+class RandRBackend;
+class RandRWorker;
+#ifdef HAS_RANDR_1_2
+struct RandRSnapshot;
+#endif
+
 class RandRDisplay
 {
 public:
-    RandRDisplay();
+    /** The display of @p backend, RandRBackend::instance() by default. */
+    RandRDisplay(RandRBackend *backend = 0);
+#ifdef HAS_RANDR_1_2
+    /** The display of @p backend, its screens built from @p snapshots,
+     * which were probed in advance, one per screen. */
+    RandRDisplay(RandRBackend *backend, const QList<RandRSnapshot> &snapshots);
+#endif
     ~RandRDisplay();
 
     bool isValid() const;
+    RandRBackend *backend() const;
+    /** The RandR version of the server of this display. RandR::has_1_2
+     * and RandR::has_1_3 only follow the display of the application. */
+    bool has_1_2() const;
+    bool has_1_3() const;
     const QString& errorCode() const;
     const QString& version() const;
 
@@ -59,7 +78,8 @@ public:
     /**
      * Loads saved settings.
      *
-     * @param config the KConfig object to load from
+     * @param config the settings to load from. The RandR 1.2 screens are
+     *               loaded from the RandRLayoutStore instead.
      * @param loadScreens whether to call LegacyRandRScreen::load() for each screen
      * @retuns true if the settings should be applied on KDE startup.
      */
@@ -71,22 +91,57 @@ public:
     static bool applyOnStartup(QSettings &config);
     static bool syncTrayApp(QSettings &config);
 
+    /** Apply the proposed configuration of every screen. The RandR 1.2
+     * screens send it from the worker thread if there is one. */
     void applyProposed(bool confirm = true);
+    /** Whether a screen waits for the worker to apply its changes. */
+    bool isApplying() const;
 
     bool canHandle(const XEvent *e) const;
     void handleEvent(XEvent *e);
 
 private:
+    /** Query the extension and the version of the server. False if it
+     * has no RandR. */
+    bool init();
+#ifdef HAS_RANDR_1_2
+    /** Build the screens, from @p snapshots where there is one. */
+    void createScreens(const QList<RandRSnapshot> &snapshots);
+#else
+    void createScreens();
+#endif
+
+    /** Passes the application's RandR events to the display that was
+     * created last, then to the filter that was installed before. */
+    static bool eventFilter(void *message, long *result);
+    static RandRDisplay *s_eventDisplay;
+    static QCoreApplication::EventFilter s_previousFilter;
+
+#ifdef HAS_RANDR_1_2
+    /** Start a worker, with a connection of its own, for every screen. */
+    void startWorkers();
+    /** Probe every screen at once, each on the connection of its worker.
+     * Empty if there is only one screen to probe; the screens then probe
+     * themselves when they are built. */
+    QList<RandRSnapshot> probeScreens();
+#endif
+
+    RandRBackend *m_backend;
     Display *m_dpy;
     int	m_numScreens;
     int	m_currentScreenIndex;
     LegacyScreenList m_legacyScreens;
 #ifdef HAS_RANDR_1_2
     ScreenList m_screens;
+    QHash<Window, RandRScreen*> m_rootScreens;
+    /** One per screen, in the order of the screens */
+    QList<RandRWorker*> m_workers;
 #endif
     bool m_valid;
     QString	m_errorCode;
     QString	m_version;
+    bool m_has_1_2;
+    bool m_has_1_3;
 
     int	m_eventBase;
     int m_errorBase;
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QFuture>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QtConcurrentRun>
+
+#include "randrdisplaygroup.h"
+#include "randrconnectionpool.h"
+#include "randrbackend.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randrsnapshot.h"
+#include "randrlayoutstore.h"
+#include "randrdaemon.h"
+#include "randrtrace.h"
+
+namespace
+{
+/** What is read from a display before its RandRDisplay is built. */
+struct DisplayProbe
+{
+    DisplayProbe() : backend(0), valid(false) {}
+
+    RandRBackend *backend;
+    /** The server has RandR 1.2 */
+    bool valid;
+    QList<RandRSnapshot> snapshots;
+};
+}
+
+/** Connect to @p name and probe all its screens. Every display has a
+ * connection of its own, so they can be probed at the same time. */
+static DisplayProbe probeDisplay(const QByteArray &name)
+{
+    RandRTrace::Span span("probe display");
+    DisplayProbe probe;
+    probe.backend = RandRConnectionPool::instance()->backend(name);
+    if (!probe.backend)
+        return probe;
+
+    int eventBase, errorBase;
+    probe.valid = probe.backend->queryExtension(eventBase, errorBase) && probe.backend->has_1_2();
+    if (!probe.valid)
+        return probe;
+
+    for (int i = 0; i < probe.backend->screenCount(); ++i)
+        probe.snapshots.append(RandRSnapshot::probe(probe.backend, i, RandR::reprobe));
+    return probe;
+}
+
+RandRDisplayGroup::Entry::Entry()
+    : dpy(0),
+      display(0),
+      notifier(0),
+      daemon(0),
+      pending(0),
+      applied(0),
+      succeeded(true),
+      elapsed(-1)
+{
+}
+
+RandRDisplayGroup::RandRDisplayGroup(QObject *parent)
+    : QObject(parent),
+      m_pending(0)
+{
+}
+
+RandRDisplayGroup::~RandRDisplayGroup()
+{
+    foreach(const Entry &entry, m_entries)
+    {
+        delete entry.daemon;
+        delete entry.notifier;
+        delete entry.display;
+    }
+}
+
+QStringList RandRDisplayGroup::parseNames(const QString &names)
+{
+    QStringList result;
+    foreach(const QString &name, names.split(',', QString::SkipEmptyParts))
+    {
+        if (!name.trimmed().isEmpty())
+            result.append(name.trimmed());
+    }
+    return result;
+}
+
+QByteArray RandRDisplayGroup::normalizedName(const QByteArray &name)
+{
+    int colon = name.lastIndexOf(':');
+    if (colon < 0)
+        return name;
+
+    QByteArray host = name.left(colon);
+    QByteArray display = name.mid(colon + 1);
+    int dot = display.indexOf('.');
+    if (dot >= 0)
+        display.truncate(dot);
+
+    if (host == "unix")
+        host.clear();
+    return host + ':' + display;
+}
+
+bool RandRDisplayGroup::open(const QStringList &names)
+{
+    // the layout store and the apply plan are keyed by screen index, so
+    // only the display of the session saves the layouts it applies
+    QByteArray session = normalizedName(XDisplayName(0));
+    bool sessionFound = false;
+
+    QList<QByteArray> displayNames;
+    foreach(const QString &name, names)
+        displayNames.append(name.toLocal8Bit());
+
+    // connecting and probing take round trips, do it for every display
+    // at once and only build the models here
+    QList<DisplayProbe> probes;
+    if (RandR::threads)
+    {
+        QList<QFuture<DisplayProbe> > futures;
+        foreach(const QByteArray &name, displayNames)
+            futures.append(QtConcurrent::run(probeDisplay, name));
+        foreach(const QFuture<DisplayProbe> &future, futures)
+            probes.append(future.result());
+    }
+    else
+    {
+        foreach(const QByteArray &name, displayNames)
+            probes.append(probeDisplay(name));
+    }
+
+    for (int i = 0; i < displayNames.count(); ++i)
+    {
+        Entry entry;
+        entry.name = displayNames.at(i);
+        const DisplayProbe &probe = probes.at(i);
+        if (!probe.backend)
+        {
+            qDebug() << "Skipping display" << entry.name << ": it can't be opened";
+            continue;
+        }
+        if (!probe.valid)
+        {
+            qDebug() << "Skipping display" << entry.name << ": RandR 1.2 is not available";
+            continue;
+        }
+
+        RandRTrace::Span span("open display");
+        entry.dpy = probe.backend->display();
+        entry.display = new RandRDisplay(probe.backend, probe.snapshots);
+        if (!entry.display->isValid() || !entry.display->has_1_2())
+        {
+            qDebug() << "Skipping display" << entry.name << ": RandR 1.2 is not available";
+            delete entry.display;
+            continue;
+        }
+
+        bool persistent = !sessionFound && normalizedName(entry.name) == session;
+        sessionFound = sessionFound || persistent;
+
+        // a connection of the pool, Qt never reads it
+        entry.notifier = new QSocketNotifier(ConnectionNumber(entry.dpy), QSocketNotifier::Read);
+        connect(entry.notifier, SIGNAL(activated(int)), SLOT(slotActivated(int)));
+        for (int j = 0; j < entry.display->numScreens(); ++j)
+        {
+            RandRScreen *screen = entry.display->screen(j);
+            screen->setPersistent(persistent);
+            connect(screen, SIGNAL(applied(bool)), SLOT(slotScreenApplied(bool)));
+            connect(screen, SIGNAL(changed(RandRChangeSet)), SLOT(slotScreenChanged()));
+        }
+        m_entries.append(entry);
+        processEvents(m_entries.last());
+    }
+
+    return !m_entries.isEmpty();
+}
+
+int RandRDisplayGroup::count() const
+{
+    return m_entries.count();
+}
+
+RandRDisplay *RandRDisplayGroup::display(int index) const
+{
+    return m_entries.at(index).display;
+}
+
+QByteArray RandRDisplayGroup::displayName(int index) const
+{
+    return m_entries.at(index).name;
+}
+
+void RandRDisplayGroup::applyLayouts()
+{
+    RandRLayoutStore store;
+    store.open();
+
+    // the layouts of every display are loaded before any is applied: the
+    // screens without a worker report their result on the spot
+    QList<RandRScreen*> screens;
+    m_pending = 1;
+    for (int i = 0; i < m_entries.count(); ++i)
+    {
+        Entry &entry = m_entries[i];
+        entry.pending = 0;
+        entry.applied = 0;
+        entry.succeeded = true;
+        entry.elapsed = -1;
+        entry.timer.start();
+
+        for (int j = 0; j < entry.display->numScreens(); ++j)
+        {
+            RandRScreen *screen = entry.display->screen(j);
+            if (screen->isApplying())
+            {
+                qDebug() << "Screen" << j << "of" << entry.name << "is still being applied";
+                continue;
+            }
+            if (!screen->loadLayout(store))
+            {
+                qDebug() << "No layout saved for" << screen->layoutName() << "on" << entry.name;
+                continue;
+            }
+            screens.append(screen);
+            ++entry.pending;
+            ++entry.applied;
+            ++m_pending;
+        }
+
+        if (!entry.pending)
+            entry.elapsed = entry.timer.elapsed();
+    }
+
+    foreach(RandRScreen *screen, screens)
+        screen->applyProposedAsync(false);
+
+    if (--m_pending == 0)
+    {
+        printResults();
+        emit finished();
+    }
+}
+
+void RandRDisplayGroup::slotScreenApplied(bool succeeded)
+{
+    int index = indexOf(sender());
+    if (index < 0 || !m_entries.at(index).pending)
+        return;
+
+    Entry &entry = m_entries[index];
+    screenDone(entry, succeeded);
+    processEvents(entry);
+}
+
+void RandRDisplayGroup::screenDone(Entry &entry, bool succeeded)
+{
+    entry.succeeded = entry.succeeded && succeeded;
+    if (--entry.pending == 0)
+    {
+        entry.elapsed = entry.timer.elapsed();
+        qDebug() << "Display" << entry.name << (entry.succeeded ? "applied" : "failed")
+                 << "in" << entry.elapsed << "ms";
+    }
+
+    if (--m_pending == 0)
+    {
+        printResults();
+        emit finished();
+    }
+}
+
+bool RandRDisplayGroup::succeeded() const
+{
+    foreach(const Entry &entry, m_entries)
+    {
+        if (!entry.succeeded)
+            return false;
+    }
+    return true;
+}
+
+void RandRDisplayGroup::printResults() const
+{
+    foreach(const Entry &entry, m_entries)
+    {
+        if (!entry.applied)
+            qDebug() << "  " << entry.name.constData() << "no layout saved";
+        else
+            qDebug() << "  " << entry.name.constData() << (entry.succeeded ? "applied" : "failed")
+                     << entry.applied << "screen(s) in" << entry.elapsed << "ms";
+    }
+}
+
+void RandRDisplayGroup::follow()
+{
+    for (int i = 0; i < m_entries.count(); ++i)
+    {
+        Entry &entry = m_entries[i];
+        if (!entry.daemon)
+            entry.daemon = new RandRDaemon(entry.display);
+    }
+}
+
+void RandRDisplayGroup::slotActivated(int socket)
+{
+    for (int i = 0; i < m_entries.count(); ++i)
+    {
+        if (m_entries.at(i).notifier->socket() == socket)
+            processEvents(m_entries[i]);
+    }
+}
+
+void RandRDisplayGroup::slotScreenChanged()
+{
+    // a reload may have read events into the queue of Xlib, the socket
+    // does not tell about those
+    int index = indexOf(sender());
+    if (index >= 0)
+        processEvents(m_entries[index]);
+}
+
+void RandRDisplayGroup::processEvents(Entry &entry)
+{
+    while (XPending(entry.dpy))
+    {
+        XEvent event;
+        XNextEvent(entry.dpy, &event);
+        if (entry.display->canHandle(&event))
+            entry.display->handleEvent(&event);
+    }
+}
+
+int RandRDisplayGroup::indexOf(QObject *screen) const
+{
+    for (int i = 0; i < m_entries.count(); ++i)
+    {
+        RandRDisplay *display = m_entries.at(i).display;
+        for (int j = 0; j < display->numScreens(); ++j)
+        {
+            if (display->screen(j) == screen)
+                return i;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRDISPLAYGROUP_H
+#define RANDRDISPLAYGROUP_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QObject>
+#include <QtCore/QStringList>
+
+#include <X11/Xlib.h>
+
+class QSocketNotifier;
+class RandRDisplay;
+class RandRDaemon;
+
+/** Several X displays managed from one process, for the hosts that run
+ * an X server per seat.
+ *
+ * Every display gets its own RandRDisplay, on the connections of the
+ * RandRConnectionPool. applyLayouts() loads the layout saved for the
+ * outputs connected to each screen and applies them all at once, each
+ * screen through its own worker, then reports the result and the time it
+ * took for every display. follow() keeps applying the saved layouts when
+ * monitors get plugged, as RandRDaemon does for a single display. Only
+ * the display named by $DISPLAY saves what it applies, the others would
+ * overwrite each other's settings.
+ *
+ * Every display, the one of the session included, is opened on a
+ * connection of the pool and never on the one of Qt, so the group reads
+ * the events of all of them from their connection. */
+class RandRDisplayGroup : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RandRDisplayGroup(QObject *parent = 0);
+    ~RandRDisplayGroup();
+
+    /** Open the displays in @p names, like ":0" or "host:1". They are
+     * connected to and probed at the same time, each on its own
+     * connection. The ones that can't be opened or lack RandR 1.2 are
+     * reported and skipped. Returns false if none is left. */
+    bool open(const QStringList &names);
+
+    int count() const;
+    RandRDisplay *display(int index) const;
+    QByteArray displayName(int index) const;
+
+    /** Apply the layouts saved for the outputs connected to the screens of
+     * every display. finished() is emitted once all of them are done. */
+    void applyLayouts();
+    /** Whether every display applied its layouts. The screens that have no
+     * layout saved are left as they are and do not count as failures. */
+    bool succeeded() const;
+    /** Print the result and the time of the last applyLayouts() for every
+     * display. */
+    void printResults() const;
+
+    /** Follow the hotplugs of every display from now on. */
+    void follow();
+
+    /** Split the argument of --displays, a comma separated list. */
+    static QStringList parseNames(const QString &names);
+    /** @p name as host:display, without the screen number. The local
+     * connections, ":0" and "unix:0", have no host. So ":0.0", "unix:0"
+     * and ":0" all name the same display. */
+    static QByteArray normalizedName(const QByteArray &name);
+
+signals:
+    void finished();
+
+private slots:
+    void slotActivated(int socket);
+    void slotScreenApplied(bool succeeded);
+    void slotScreenChanged();
+
+private:
+    struct Entry
+    {
+        Entry();
+
+        QByteArray name;
+        Display *dpy;
+        RandRDisplay *display;
+        /** Reads the events of the connection of the pool */
+        QSocketNotifier *notifier;
+        RandRDaemon *daemon;
+
+        /** The screens still being applied */
+        int pending;
+        /** The screens that had a layout saved */
+        int applied;
+        bool succeeded;
+        QElapsedTimer timer;
+        qint64 elapsed;
+    };
+
+    /** Pass the events queued on the connection of @p entry to its
+     * display. */
+    void processEvents(Entry &entry);
+    /** Take note that a screen of @p entry is done. */
+    void screenDone(Entry &entry, bool succeeded);
+    int indexOf(QObject *screen) const;
+
+    QList<Entry> m_entries;
+    int m_pending;
+};
+
+#endif // RANDRDISPLAYGROUP_H
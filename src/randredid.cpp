@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <X11/Xatom.h>
+#include <string.h>
+
+#include "randredid.h"
+
+// the EDID header every base block starts with
+static const unsigned char edidHeader[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+
+Atom RandREdid::edidAtom(Display *dpy)
+{
+    static Atom atom = None;
+    if (atom == None)
+        atom = XInternAtom(dpy, RR_PROPERTY_RANDR_EDID, True);
+    return atom;
+}
+
+// drivers from before RandR 1.3 use a different name
+Atom RandREdid::legacyEdidAtom(Display *dpy)
+{
+    static Atom atom = None;
+    if (atom == None)
+        atom = XInternAtom(dpy, "EDID_DATA", True);
+    return atom;
+}
+
+bool RandREdid::isEdidProperty(Display *dpy, Atom property)
+{
+    return property != None && (property == edidAtom(dpy) || property == legacyEdidAtom(dpy));
+}
+
+QByteArray RandREdid::read(Display *dpy, RROutput output)
+{
+    Atom atoms[2] = { edidAtom(dpy), legacyEdidAtom(dpy) };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (atoms[i] == None)
+            continue;
+
+        Atom type;
+        int format;
+        unsigned long items, bytesAfter;
+        unsigned char *data = 0;
+
+        // only the base block is needed, the length is given in 32 bit units
+        if (XRRGetOutputProperty(dpy, output, atoms[i], 0, BlockSize / 4, False, False,
+                                 AnyPropertyType, &type, &format, &items, &bytesAfter,
+                                 &data) != Success)
+            continue;
+
+        QByteArray edid;
+        if (type == XA_INTEGER && format == 8 && items >= (unsigned long)BlockSize)
+            edid = QByteArray((const char*)data, BlockSize);
+        if (data)
+            XFree(data);
+
+        if (!edid.isEmpty())
+            return edid;
+    }
+
+    return QByteArray();
+}
+
+QString RandREdid::fingerprint(const QByteArray &edid)
+{
+    if (edid.size() < BlockSize || memcmp(edid.constData(), edidHeader, sizeof(edidHeader)) != 0)
+        return QString();
+
+    quint32 hash = 2166136261u;
+    const unsigned char *data = (const unsigned char*)edid.constData();
+    for (int i = 0; i < BlockSize; ++i)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return QString("%1").arg(hash, 8, 16, QChar('0'));
+}
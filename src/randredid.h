@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef RANDREDID_H
+#define RANDREDID_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+
+/** Identifies monitors by their EDID.
+ *
+ * Connector names are not stable (MST docks renumber them between boots),
+ * the EDID base block is: it holds the vendor, product and serial number
+ * of the monitor. The fingerprint is a 32 bit FNV-1a hash of that block. */
+class RandREdid
+{
+public:
+    /** Size of the EDID base block */
+    static const int BlockSize = 128;
+
+    /** Read the EDID base block of @p output. An empty array is returned
+     * if the output does not provide one. */
+    static QByteArray read(Display *dpy, RROutput output);
+
+    /** Whether @p property is one of the properties the EDID is read from. */
+    static bool isEdidProperty(Display *dpy, Atom property);
+
+    /** A short hexadecimal fingerprint of @p edid, or an empty string if
+     * @p edid is not a valid base block. */
+    static QString fingerprint(const QByteArray &edid);
+
+private:
+    static Atom edidAtom(Display *dpy);
+    static Atom legacyEdidAtom(Display *dpy);
+};
+
+#endif // RANDREDID_H
@@ -41,9 +41,11 @@
 #include <X11/extensions/Xrandr.h>
 
 #include "randrgammainfo.h"
+#include "randrgammalut.h"
+#include "randrstats.h"
 
 /* Returns the index of the last value in an array < 0xffff */
-static int find_last_non_clamped(unsigned short array[], int size) {
+static int find_last_non_clamped(const unsigned short array[], int size) {
     int i;
     for (i = size - 1; i > 0; i--) {
         if (array[i] < 0xffff)
@@ -52,25 +54,17 @@ static int find_last_non_clamped(unsigned short array[], int size) {
     return 0;
 }
 
-void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *brightness, float *red, float *blue, float *green)
+void gamma_info_from_ramps(int size, const unsigned short *ramp_red, const unsigned short *ramp_green, const unsigned short *ramp_blue, float *brightness, float *red, float *blue, float *green)
 {
-    XRRCrtcGamma *crtc_gamma;
     double i1, v1, i2, v2;
-    int size, middle, last_best, last_red, last_green, last_blue;
-    unsigned short *best_array;
+    int middle, last_best, last_red, last_green, last_blue;
+    const unsigned short *best_array;
 
-    size = XRRGetCrtcGammaSize(dpy, crtc);
     if (!size) {
       printf("Failed to get size of gamma for output\n");
       return;
     }
 
-    crtc_gamma = XRRGetCrtcGamma(dpy, crtc);
-    if (!crtc_gamma) {
-      printf("Failed to get gamma for output\n");
-      return;
-    }
-
     /*
      * Here is a bit tricky because gamma is a whole curve for each
      * color.  So, typically, we need to represent 3 * 256 values as 3 + 1
@@ -85,18 +79,18 @@ void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *b
      * clamped and i1 at i2/2. Note that if i2 = 1 (as in most normal
      * cases), then b = v2.
      */
-    last_red = find_last_non_clamped(crtc_gamma->red, size);
-    last_green = find_last_non_clamped(crtc_gamma->green, size);
-    last_blue = find_last_non_clamped(crtc_gamma->blue, size);
-    best_array = crtc_gamma->red;
+    last_red = find_last_non_clamped(ramp_red, size);
+    last_green = find_last_non_clamped(ramp_green, size);
+    last_blue = find_last_non_clamped(ramp_blue, size);
+    best_array = ramp_red;
     last_best = last_red;
     if (last_green > last_best) {
       last_best = last_green;
-      best_array = crtc_gamma->green;
+      best_array = ramp_green;
     }
     if (last_blue > last_best) {
       last_best = last_blue;
-      best_array = crtc_gamma->blue;
+      best_array = ramp_blue;
     }
     if (last_best == 0)
       last_best = 1;
@@ -116,60 +110,65 @@ void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *b
         *brightness = v2;
     else
         *brightness = exp((log(v2)*log(i1) - log(v1)*log(i2))/log(i1/i2));
-        *red = log((double)(crtc_gamma->red[last_red / 2]) / *brightness
+        *red = log((double)(ramp_red[last_red / 2]) / *brightness
               / 65535) / log((double)((last_red / 2) + 1) / size);
-        *green = log((double)(crtc_gamma->green[last_green / 2]) / *brightness
+        *green = log((double)(ramp_green[last_green / 2]) / *brightness
                 / 65535) / log((double)((last_green / 2) + 1) / size);
-        *blue = log((double)(crtc_gamma->blue[last_blue / 2]) / *brightness
+        *blue = log((double)(ramp_blue[last_blue / 2]) / *brightness
                / 65535) / log((double)((last_blue / 2) + 1) / size);
     }
-
-    XRRFreeGamma(crtc_gamma);
 }
 
-static double dmin (double x, double y)
+void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *brightness, float *red, float *blue, float *green)
 {
-    return x < y ? x : y;
+    XRRCrtcGamma *crtc_gamma;
+    RandRStats::Scope scope(RandRStats::Gamma);
+
+    crtc_gamma = XRRGetCrtcGamma(dpy, crtc);
+    if (!crtc_gamma) {
+      printf("Failed to get gamma for output\n");
+      return;
+    }
+    RandRStats::call(8, 32 + ((6 * crtc_gamma->size + 3) & ~3));
+
+    gamma_info_from_ramps(crtc_gamma->size, crtc_gamma->red, crtc_gamma->green, crtc_gamma->blue,
+                          brightness, red, blue, green);
+
+    XRRFreeGamma(crtc_gamma);
 }
 
 void
 set_gamma(Display *dpy, XRRScreenResources *res, RRCrtc crtc_id, float brightness, float red, float blue, float green)
 {
-	int i, size, shift;
-	XRRCrtcGamma *crtc_gamma;
-	float gammaRed;
-	float gammaGreen;
-	float gammaBlue;
+	int size;
+	RandRStats::Scope scope(RandRStats::Gamma);
 
 	qDebug() << "[set_gamma] Appling brightness " << brightness;
 
-	//XRRCrtcInfo *info = XRRGetCrtcInfo(dpy, res, crtc_id);
-
 	size = XRRGetCrtcGammaSize(dpy, crtc_id);
+	RandRStats::call(8, 32);
 
 	if (!size) {
 	    qDebug() << "Gamma size is 0.\n";
 	    return;
 	}
 
-	/*
-	 * The gamma-correction lookup table managed through XRR[GS]etCrtcGamma
-	 * is 2^n in size, where 'n' is the number of significant bits in
-	 * the X Color.  Because an X Color is 16 bits, size cannot be larger
-	 * than 2^16.
-	 */
-	if (size > 65536) {
+	/* The ramps are computed by RandRGammaLut, which refuses sizes that
+	 * can't be represented in a 16 bit X Color */
+	QVector<unsigned short> ramp = RandRGammaLut::ramp(size, brightness, red, green, blue);
+	if (ramp.isEmpty()) {
 	    qDebug() << "Gamma correction table is impossibly large.\n";
 	    return;
 	}
 
-	/*
-	 * The hardware color lookup table has a number of significant
-	 * bits equal to ffs(size) - 1; compute all values so that
-	 * they are in the range [0,size) then shift the values so
-	 * that they occupy the MSBs of the 16-bit X Color.
-	 */
-	shift = 16 - (ffs(size) - 1);
+	set_gamma_ramp(dpy, crtc_id, size, ramp.constData());
+}
+
+void
+set_gamma_ramp(Display *dpy, RRCrtc crtc_id, int size, const unsigned short *ramp)
+{
+	XRRCrtcGamma *crtc_gamma;
+	RandRStats::Scope scope(RandRStats::Gamma);
 
 	crtc_gamma = XRRAllocGamma(size);
 	if (!crtc_gamma) {
@@ -177,46 +176,12 @@ set_gamma(Display *dpy, XRRScreenResources *res, RRCrtc crtc_id, float brightnes
 	    return;
 	}
 
-	if (red == 0.0)
-	    red = 1.0;
-	if (green == 0.0)
-	    green = 1.0;
-	if (blue == 0.0)
-	    blue = 1.0;
-
-	gammaRed = 1.0 / red;
-	gammaGreen = 1.0 / green;
-	gammaBlue = 1.0 / blue;
-
-	for (i = 0; i < size; i++) {
-	    if (gammaRed == 1.0 && brightness == 1.0)
-		crtc_gamma->red[i] = i;
-	    else
-		crtc_gamma->red[i] = dmin(pow((double)i/(double)(size - 1),
-					      gammaRed) * brightness,
-					  1.0) * (double)(size - 1);
-	    crtc_gamma->red[i] <<= shift;
-
-	    if (gammaGreen == 1.0 && brightness == 1.0)
-		crtc_gamma->green[i] = i;
-	    else
-		crtc_gamma->green[i] = dmin(pow((double)i/(double)(size - 1),
-						gammaGreen) * brightness,
-					    1.0) * (double)(size - 1);
-	    crtc_gamma->green[i] <<= shift;
-
-	    if (gammaBlue == 1.0 && brightness == 1.0)
-		crtc_gamma->blue[i] = i;
-	    else
-		crtc_gamma->blue[i] = dmin(pow((double)i/(double)(size - 1),
-					       gammaBlue) * brightness,
-					   1.0) * (double)(size - 1);
-	    crtc_gamma->blue[i] <<= shift;
-	}
+	memcpy(crtc_gamma->red, ramp, size * sizeof(unsigned short));
+	memcpy(crtc_gamma->green, ramp + size, size * sizeof(unsigned short));
+	memcpy(crtc_gamma->blue, ramp + 2 * size, size * sizeof(unsigned short));
 
 	XRRSetCrtcGamma(dpy, crtc_id, crtc_gamma);
+	RandRStats::request(12 + ((6 * size + 3) & ~3));
 
-	free(crtc_gamma);
-
+	XRRFreeGamma(crtc_gamma);
 }
-
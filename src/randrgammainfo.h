@@ -36,8 +36,13 @@
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrandr.h>
 
+void gamma_info_from_ramps(int size, const unsigned short *ramp_red, const unsigned short *ramp_green, const unsigned short *ramp_blue, float *brightness, float *red, float *blue, float *green);
+
 void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *brightness, float *red, float *blue, float *green);
 
 void set_gamma(Display *dpy, XRRScreenResources *res, RRCrtc crtc_id, float brightness, float red, float blue, float green);
 
+/* Set precomputed ramps, red, green and blue of the given size one after the other */
+void set_gamma_ramp(Display *dpy, RRCrtc crtc_id, int size, const unsigned short *ramp);
+
 #endif
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+
+#include "randrgammalut.h"
+
+// more different settings than this are not expected in a session, the
+// cache is simply emptied when it grows beyond that
+static const int MaxCachedRamps = 32;
+
+namespace
+{
+    struct RampKey
+    {
+        int size;
+        float brightness;
+        float red;
+        float green;
+        float blue;
+
+        bool operator==(const RampKey &other) const
+        {
+            return size == other.size && brightness == other.brightness &&
+                   red == other.red && green == other.green && blue == other.blue;
+        }
+    };
+
+    uint floatHash(float value)
+    {
+        quint32 bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    uint qHash(const RampKey &key)
+    {
+        uint h = key.size;
+        h = h * 31 + floatHash(key.brightness);
+        h = h * 31 + floatHash(key.red);
+        h = h * 31 + floatHash(key.green);
+        h = h * 31 + floatHash(key.blue);
+        return h;
+    }
+}
+
+// the ramps are made on the GUI thread, the workers and the threads of
+// RandRDisplayGroup, the caches are only touched with the mutex held
+static QMutex cacheMutex;
+static QHash<RampKey, QVector<unsigned short> > rampCache;
+static QHash<int, QVector<double> > logCache;
+
+/* Whether @p scaled is so close to a whole level that the rounding of
+ * exp(g * ln(x)), which differs from the one of pow(x, g) by far less than
+ * this, could truncate it to another one */
+static bool nearLevel(double scaled)
+{
+    double fraction = scaled - floor(scaled);
+    return fraction < 1e-6 || fraction > 1.0 - 1e-6;
+}
+
+/* ln(i / (size - 1)) for every input level, so that the power function
+ * costs a single exp() per entry. Returned as a shared copy, the cache may
+ * be emptied by another thread while it is used. */
+static QVector<double> logTable(int size)
+{
+    {
+        QMutexLocker locker(&cacheMutex);
+        QHash<int, QVector<double> >::const_iterator it = logCache.constFind(size);
+        if (it != logCache.constEnd())
+            return it.value();
+    }
+
+    QVector<double> table(size);
+    for (int i = 0; i < size; ++i)
+        table[i] = log((double)i / (double)(size - 1));
+
+    QMutexLocker locker(&cacheMutex);
+    logCache.insert(size, table);
+    return table;
+}
+
+void RandRGammaLut::fill(unsigned short *channel, int size, float brightness, float gamma)
+{
+    if (size < 2)
+    {
+        if (size == 1)
+            channel[0] = 0;
+        return;
+    }
+
+    /*
+     * The hardware color lookup table has a number of significant
+     * bits equal to ffs(size) - 1; compute all values so that
+     * they are in the range [0,size) then shift the values so
+     * that they occupy the MSBs of the 16-bit X Color.
+     */
+    const int shift = 16 - (ffs(size) - 1);
+    const double top = size - 1;
+
+    if (gamma == 1.0)
+    {
+        if (brightness == 1.0)
+        {
+            for (int i = 0; i < size; ++i)
+                channel[i] = (unsigned short)(i << shift);
+            return;
+        }
+
+        for (int i = 0; i < size; ++i)
+        {
+            double v = (double)i / top * brightness;
+            channel[i] = (unsigned short)((unsigned short)((v < 1.0 ? v : 1.0) * top) << shift);
+        }
+        return;
+    }
+
+    const QVector<double> table = logTable(size);
+    const double *ln = table.constData();
+    const unsigned short clamped = (unsigned short)((unsigned short)top << shift);
+    for (int i = 0; i < size; ++i)
+    {
+        double v = exp(gamma * ln[i]) * brightness;
+        // the few entries the two could round apart are computed the way
+        // xrandr does, so the ramp is the same as the one it sets
+        if (nearLevel((v < 1.0 ? v : 1.0) * top) || fabs(v - 1.0) < 1e-9)
+            v = pow((double)i / top, (double)gamma) * brightness;
+        if (v >= 1.0)
+        {
+            channel[i] = clamped;
+            // the curve only grows, everything after this is clamped too
+            if (gamma > 0)
+            {
+                for (++i; i < size; ++i)
+                    channel[i] = clamped;
+                return;
+            }
+            continue;
+        }
+        channel[i] = (unsigned short)((unsigned short)(v * top) << shift);
+    }
+}
+
+QVector<unsigned short> RandRGammaLut::ramp(int size, float brightness, float red, float green, float blue)
+{
+    /*
+     * The gamma-correction lookup table managed through XRR[GS]etCrtcGamma
+     * is 2^n in size, where 'n' is the number of significant bits in
+     * the X Color.  Because an X Color is 16 bits, size cannot be larger
+     * than 2^16.
+     */
+    if (size < 1 || size > 65536)
+        return QVector<unsigned short>();
+
+    if (red == 0.0)
+        red = 1.0;
+    if (green == 0.0)
+        green = 1.0;
+    if (blue == 0.0)
+        blue = 1.0;
+
+    RampKey key;
+    key.size = size;
+    key.brightness = brightness;
+    key.red = red;
+    key.green = green;
+    key.blue = blue;
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        QHash<RampKey, QVector<unsigned short> >::const_iterator it = rampCache.constFind(key);
+        if (it != rampCache.constEnd())
+            return it.value();
+    }
+
+    float gammaRed = 1.0 / red;
+    float gammaGreen = 1.0 / green;
+    float gammaBlue = 1.0 / blue;
+
+    // channels with the same gamma share the computation
+    QVector<unsigned short> ramp(3 * size);
+    unsigned short *r = ramp.data();
+    unsigned short *g = r + size;
+    unsigned short *b = g + size;
+
+    fill(r, size, brightness, gammaRed);
+
+    if (gammaGreen == gammaRed)
+        memcpy(g, r, size * sizeof(unsigned short));
+    else
+        fill(g, size, brightness, gammaGreen);
+
+    if (gammaBlue == gammaRed)
+        memcpy(b, r, size * sizeof(unsigned short));
+    else if (gammaBlue == gammaGreen)
+        memcpy(b, g, size * sizeof(unsigned short));
+    else
+        fill(b, size, brightness, gammaBlue);
+
+    QMutexLocker locker(&cacheMutex);
+    if (rampCache.count() >= MaxCachedRamps)
+        rampCache.clear();
+    rampCache.insert(key, ramp);
+
+    return ramp;
+}
+
+void RandRGammaLut::clearCache()
+{
+    QMutexLocker locker(&cacheMutex);
+    rampCache.clear();
+    logCache.clear();
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRGAMMALUT_H
+#define RANDRGAMMALUT_H
+
+#include <QtCore/QVector>
+
+/** Generates the gamma ramps set with XRRSetCrtcGamma.
+ *
+ * A ramp maps each of the @p size input levels to
+ * min((i / (size - 1)) ^ (1 / gamma) * brightness, 1), scaled to the
+ * significant bits of a 16 bit X color, like xrandr does. Finished ramps
+ * are cached by size, brightness and gamma, so applying the same settings
+ * again costs nothing. The cache can be used from any thread. */
+class RandRGammaLut
+{
+public:
+    /** Return the ramp for the given settings. The red, green and blue
+     * channels are stored one after the other, each with @p size entries.
+     * An empty vector is returned if @p size is not supported. */
+    static QVector<unsigned short> ramp(int size, float brightness, float red, float green, float blue);
+
+    /** Fill one channel of a ramp without using the cache. */
+    static void fill(unsigned short *channel, int size, float brightness, float gamma);
+
+    /** Drop all cached ramps and tables. */
+    static void clearCache();
+};
+
+#endif // RANDRGAMMALUT_H
@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <QtCore/QtAlgorithms>
+#include <X11/extensions/randr.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "randrlayoutstore.h"
+#include "randrtrace.h"
+
+// the record is the file format, its size must not change by accident
+typedef char RecordSizeCheck[sizeof(RandRLayoutStore::Record) == 112 ? 1 : -1];
+
+// the records of version 1 are the start of the current ones
+static const quint32 RecordSizeV1 = 96;
+
+bool RandRLayoutStore::Record::hasFlag(Flag flag) const
+{
+    return flags & flag;
+}
+
+void RandRLayoutStore::Record::setFlag(Flag flag, bool on)
+{
+    if (on)
+        flags |= flag;
+    else
+        flags &= ~flag;
+}
+
+QRect RandRLayoutStore::Record::rect() const
+{
+    return QRect(geometry[0], geometry[1], geometry[2], geometry[3]);
+}
+
+void RandRLayoutStore::Record::setRect(const QRect &rect)
+{
+    // an invalid rect is stored as 0,0,0,0, which reads back as invalid
+    bool valid = rect.isValid();
+    geometry[0] = valid ? rect.x() : 0;
+    geometry[1] = valid ? rect.y() : 0;
+    geometry[2] = valid ? rect.width() : 0;
+    geometry[3] = valid ? rect.height() : 0;
+}
+
+QRect RandRLayoutStore::Record::virtualRect() const
+{
+    return QRect(virtualGeometry[0], virtualGeometry[1], virtualGeometry[2], virtualGeometry[3]);
+}
+
+void RandRLayoutStore::Record::setVirtualRect(const QRect &rect)
+{
+    bool valid = rect.isValid();
+    virtualGeometry[0] = valid ? rect.x() : 0;
+    virtualGeometry[1] = valid ? rect.y() : 0;
+    virtualGeometry[2] = valid ? rect.width() : 0;
+    virtualGeometry[3] = valid ? rect.height() : 0;
+}
+
+RandRLayoutStore::RandRLayoutStore()
+    : m_map(0),
+      m_data(0),
+      m_count(0),
+      m_detached(false)
+{
+}
+
+RandRLayoutStore::~RandRLayoutStore()
+{
+    close();
+}
+
+QString RandRLayoutStore::defaultFileName()
+{
+    return configFileName(".layouts");
+}
+
+QString RandRLayoutStore::configFileName(const QString &extension)
+{
+    // where QSettings keeps the INI file, without having to parse it
+    QString dir = QFile::decodeName(qgetenv("XDG_CONFIG_HOME"));
+    if (dir.isEmpty())
+        dir = QDir::homePath() + "/.config";
+
+    QString organization = QCoreApplication::organizationName();
+    if (organization.isEmpty())
+        organization = QCoreApplication::organizationDomain();
+
+    return dir + "/" + organization + "/" + QCoreApplication::applicationName() + extension;
+}
+
+bool RandRLayoutStore::open(const QString &fileName)
+{
+    close();
+    m_fileName = fileName;
+
+    if (!QFile::exists(m_fileName))
+    {
+        import();
+        if (!isEmpty())
+            save();
+        return true;
+    }
+
+    if (!map())
+    {
+        qDebug() << "Ignoring the invalid layout store" << m_fileName;
+        close();
+        m_fileName = fileName;
+        return false;
+    }
+    return true;
+}
+
+bool RandRLayoutStore::map()
+{
+    m_file.setFileName(m_fileName);
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = m_file.size();
+    if (size < (qint64) sizeof(Header))
+        return false;
+
+    m_map = m_file.map(0, size);
+    if (!m_map)
+        return false;
+
+    const Header *header = (const Header*) m_map;
+    if (header->magic == Magic && header->version == 1 && header->recordSize == RecordSizeV1 &&
+        size == (qint64) (sizeof(Header) + header->count * RecordSizeV1))
+    {
+        // converted in memory, the next save() writes the current version
+        const uchar *data = m_map + sizeof(Header);
+        m_records.resize(header->count);
+        for (quint32 i = 0; i < header->count; ++i)
+        {
+            memset(&m_records[i], 0, sizeof(Record));
+            memcpy(&m_records[i], data + i * RecordSizeV1, RecordSizeV1);
+        }
+        m_data = m_records.constData();
+        m_count = header->count;
+        m_detached = true;
+        return true;
+    }
+
+    if (header->magic != Magic || header->version != Version ||
+        header->recordSize != sizeof(Record) ||
+        size != (qint64) (sizeof(Header) + header->count * sizeof(Record)))
+        return false;
+
+    m_data = (const Record*) (m_map + sizeof(Header));
+    m_count = header->count;
+    return true;
+}
+
+void RandRLayoutStore::close()
+{
+    if (m_map)
+        m_file.unmap(m_map);
+    m_file.close();
+
+    m_map = 0;
+    m_data = 0;
+    m_count = 0;
+    m_records.clear();
+    m_detached = false;
+    m_fileName.clear();
+}
+
+bool RandRLayoutStore::isEmpty() const
+{
+    return m_count == 0;
+}
+
+int RandRLayoutStore::count() const
+{
+    return m_count;
+}
+
+quint64 RandRLayoutStore::layoutId(const QString &layout)
+{
+    if (layout.isEmpty())
+        return 0;
+
+    QByteArray name = layout.toUtf8();
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    for (int i = 0; i < name.size(); ++i)
+    {
+        hash ^= (uchar) name.at(i);
+        hash *= Q_UINT64_C(1099511628211);
+    }
+    return hash;
+}
+
+RandRLayoutStore::Record RandRLayoutStore::record(RecordType type, const QString &layout, int screen,
+                                                  const QString &key)
+{
+    return record(type, layoutId(layout), screen, key);
+}
+
+RandRLayoutStore::Record RandRLayoutStore::record(RecordType type, quint64 layout, int screen,
+                                                  const QString &key)
+{
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.type = type;
+    record.layout = layout;
+    record.screen = screen;
+    record.rotation = RR_Rotate_0;
+    qstrncpy(record.key, key.toUtf8().constData(), KeySize);
+    return record;
+}
+
+bool RandRLayoutStore::lessThan(const Record &a, const Record &b)
+{
+    if (a.layout != b.layout)
+        return a.layout < b.layout;
+    if (a.screen != b.screen)
+        return a.screen < b.screen;
+    if (a.type != b.type)
+        return a.type < b.type;
+    return strncmp(a.key, b.key, KeySize) < 0;
+}
+
+const RandRLayoutStore::Record *RandRLayoutStore::lowerBound(const Record &record) const
+{
+    return qLowerBound(m_data, m_data + m_count, record, lessThan);
+}
+
+bool RandRLayoutStore::hasLayout(const QString &layout) const
+{
+    // the first record of the layout, if there is one
+    Record first = record(ScreenRecord, layout, -0x7fffffff - 1, QString());
+    first.type = 0;
+
+    const Record *it = lowerBound(first);
+    return it != m_data + m_count && it->layout == first.layout;
+}
+
+const RandRLayoutStore::Record *RandRLayoutStore::find(RecordType type, const QString &layout,
+                                                       int screen, const QString &key) const
+{
+    Record wanted = record(type, layout, screen, key);
+
+    const Record *it = lowerBound(wanted);
+    if (it == m_data + m_count || lessThan(wanted, *it))
+        return 0;
+    return it;
+}
+
+void RandRLayoutStore::detach()
+{
+    if (m_detached)
+        return;
+
+    m_records.resize(m_count);
+    if (m_count)
+        memcpy(m_records.data(), m_data, m_count * sizeof(Record));
+    m_data = m_records.constData();
+    m_detached = true;
+}
+
+void RandRLayoutStore::insert(const Record &record)
+{
+    detach();
+
+    QVector<Record>::iterator it = qLowerBound(m_records.begin(), m_records.end(), record, lessThan);
+    if (it != m_records.end() && !lessThan(record, *it))
+        *it = record;
+    else
+        m_records.insert(it, record);
+
+    m_data = m_records.constData();
+    m_count = m_records.count();
+}
+
+bool RandRLayoutStore::save()
+{
+    if (m_fileName.isEmpty())
+        return false;
+
+    Header header;
+    header.magic = Magic;
+    header.version = Version;
+    header.recordSize = sizeof(Record);
+    header.count = m_count;
+
+    if (!writeFile(m_fileName, &header, sizeof(header), m_data, m_count * sizeof(Record)))
+    {
+        qDebug() << "Cannot save the layout store" << m_fileName;
+        return false;
+    }
+    return true;
+}
+
+bool RandRLayoutStore::writeFile(const QString &fileName, const void *header, qint64 headerSize,
+                                 const void *data, qint64 size)
+{
+    RandRTrace::Span span("write file");
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+
+    // readers either see the old file or the new one, never a part of it
+    QString temporary = fileName + ".new";
+    QFile file(temporary);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        qDebug() << "Cannot write" << temporary;
+        return false;
+    }
+
+    bool succeed = file.write((const char*) header, headerSize) == headerSize &&
+                   file.write((const char*) data, size) == size &&
+                   file.flush() && fsync(file.handle()) == 0;
+    file.close();
+
+    if (!succeed || ::rename(QFile::encodeName(temporary).constData(),
+                             QFile::encodeName(fileName).constData()) != 0)
+    {
+        QFile::remove(temporary);
+        return false;
+    }
+    return true;
+}
+
+static QRect rectValue(QSettings &config, const QString &key)
+{
+    QVariant value = config.value(key, QRect());
+    if (value == QVariant("0,0,0,0"))
+        return QRect();
+    return value.toRect();
+}
+
+void RandRLayoutStore::import()
+{
+    QSettings config;
+    if (!QFile::exists(config.fileName()))
+        return;
+
+    qDebug() << "Importing the layouts saved in" << config.fileName();
+    importGroups(config, 0);
+}
+
+void RandRLayoutStore::importGroups(QSettings &config, quint64 layout)
+{
+    foreach(const QString &group, config.childGroups())
+    {
+        // Layout_<name> holds the same groups as the top level
+        if (group.startsWith("Layout_"))
+        {
+            if (layout == 0)
+            {
+                config.beginGroup(group);
+                importGroups(config, layoutId(group.mid(7)));
+                config.endGroup();
+            }
+            continue;
+        }
+
+        // Screen_<n>, Screen_<n>_Output_<name> or Screen_<n>_Monitor_<fingerprint>
+        if (!group.startsWith("Screen_"))
+            continue;
+
+        QString name = group.mid(7);
+        int separator = name.indexOf('_');
+        bool ok;
+        int screen = name.left(separator).toInt(&ok);
+        if (!ok)
+            continue;
+
+        Record r;
+        config.beginGroup(group);
+        if (separator < 0)
+        {
+            r = record(ScreenRecord, layout, screen, QString());
+            r.setFlag(OutputsUnified, config.value("OutputsUnified", false).toBool());
+            r.setRect(rectValue(config, "UnifiedRect"));
+            r.rotation = config.value("UnifiedRotation", RR_Rotate_0).toInt();
+        }
+        else
+        {
+            QString output = name.mid(separator + 1);
+            if (output.startsWith("Output_"))
+                r = record(OutputRecord, layout, screen, output.mid(7));
+            else if (output.startsWith("Monitor_"))
+                r = record(MonitorRecord, layout, screen, output.mid(8));
+            else
+            {
+                config.endGroup();
+                continue;
+            }
+
+            r.setFlag(Active, config.value("Active", true).toBool());
+            r.setFlag(Tracking, config.value("Tracking", false).toBool());
+            r.setFlag(VirtualModeEnabled, config.value("VirtualModeEnabled", false).toBool());
+            r.setRect(rectValue(config, "Rect"));
+            r.setVirtualRect(config.value("VirtualRect", QRect()).toRect());
+            r.rotation = config.value("Rotation", RR_Rotate_0).toInt();
+            r.rate = config.value("RefreshRate", 0).toFloat();
+            r.brightness = config.value("Brightness", 0).toFloat();
+        }
+        config.endGroup();
+
+        insert(r);
+    }
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef RANDRLAYOUTSTORE_H
+#define RANDRLAYOUTSTORE_H
+
+#include <QtCore/QFile>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+class QSettings;
+
+/** The saved settings of every screen and output, in a binary file.
+ *
+ * The file is a header followed by an array of fixed size records, sorted
+ * by layout, screen, type and key. It is memory-mapped, so looking a record
+ * up is a binary search over the mapping that allocates nothing. Changes
+ * are made on a copy of the records and written back atomically by save().
+ * The file is meant to be read on the machine that wrote it, the values
+ * are stored in native byte order.
+ *
+ * When there is no file yet, the settings saved by earlier versions in the
+ * INI file are imported. */
+class RandRLayoutStore
+{
+public:
+    enum RecordType
+    {
+        ScreenRecord = 1,
+        /** An output known by its connector name */
+        OutputRecord = 2,
+        /** An output known by the EDID fingerprint of its monitor */
+        MonitorRecord = 3
+    };
+
+    enum Flag
+    {
+        Active = 0x1,
+        Tracking = 0x2,
+        VirtualModeEnabled = 0x4,
+        OutputsUnified = 0x8,
+        /** The output was the primary one */
+        Primary = 0x10,
+        /** The screen record knows which output was the primary one */
+        PrimarySaved = 0x20
+    };
+
+    static const quint32 Magic = 0x4c52584c; // "LXRL"
+    /** Version 1 had no colours, its records are converted when read */
+    static const quint32 Version = 2;
+    static const int KeySize = 32;
+
+    /** One screen or output. Its layout is the file format. */
+    struct Record
+    {
+        quint32 type;
+        quint32 flags;
+        /** See layoutId(), 0 for the settings that are not in a layout */
+        quint64 layout;
+        qint32 screen;
+        qint32 rotation;
+        /** The unified rect of a screen, the rect of an output */
+        qint32 geometry[4];
+        qint32 virtualGeometry[4];
+        float rate;
+        float brightness;
+        /** Output name or fingerprint, nul terminated */
+        char key[KeySize];
+        /** The colour balance of the output, 0 if it was not saved */
+        float red;
+        float green;
+        float blue;
+        quint32 reserved;
+
+        bool hasFlag(Flag flag) const;
+        void setFlag(Flag flag, bool on);
+        QRect rect() const;
+        void setRect(const QRect &rect);
+        QRect virtualRect() const;
+        void setVirtualRect(const QRect &rect);
+    };
+
+    RandRLayoutStore();
+    ~RandRLayoutStore();
+
+    /** The store next to the settings of the application. */
+    static QString defaultFileName();
+    /** A file named after the application in its settings directory. */
+    static QString configFileName(const QString &extension);
+
+    /** Write @p header then @p size bytes of @p data to a temporary file and
+     * move it over @p fileName, so that readers never see a partial file. */
+    static bool writeFile(const QString &fileName, const void *header, qint64 headerSize,
+                          const void *data, qint64 size);
+
+    /** Map the store, importing the INI settings if it does not exist yet. */
+    bool open(const QString &fileName = defaultFileName());
+    void close();
+
+    bool isEmpty() const;
+    int count() const;
+
+    /** Whether anything was saved for @p layout, see RandRScreen::layoutName(). */
+    bool hasLayout(const QString &layout) const;
+
+    /** The record with the given identity, or 0 if there is none. The
+     * pointer is valid until the store is changed or closed. */
+    const Record *find(RecordType type, const QString &layout, int screen,
+                       const QString &key = QString()) const;
+
+    /** An empty record with the given identity. */
+    static Record record(RecordType type, const QString &layout, int screen,
+                         const QString &key = QString());
+
+    /** Add @p record, replacing the one with the same identity. */
+    void insert(const Record &record);
+
+    /** Write the records to a temporary file and move it over the store. */
+    bool save();
+
+    /** A 64 bit FNV-1a hash of @p layout, 0 for the empty name. */
+    static quint64 layoutId(const QString &layout);
+
+private:
+    static Record record(RecordType type, quint64 layout, int screen, const QString &key);
+    static bool lessThan(const Record &a, const Record &b);
+    const Record *lowerBound(const Record &record) const;
+    /** Copy the mapped records, so that they can be changed. */
+    void detach();
+    bool map();
+    void import();
+    void importGroups(QSettings &config, quint64 layout);
+
+    struct Header
+    {
+        quint32 magic;
+        quint32 version;
+        quint32 recordSize;
+        quint32 count;
+    };
+
+    QString m_fileName;
+    QFile m_file;
+    uchar *m_map;
+    const Record *m_data;
+    int m_count;
+    /** The records once they were changed */
+    QVector<Record> m_records;
+    bool m_detached;
+};
+
+#endif // RANDRLAYOUTSTORE_H
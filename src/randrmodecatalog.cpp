@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "randrmodecatalog.h"
+#include "randrmode.h"
+
+// returned for sizes the output does not support
+static const RateList noRates;
+static const ModeList noModes;
+
+RandRModeCatalog::RandRModeCatalog()
+{
+}
+
+quint64 RandRModeCatalog::sizeKey(const QSize &size)
+{
+    return ((quint64)(quint32)size.width() << 32) | (quint32)size.height();
+}
+
+void RandRModeCatalog::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_sizes.clear();
+    m_modes.clear();
+}
+
+void RandRModeCatalog::build(const ModeList &modes, const ModeMap &modeMap)
+{
+    clear();
+
+    foreach(RRMode m, modes)
+    {
+        ModeMap::const_iterator it = modeMap.constFind(m);
+        if (it == modeMap.constEnd() || !it.value().isValid())
+            continue;
+
+        const RandRMode &mode = it.value();
+        quint64 key = sizeKey(mode.size());
+        QHash<quint64, int>::const_iterator index = m_index.constFind(key);
+        int i;
+        if (index == m_index.constEnd())
+        {
+            i = m_entries.count();
+            m_index.insert(key, i);
+            m_entries.append(SizeEntry());
+            m_entries[i].size = mode.size();
+            m_sizes.append(mode.size());
+        }
+        else
+            i = index.value();
+
+        SizeEntry &entry = m_entries[i];
+        entry.modes.append(m);
+        m_modes.insert(m);
+
+        // keep the rates sorted, the first mode listed for a rate wins
+        float rate = mode.refreshRate();
+        int pos = 0;
+        while (pos < entry.rates.count() && entry.rates.at(pos) > rate)
+            ++pos;
+        if (pos < entry.rates.count() && entry.rates.at(pos) == rate)
+            continue;
+        entry.rates.insert(pos, rate);
+        entry.rateModes.insert(pos, m);
+    }
+}
+
+const RandRModeCatalog::SizeEntry *RandRModeCatalog::entry(const QSize &size) const
+{
+    QHash<quint64, int>::const_iterator it = m_index.constFind(sizeKey(size));
+    if (it == m_index.constEnd())
+        return 0;
+    return &m_entries.at(it.value());
+}
+
+const SizeList &RandRModeCatalog::sizes() const
+{
+    return m_sizes;
+}
+
+bool RandRModeCatalog::hasSize(const QSize &size) const
+{
+    return m_index.contains(sizeKey(size));
+}
+
+const RateList &RandRModeCatalog::rates(const QSize &size) const
+{
+    const SizeEntry *e = entry(size);
+    return e ? e->rates : noRates;
+}
+
+const ModeList &RandRModeCatalog::modes(const QSize &size) const
+{
+    const SizeEntry *e = entry(size);
+    return e ? e->modes : noModes;
+}
+
+RRMode RandRModeCatalog::mode(const QSize &size, float rate) const
+{
+    const SizeEntry *e = entry(size);
+    if (!e)
+        return None;
+
+    int i = e->rates.indexOf(rate);
+    return i == -1 ? None : e->rateModes.at(i);
+}
+
+float RandRModeCatalog::defaultRate(const QSize &size) const
+{
+    const SizeEntry *e = entry(size);
+    if (!e)
+        return 0;
+
+    // rates and rateModes are in the same order
+    return e->rates.at(e->rateModes.indexOf(e->modes.first()));
+}
+
+bool RandRModeCatalog::contains(RRMode mode) const
+{
+    return m_modes.contains(mode);
+}
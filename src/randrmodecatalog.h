@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRMODECATALOG_H
+#define RANDRMODECATALOG_H
+
+#include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+
+#include "randr.h"
+
+/** Index of the modes supported by an output.
+ *
+ * Built once per probe from the output's mode list, it answers which sizes
+ * are available, which refresh rates a size has and which mode matches a
+ * size and rate without going through every mode of the output again. */
+class RandRModeCatalog
+{
+public:
+    RandRModeCatalog();
+
+    /** Index @p modes, looking up their size and rate in @p modeMap. Modes
+     * that are not in @p modeMap are ignored. */
+    void build(const ModeList &modes, const ModeMap &modeMap);
+    void clear();
+
+    /** The supported sizes, in the order the server listed them. */
+    const SizeList &sizes() const;
+    bool hasSize(const QSize &size) const;
+
+    /** The refresh rates for @p size, highest first, without duplicates. */
+    const RateList &rates(const QSize &size) const;
+
+    /** All modes of @p size, in the order the server listed them. The first
+     * one is used when no particular refresh rate is asked for. */
+    const ModeList &modes(const QSize &size) const;
+
+    /** The mode with the given size and refresh rate, or None. */
+    RRMode mode(const QSize &size, float rate) const;
+
+    /** The rate of the first mode of @p size, 0 if there is none. */
+    float defaultRate(const QSize &size) const;
+
+    bool contains(RRMode mode) const;
+
+    /** A hash key for @p size */
+    static quint64 sizeKey(const QSize &size);
+
+private:
+    struct SizeEntry
+    {
+        QSize size;
+        ModeList modes;
+        RateList rates;
+        /** The mode for each entry of rates */
+        ModeList rateModes;
+    };
+
+    const SizeEntry *entry(const QSize &size) const;
+
+    QVector<SizeEntry> m_entries;
+    QHash<quint64, int> m_index;
+    SizeList m_sizes;
+    QSet<RRMode> m_modes;
+};
+
+#endif // RANDRMODECATALOG_H
@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "randrmodematrix.h"
+#include "randrmodecatalog.h"
+#include "randrmode.h"
+
+RandRModeMatrix::RandRModeMatrix()
+    : m_generation(0)
+{
+}
+
+int RandRModeMatrix::generation() const
+{
+    return m_generation;
+}
+
+int RandRModeMatrix::modeBit(RRMode mode)
+{
+    QHash<RRMode, int>::const_iterator it = m_modeIndex.constFind(mode);
+    if (it != m_modeIndex.constEnd())
+        return it.value();
+
+    int bit = m_modeIndex.count();
+    m_modeIndex.insert(mode, bit);
+    m_modeSizes.append(-1);
+    return bit;
+}
+
+int RandRModeMatrix::sizeBit(const QSize &size)
+{
+    quint64 key = RandRModeCatalog::sizeKey(size);
+    QHash<quint64, int>::const_iterator it = m_sizeIndex.constFind(key);
+    if (it != m_sizeIndex.constEnd())
+        return it.value();
+
+    int bit = m_sizeIndex.count();
+    m_sizeIndex.insert(key, bit);
+    m_sizes.append(size);
+    return bit;
+}
+
+void RandRModeMatrix::setOutputModes(RROutput output, const ModeList &modes, const ModeMap &modeMap)
+{
+    Row row;
+    foreach(RRMode m, modes)
+    {
+        ModeMap::const_iterator it = modeMap.constFind(m);
+        if (it == modeMap.constEnd() || !it.value().isValid())
+            continue;
+
+        int bit = modeBit(m);
+        int size = m_modeSizes[bit];
+        if (size == -1)
+            size = m_modeSizes[bit] = sizeBit(it.value().size());
+
+        if (row.modeBits.size() <= bit)
+            row.modeBits.resize(m_modeIndex.count());
+        if (row.sizeBits.size() <= size)
+            row.sizeBits.resize(m_sizeIndex.count());
+
+        row.modes.append(m);
+        row.modeBits.setBit(bit);
+        if (!row.sizeBits.testBit(size))
+        {
+            row.sizeBits.setBit(size);
+            row.sizes.append(it.value().size());
+        }
+    }
+
+    m_rows[output] = row;
+    m_generation++;
+}
+
+void RandRModeMatrix::removeOutput(RROutput output)
+{
+    if (m_rows.remove(output))
+        m_generation++;
+}
+
+void RandRModeMatrix::clear()
+{
+    m_modeIndex.clear();
+    m_sizeIndex.clear();
+    m_modeSizes.clear();
+    m_sizes.clear();
+    m_rows.clear();
+    m_generation++;
+}
+
+QBitArray RandRModeMatrix::sharedBits(const OutputList &outputs, bool sizes) const
+{
+    QBitArray bits;
+    bool first = true;
+    foreach(RROutput o, outputs)
+    {
+        QMap<RROutput, Row>::const_iterator it = m_rows.constFind(o);
+        if (it == m_rows.constEnd())
+            return QBitArray();
+
+        const QBitArray &rowBits = sizes ? it.value().sizeBits : it.value().modeBits;
+        if (first)
+        {
+            bits = rowBits;
+            first = false;
+        }
+        else
+            // missing bits of the shorter array count as cleared
+            bits &= rowBits;
+    }
+    return bits;
+}
+
+ModeList RandRModeMatrix::sharedModes(const OutputList &outputs) const
+{
+    ModeList modes;
+    QBitArray bits = sharedBits(outputs, false);
+    if (bits.isEmpty())
+        return modes;
+
+    foreach(RRMode m, m_rows[outputs.first()].modes)
+        if (bits.testBit(m_modeIndex.value(m)))
+            modes.append(m);
+    return modes;
+}
+
+SizeList RandRModeMatrix::sharedSizes(const OutputList &outputs) const
+{
+    SizeList sizes;
+    QBitArray bits = sharedBits(outputs, true);
+    if (bits.isEmpty())
+        return sizes;
+
+    foreach(const QSize &size, m_rows[outputs.first()].sizes)
+        if (bits.testBit(m_sizeIndex.value(RandRModeCatalog::sizeKey(size))))
+            sizes.append(size);
+    return sizes;
+}
+
+SizeList RandRModeMatrix::cloneSizes(const OutputList &outputs) const
+{
+    SizeList sizes;
+    QBitArray bits = sharedBits(outputs, false);
+    if (bits.isEmpty())
+        return sizes;
+
+    QBitArray seen(m_sizes.count());
+    foreach(RRMode m, m_rows[outputs.first()].modes)
+    {
+        int bit = m_modeIndex.value(m);
+        if (!bits.testBit(bit))
+            continue;
+
+        int size = m_modeSizes.at(bit);
+        if (seen.testBit(size))
+            continue;
+        seen.setBit(size);
+        sizes.append(m_sizes.at(size));
+    }
+    return sizes;
+}
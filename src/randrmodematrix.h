@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRMODEMATRIX_H
+#define RANDRMODEMATRIX_H
+
+#include <QtCore/QBitArray>
+#include <QtCore/QHash>
+#include <QtCore/QMap>
+#include <QtCore/QSize>
+#include <QtCore/QVector>
+
+#include "randr.h"
+
+/** Which modes and sizes each output of a screen supports.
+ *
+ * Every mode and size known to the screen gets a fixed bit, and every
+ * output a bitset of the modes and sizes it lists. What a set of outputs
+ * has in common is then the AND of their bitsets. Bits are never reused,
+ * so an output whose mode list changed is updated without touching the
+ * others. */
+class RandRModeMatrix
+{
+public:
+    RandRModeMatrix();
+
+    /** Set the modes of @p output, looking up their size in @p modeMap. */
+    void setOutputModes(RROutput output, const ModeList &modes, const ModeMap &modeMap);
+    void removeOutput(RROutput output);
+    void clear();
+
+    /** Changes whenever the modes of any output change. */
+    int generation() const;
+
+    /** The modes supported by all of @p outputs, in the order the first
+     * one lists them. */
+    ModeList sharedModes(const OutputList &outputs) const;
+
+    /** The sizes all of @p outputs can show with some mode of their own,
+     * in the order the first one lists them. */
+    SizeList sharedSizes(const OutputList &outputs) const;
+
+    /** The sizes of the modes all of @p outputs share, i.e. the sizes at
+     * which they can be driven by a single CRTC. */
+    SizeList cloneSizes(const OutputList &outputs) const;
+
+private:
+    struct Row
+    {
+        ModeList modes;
+        SizeList sizes;
+        QBitArray modeBits;
+        QBitArray sizeBits;
+    };
+
+    int modeBit(RRMode mode);
+    int sizeBit(const QSize &size);
+    /** The AND of the mode (or size) bits of @p outputs, empty if any of
+     * them is unknown. */
+    QBitArray sharedBits(const OutputList &outputs, bool sizes) const;
+
+    QHash<RRMode, int> m_modeIndex;
+    QHash<quint64, int> m_sizeIndex;
+    /** The size bit of every mode bit */
+    QVector<int> m_modeSizes;
+    /** The size of every size bit */
+    SizeList m_sizes;
+    QMap<RROutput, Row> m_rows;
+    int m_generation;
+};
+
+#endif // RANDRMODEMATRIX_H
@@ -18,16 +18,19 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <QtCore/QSettings>
-#include <QtGui/QX11Info>
 #include <QtGui/QAction>
 
 #include "randroutput.h"
 #include "randrscreen.h"
 #include "randrcrtc.h"
 #include "randrmode.h"
+#include "randrprobe.h"
+#include "randrtransaction.h"
+#include "randrbackend.h"
+#include "randredid.h"
+#include "randrlayoutstore.h"
 
-RandROutput::RandROutput(RandRScreen *parent, RROutput id)
+RandROutput::RandROutput(RandRScreen *parent, RROutput id, const RandROutputInfo *info)
 : QObject(parent)
 {
     m_screen = parent;
@@ -36,8 +39,12 @@ RandROutput::RandROutput(RandRScreen *parent, RROutput id)
     m_id = id;
     m_crtc = 0;
     m_rotations = 0;
+    m_fingerprintValid = false;
 
-    queryOutputInfo();
+    if (info)
+        queryOutputInfo(*info);
+    else
+        queryOutputInfo();
 
     m_proposedRotation = m_originalRotation;
     m_proposedRate = m_originalRate;
@@ -64,39 +71,52 @@ RandRScreen *RandROutput::screen() const
 
 void RandROutput::queryOutputInfo(void)
 {
-    XRROutputInfo *info = XRRGetOutputInfo(QX11Info::display(), m_screen->resources(), m_id);
+    RandRProbe probe(m_screen->resources(), m_screen->backend());
+    probe.addOutput(m_id);
+    probe.run();
+
+    const RandROutputInfo *info = probe.output(m_id);
     Q_ASSERT(info);
+    if (info)
+        queryOutputInfo(*info);
+}
 
-    if (RandR::timestamp != info->timestamp)
-        RandR::timestamp = info->timestamp;
+void RandROutput::queryOutputInfo(const RandROutputInfo &info)
+{
+    if (m_screen->timestamp() != info.timestamp)
+        m_screen->setTimestamp(info.timestamp);
 
     // Set up the output's connection status, name, and current
     // CRT controller.
-    m_connected = (info->connection == RR_Connected);
-    m_name = info->name;
+    m_connected = (info.connection == RR_Connected);
+    m_name = info.name;
+    updateFingerprint();
 
     qDebug() << "XID" << m_id << "is output" << m_name <<
                 (isConnected() ? "(connected)" : "(disconnected)");
 
-    setCrtc(m_screen->crtc(info->crtc));
+    setCrtc(m_screen->crtc(info.crtc), false);
     qDebug() << "Possible CRTCs for output" << m_name << ":";
 
-    if (!info->ncrtc) {
+    if (info.crtcs.isEmpty()) {
         qDebug() << "   - none";
     }
-    for(int i = 0; i < info->ncrtc; ++i) {
-        qDebug() << "   - CRTC" << info->crtcs[i];
-        m_possibleCrtcs.append(info->crtcs[i]);
+    foreach(RRCrtc c, info.crtcs) {
+        qDebug() << "   - CRTC" << c;
     }
+    m_possibleCrtcs = info.crtcs;
+    m_clones = info.clones;
 
     //TODO: is it worth notifying changes on mode list changing?
-    m_modes.clear();
+    if (info.modes != m_modes || m_catalog.sizes().isEmpty())
+    {
+        m_modes = info.modes;
+        m_catalog.build(m_modes, m_screen->modes());
+        m_screen->setOutputModes(m_id, m_modes);
+    }
 
-    for (int i = 0; i < info->nmode; ++i) {
-        if (i < info->npreferred) {
-            m_preferredMode = m_screen->mode(info->modes[i]);
-        }
-        m_modes.append(info->modes[i]);
+    for (int i = 0; i < info.npreferred && i < m_modes.count(); ++i) {
+        m_preferredMode = m_screen->mode(m_modes.at(i));
     }
 
     //get all possible rotations
@@ -121,8 +141,6 @@ void RandROutput::queryOutputInfo(void)
         qDebug() << "   - Rect:" << m_originalRect;
         qDebug() << "   - Rotation:" << m_originalRotation;
     }
-
-    XRRFreeOutputInfo(info);
 }
 
 void RandROutput::loadSettings(bool notify)
@@ -139,8 +157,8 @@ void RandROutput::loadSettings(bool notify)
     XRROutputInfo *info = XRRGetOutputInfo(QX11Info::display(), m_screen->resources(), m_id);
     Q_ASSERT(info);
 
-    if (RandR::timestamp != info->timestamp)
-        RandR::timestamp = info->timestamp;
+    if (m_screen->timestamp() != info->timestamp)
+        m_screen->setTimestamp(info->timestamp);
 
     m_possibleCrtcs.clear();
     for (int i = 0; i < info->ncrtc; ++i)
@@ -169,68 +187,69 @@ void RandROutput::loadSettings(bool notify)
     */
 }
 
-void RandROutput::handleEvent(XRROutputChangeNotifyEvent *event)
+void RandROutput::loadSettings(const RandROutputInfo &info, bool notify)
 {
-    int changed = 0;
-
-    qDebug() << "[OUTPUT] Got event for " << m_name;
-    qDebug() << "       crtc: " << event->crtc;
-    qDebug() << "       mode: " << event->mode;
-    qDebug() << "       rotation: " << event->rotation;
-    qDebug() << "       connection: " << event->connection;
+    bool connected = m_connected;
+    RRCrtc crtc = m_crtc ? m_crtc->id() : None;
+    QRect rect = m_originalRect;
+    int rotation = m_originalRotation;
+    float rate = m_originalRate;
+    ModeList modes = m_modes;
 
-    //FIXME: handling these events incorrectly, causing an X11 I/O error...
-    // Disable for now.
-// 	kWarning() << "FIXME: Output event ignored!";
-// 	return;
+    queryOutputInfo(info);
 
-    RRCrtc currentCrtc = m_crtc->id();
-    if (event->crtc != currentCrtc)
-    {
-        changed |= RandR::ChangeCrtc;
-        // update crtc settings
-        if (currentCrtc != None)
-            m_crtc->loadSettings(true);
-            //m_screen->crtc(m_currentCrtc)->loadSettings(true);
-        setCrtc(m_screen->crtc(event->crtc), false);
-        if (currentCrtc != None)
-            m_crtc->loadSettings(true);
-    }
-
-    if (event->mode != mode().id())
-        changed |= RandR::ChangeMode;
+    int changes = 0;
+    if (connected != m_connected)
+        changes |= RandR::ChangeConnection;
+    if (crtc != m_crtc->id())
+        changes |= RandR::ChangeCrtc;
+    if (rect != m_originalRect)
+        changes |= RandR::ChangeRect;
+    if (rotation != m_originalRotation)
+        changes |= RandR::ChangeRotation;
+    if (rate != m_originalRate)
+        changes |= RandR::ChangeRate;
+    if (modes != m_modes)
+        changes |= RandR::ChangeMode;
 
-    if (event->rotation != rotation())
-        changed |= RandR::ChangeRotation;
+    if (changes && notify)
+        emit outputChanged(m_id, changes);
+}
 
-    if((event->connection == RR_Connected) != m_connected)
+void RandROutput::updateFingerprint()
+{
+    if (!m_connected)
     {
-        changed |= RandR::ChangeConnection;
-        m_connected = (event->connection == RR_Connected);
-        loadSettings(false);
-        if (!m_connected && currentCrtc != None)
-            setCrtc(None);
+        // the next monitor plugged in may be a different one
+        m_fingerprint.clear();
+        m_fingerprintValid = false;
+        return;
     }
 
-    // check if we are still connected, if not, release the crtc connection
-    if(!m_connected && m_crtc->isValid())
-        setCrtc(None);
+    if (m_fingerprintValid)
+        return;
 
-    if(changed)
-        emit outputChanged(m_id, changed);
+    m_fingerprint = RandREdid::fingerprint(m_screen->backend()->edid(m_id));
+    m_fingerprintValid = true;
+    qDebug() << "Output" << m_name << "has EDID fingerprint" << m_fingerprint;
 }
 
 void RandROutput::handlePropertyEvent(XRROutputPropertyNotifyEvent *event)
 {
+    if (m_screen->backend()->isEdidProperty(event->property))
+    {
+        m_fingerprintValid = false;
+        updateFingerprint();
+        return;
+    }
+
     // TODO: Do something with this!
     // By perusing thru some XOrg drivers, some of the properties that can
     // are configured through XRANDR are:
     // - LVDS Backlights
     // - TV output formats
 
-    char *name = XGetAtomName(QX11Info::display(), event->property);
-    qDebug() << "Got XRROutputPropertyNotifyEvent for property Atom " << name;
-    XFree(name);
+    qDebug() << "Got XRROutputPropertyNotifyEvent for property Atom " << event->property;
 }
 
 QString RandROutput::name() const
@@ -238,6 +257,16 @@ QString RandROutput::name() const
     return m_name;
 }
 
+QString RandROutput::fingerprint() const
+{
+    return m_fingerprint;
+}
+
+QString RandROutput::settingsKey() const
+{
+    return m_fingerprint.isEmpty() ? m_name : m_fingerprint;
+}
+
 QString RandROutput::icon() const
 {
     // http://www.thinkwiki.org/wiki/Xorg_RandR_1.2#Output_port_names has a
@@ -261,16 +290,26 @@ CrtcList RandROutput::possibleCrtcs() const
     return m_possibleCrtcs;
 }
 
+OutputList RandROutput::clones() const
+{
+    return m_clones;
+}
+
 RandRCrtc *RandROutput::crtc() const
 {
     return m_crtc;
 }
 
-ModeList RandROutput::modes() const
+const ModeList &RandROutput::modes() const
 {
     return m_modes;
 }
 
+const RandRModeCatalog &RandROutput::modeCatalog() const
+{
+    return m_catalog;
+}
+
 RandRMode RandROutput::mode() const
 {
     if (!isConnected())
@@ -287,19 +326,9 @@ RandRMode RandROutput::preferredMode(void) const
     return m_preferredMode;
 }
 
-SizeList RandROutput::sizes() const
+const SizeList &RandROutput::sizes() const
 {
-    SizeList sizeList;
-
-    foreach(RRMode m, m_modes)
-    {
-        RandRMode mode = m_screen->mode(m);
-        if (!mode.isValid())
-            continue;
-        if (sizeList.indexOf(mode.size()) == -1)
-            sizeList.append(mode.size());
-    }
-    return sizeList;
+    return m_catalog.sizes();
 }
 
 QRect RandROutput::rect() const
@@ -312,20 +341,11 @@ QRect RandROutput::rect() const
 
 RateList RandROutput::refreshRates(const QSize &s) const
 {
-    RateList list;
     QSize size = s;
     if (!size.isValid())
         size = rect().size();
 
-    foreach(RRMode m, m_modes)
-    {
-        RandRMode mode = m_screen->mode(m);
-        if (!mode.isValid())
-            continue;
-        if (mode.size() == size)
-            list.append(mode.refreshRate());
-    }
-    return list;
+    return m_catalog.rates(size);
 }
 
 float RandROutput::refreshRate() const
@@ -394,15 +414,35 @@ void RandROutput::proposeOriginal()
         m_crtc->proposeOriginal();
 }
 
-void RandROutput::load(QSettings &config)
+const RandRLayoutStore::Record *RandROutput::findSettings(const RandRLayoutStore &store,
+                                                          const QString &layout) const
+{
+    // settings saved for the monitor win over the ones of the connector,
+    // which are also the ones saved before fingerprints were used
+    const RandRLayoutStore::Record *record = 0;
+    if (!m_fingerprint.isEmpty())
+        record = store.find(RandRLayoutStore::MonitorRecord, layout, m_screen->index(), m_fingerprint);
+    if (!record)
+        record = store.find(RandRLayoutStore::OutputRecord, layout, m_screen->index(), m_name);
+    return record;
+}
+
+void RandROutput::load(const RandRLayoutStore &store, const QString &layout)
 {
     if (!m_connected)
         return;
 
-    config.beginGroup("Screen_" + QString::number(m_screen->index()) +
-                                   "_Output_" + m_name);
+    RandRLayoutStore::Record defaults = RandRLayoutStore::record(RandRLayoutStore::OutputRecord,
+                                                                 layout, m_screen->index(), m_name);
+    defaults.setFlag(RandRLayoutStore::Active, true);
+
+    const RandRLayoutStore::Record *settings = findSettings(store, layout);
+    if (!settings)
+        settings = &defaults;
 
-    bool active = config.value("Active", true).toBool();
+    bool active = settings->hasFlag(RandRLayoutStore::Active);
+    if (settings->hasFlag(RandRLayoutStore::Primary))
+        m_screen->proposePrimaryOutput(this);
 
     if (!active && !m_screen->outputsUnified())
     {
@@ -410,12 +450,12 @@ void RandROutput::load(QSettings &config)
         return;
     }
 
-    // use the current crtc if any, or try to find an empty one
+    // use the current crtc if any, or let the screen find one
     if (!m_crtc->isValid() && m_originalRect.isValid()) {
-        qDebug() << "Finding empty CRTC for" << m_name;
+        qDebug() << "Finding a CRTC for" << m_name;
         qDebug() << "  with rect = " << m_originalRect;
 
-        m_crtc = findEmptyCrtc();
+        m_screen->assignCrtcs(this);
     }
     // if there is no crtc we can use, stop processing
     if (!m_crtc->isValid())
@@ -426,34 +466,41 @@ void RandROutput::load(QSettings &config)
     // if the outputs are unified, the screen will handle size changing
     if (!m_screen->outputsUnified() || m_screen->connectedCount() <= 1)
     {
-        m_proposedRect = (config.value("Rect", "0,0,0,0") == "0,0,0,0")
-            ? QRect() // "0,0,0,0" (serialization for QRect()) does not convert to a QRect
-            : config.value("Rect", QRect()).toRect();
-        m_proposedRotation = config.value("Rotation", (int) RandR::Rotate0).toInt();
+        m_proposedRect = settings->rect();
+        m_proposedRotation = settings->rotation;
+    }
+    m_proposedRate = settings->rate;
+    m_proposedBrightness = settings->brightness;
+    // stores written before the colours were saved have none
+    if (settings->red > 0 && settings->green > 0 && settings->blue > 0)
+    {
+        m_crtc->red = settings->red;
+        m_crtc->green = settings->green;
+        m_crtc->blue = settings->blue;
     }
-    m_proposedRate = config.value("RefreshRate", 0).toFloat();
-    m_proposedBrightness = config.value("Brightness", 0).toFloat();
-    m_proposedTracking = config.value("Tracking", false).toBool();
-    m_proposedVirtualRect = config.value("VirtualRect", QRect()).toRect();
-    m_proposedVirtualModeEnabled = config.value("VirtualModeEnabled", false).toBool();
-    config.endGroup();
+    m_proposedTracking = settings->hasFlag(RandRLayoutStore::Tracking);
+    m_proposedVirtualRect = settings->virtualRect();
+    m_proposedVirtualModeEnabled = settings->hasFlag(RandRLayoutStore::VirtualModeEnabled);
 }
 
-void RandROutput::save(QSettings &config)
+void RandROutput::save(RandRLayoutStore &store, const QString &layout, bool primary)
 {
-    config.beginGroup("Screen_" + QString::number(m_screen->index()) +
-                                   "_Output_" + m_name);
     if (!m_connected)
-    {
-        config.endGroup();
         return;
-    }
 
-    config.setValue("Active", isActive());
+    // keep what is not saved below, like the rect of unified outputs
+    RandRLayoutStore::RecordType type = m_fingerprint.isEmpty()
+        ? RandRLayoutStore::OutputRecord : RandRLayoutStore::MonitorRecord;
+    const RandRLayoutStore::Record *saved = store.find(type, layout, m_screen->index(), settingsKey());
+    RandRLayoutStore::Record settings = saved ? *saved
+        : RandRLayoutStore::record(type, layout, m_screen->index(), settingsKey());
+
+    settings.setFlag(RandRLayoutStore::Active, isActive());
+    settings.setFlag(RandRLayoutStore::Primary, primary && isActive());
 
     if (!isActive())
     {
-        config.endGroup();
+        store.insert(settings);
         return;
     }
 
@@ -462,47 +509,28 @@ void RandROutput::save(QSettings &config)
     // when the outputs are not unified.
     if (!m_screen->outputsUnified() || m_screen->connectedCount() <=1)
     {
-        config.setValue("Rect", m_crtc->rect());
-        config.setValue("Rotation", m_crtc->rotation());
+        settings.setRect(m_crtc->rect());
+        settings.rotation = m_crtc->rotation();
     }
-    config.setValue("RefreshRate", (double)m_crtc->refreshRate());
-    config.setValue("Brightness", (double)m_crtc->brightness());
-    config.setValue("Tracking", m_crtc->tracking());
-    config.setValue("VirtualRect", m_crtc->virtualRect());
-    config.setValue("VirtualModeEnabled", m_crtc->virtualModeEnabled());
-    config.endGroup();
+    settings.rate = m_crtc->refreshRate();
+    settings.brightness = m_crtc->brightness();
+    settings.red = m_crtc->red;
+    settings.green = m_crtc->green;
+    settings.blue = m_crtc->blue;
+    settings.setFlag(RandRLayoutStore::Tracking, m_crtc->tracking());
+    settings.setVirtualRect(m_crtc->virtualRect());
+    settings.setFlag(RandRLayoutStore::VirtualModeEnabled, m_crtc->virtualModeEnabled());
+    store.insert(settings);
 }
 
-QStringList RandROutput::startupCommands() const
+QRect RandROutput::proposedRect() const
 {
-    if (!m_connected)
-        return QStringList();
-    if (!isActive())
-        return QStringList() << QString( "xrandr --output %1 --off" ).arg(m_name);
-    if (m_crtc->id() == None)
-         return QStringList();
-    QString command = QString( "xrandr --output %1" ).arg(m_name);
-    // if the outputs are unified, do not save size and rotation
-    // this allow us to set back the size and rotation being used
-    // when the outputs are not unified.
-    if (!m_screen->outputsUnified() || m_screen->connectedCount() <=1)
-    {
-        command += QString( " --pos %1x%2 --mode %3x%4" ).arg( m_crtc->rect().x())
-            .arg( m_crtc->rect().y()).arg( m_crtc->rect().width()).arg( m_crtc->rect().height());
-        switch( m_crtc->rotation()) {
-            case RandR::Rotate90:
-                command += " --rotate left";
-                break;
-            case RandR::Rotate180:
-                command += " --rotate inverted";
-                break;
-            case RandR::Rotate270:
-                command += " --rotate right";
-                break;
-        }
-    }
-    command += QString(" --refresh %1").arg( m_crtc->refreshRate());
-    return QStringList() << command;
+    return m_proposedRect;
+}
+
+int RandROutput::proposedRotation() const
+{
+    return m_proposedRotation;
 }
 
 void RandROutput::proposeRefreshRate(float rate)
@@ -609,16 +637,22 @@ void RandROutput::slotDisable()
     setCrtc(m_screen->crtc(None));
 }
 
+void RandROutput::proposeDisable()
+{
+    m_originalRect = rect();
+    m_proposedRect = QRect();
+    m_originalRate = refreshRate();
+    m_proposedRate = 0;
+    setCrtc(m_screen->crtc(None), false);
+}
+
 void RandROutput::slotEnable()
 {
     if(!m_connected)
         return;
 
     qDebug() << "Attempting to enable" << m_name;
-    RandRCrtc *crtc = findEmptyCrtc();
-
-    if(crtc)
-        setCrtc(crtc);
+    m_screen->assignCrtcs(this);
 }
 
 void RandROutput::slotSetAsPrimary(bool primary)
@@ -638,30 +672,35 @@ void RandROutput::slotSetAsPrimary(bool primary)
     }
 }
 
-RandRCrtc *RandROutput::findEmptyCrtc()
+bool RandROutput::stageProposed(RandRTransaction &transaction, int changes)
 {
-    RandRCrtc *crtc = 0;
+    if (!isConnected())
+        return true;
 
-    foreach(RRCrtc c, m_possibleCrtcs)
+    // Don't try to disable an already disabled output.
+    if (!m_proposedRect.isValid() && !m_crtc->isValid()) {
+        return true;
+    }
+    // Don't try to change an enabled output if there is nothing to change.
+    if (m_crtc->isValid()
+        && (m_crtc->rect() == m_proposedRect || !(changes & RandR::ChangeRect))
+        && (m_crtc->rotation() == m_proposedRotation || !(changes & RandR::ChangeRotation))
+        && ((m_crtc->refreshRate() == m_proposedRate || !m_proposedRate || !(changes & RandR::ChangeRate)))
+        && (m_crtc->brightness() == m_proposedBrightness || !(changes & RandR::ChangeBrightness))
+        && ( (m_crtc->virtualRect() == m_proposedVirtualRect &&  m_crtc->tracking() == m_proposedTracking && m_crtc->virtualModeEnabled() == m_proposedVirtualModeEnabled ) || !(changes & RandR::ChangeVirtualRect))
+        )
     {
-        crtc = m_screen->crtc(c);
-        if (crtc->connectedOutputs().count() == 0)
-            return crtc;
+        qDebug() << "No changes for output" << m_name;
+        return true;
     }
 
-    return 0;
-}
-
-bool RandROutput::tryCrtc(RandRCrtc *crtc, int changes)
-{
-    qDebug() << "Trying to change output" << m_name << "to CRTC" << crtc->id() << "...";
-    RandRCrtc *oldCrtc = m_crtc;
-
-    // if we are not yet using this crtc, switch to use it
-    if (crtc->id() != oldCrtc->id())
-        setCrtc(crtc);
+    // use the already attached crtc if any. Otherwise the screen assigns
+    // one, moving other outputs if needed; they are staged as well
+    if (!m_crtc->isValid() && !m_screen->assignCrtcs(this, &transaction))
+        return false;
+    RandRCrtc *crtc = m_crtc;
 
-    crtc->setOriginal();
+    qDebug() << "Staging proposed changes for output" << m_name << "on CRTC" << crtc->id();
 
     if (changes & RandR::ChangeRect)
     {
@@ -680,99 +719,42 @@ bool RandROutput::tryCrtc(RandRCrtc *crtc, int changes)
         crtc->proposeTracking(m_proposedTracking);
         crtc->proposeVirtualModeEnabled(m_proposedVirtualModeEnabled);
     }
-    
-    if (crtc->applyProposed()) {
-        qDebug() << "Changed output" << m_name << "to CRTC" << crtc->id();
-        qDebug() << "   ( from old CRTC" << oldCrtc->id() << ")";
-        return true;
-    }
 
-    // revert changes if we didn't succeed
-    crtc->proposeOriginal();
-    crtc->applyProposed();
-
-    // switch back to the old crtc
-    qDebug() << "Failed to change output" << m_name << "to CRTC" << crtc->id();
-    qDebug() << "   Switching back to old CRTC" << oldCrtc->id();
-    setCrtc(oldCrtc);
-    return false;
+    transaction.addCrtc(crtc);
+    return true;
 }
 
 bool RandROutput::applyProposed(int changes, bool confirm)
 {
-    // If disabled, save anyway to ensure it's saved
+    // nothing is saved for outputs that are not connected
     if (!isConnected())
-    {
-        QSettings cfg;
-        save(cfg);
         return true;
-    }
-    // Don't try to disable an already disabled output.
-    if (!m_proposedRect.isValid() && !m_crtc->isValid()) {
-        return true;
-    }
-    // Don't try to change an enabled output if there is nothing to change.
-    if (m_crtc->isValid()
-        && (m_crtc->rect() == m_proposedRect || !(changes & RandR::ChangeRect))
-        && (m_crtc->rotation() == m_proposedRotation || !(changes & RandR::ChangeRotation))
-        && ((m_crtc->refreshRate() == m_proposedRate || !m_proposedRate || !(changes & RandR::ChangeRate)))
-        && (m_crtc->brightness() == m_proposedBrightness || !(changes & RandR::ChangeBrightness))
-        && ( (m_crtc->virtualRect() == m_proposedVirtualRect &&  m_crtc->tracking() == m_proposedTracking && m_crtc->virtualModeEnabled() == m_proposedVirtualModeEnabled ) || !(changes & RandR::ChangeVirtualRect))
-        )
-    {
-        qDebug() << "No changes for output" << m_name;
-        return true;
-    }
-    qDebug() << "Applying proposed changes for output" << m_name << "...";
 
-    QSettings cfg;
-    RandRCrtc *crtc;
+    RandRTransaction transaction(m_screen);
+    if (!stageProposed(transaction, changes))
+        return false;
+    if (transaction.isEmpty())
+        return true;
 
-    // first try to apply to the already attached crtc if any
-    if (m_crtc->isValid())
+    qDebug() << "Applying proposed changes for output" << m_name << "...";
+    if (!transaction.commit())
     {
-        crtc = m_crtc;
-        if (tryCrtc(crtc, changes))
-        {
-            if ( !confirm || (confirm && RandR::confirm(crtc->rect())) )
-            {
-                save(cfg);
-                return true;
-            }
-            else
-            {
-                crtc->proposeOriginal();
-                crtc->applyProposed();
-            }
-        }
+        qDebug() << "Failed to apply changes for output" << m_name;
         return false;
     }
 
-    //then try an empty crtc
-    crtc = findEmptyCrtc();
-
-    // TODO: check if we can add this output to a CRTC which already has an output
-    // connection
-    if (!crtc)
-        return false;
-
-    // try the crtc, and if no confirmation is needed or the user confirm, save the new settings
-    if (tryCrtc(crtc, changes))
+    // the screen saves the settings once the user keeps them
+    if (confirm)
     {
-        if ( !confirm || (confirm && RandR::confirm(crtc->rect())) )
-        {
-            save(cfg);
-            return true;
-        }
-        else
-        {
-            crtc->proposeOriginal();
-            crtc->applyProposed();
-            return false;
-        }
+        m_screen->startConfirmation(transaction);
+        return true;
     }
 
-    return false;
+    RandRLayoutStore store;
+    store.open();
+    save(store);
+    store.save();
+    return true;
 }
 
 bool RandROutput::setCrtc(RandRCrtc *crtc, bool applyNow)
@@ -808,6 +790,11 @@ void RandROutput::disconnectFromCrtc()
     setCrtc(m_screen->crtc(None), false);
 }
 
+void RandROutput::moveToCrtc(RandRCrtc *crtc)
+{
+    setCrtc(crtc, false);
+}
+
 void RandROutput::slotCrtcChanged(RRCrtc c, int changes)
 {
     Q_UNUSED(c);
@@ -27,9 +27,12 @@
 
 #include "randr.h"
 #include "randrmode.h"
+#include "randrmodecatalog.h"
+#include "randrlayoutstore.h"
 
 class QAction;
-class QSettings;
+class RandRTransaction;
+struct RandROutputInfo;
 
 /** Class representing an RROutput identifier. This class is used
  * to control a particular output's configuration (i.e., the mode or
@@ -39,7 +42,9 @@ class RandROutput : public QObject
     Q_OBJECT
 
 public:
-    RandROutput(RandRScreen *parent, RROutput id);
+    /** Create the output. If @p info is given it is used instead of
+     * querying the server. */
+    RandROutput(RandRScreen *parent, RROutput id, const RandROutputInfo *info = 0);
     ~RandROutput();
 
     /** Returns the internal RANDR identifier for a particular output. */
@@ -49,10 +54,9 @@ public:
     RandRScreen *screen() const;
 
     void loadSettings(bool notify = false);
+    /** Update the output from an already probed state. */
+    void loadSettings(const RandROutputInfo &info, bool notify = false);
 
-    /** Handle an event from RANDR signifying a change in this output's
-     * configuration. */
-    void handleEvent(XRROutputChangeNotifyEvent *event);
     void handlePropertyEvent(XRROutputPropertyNotifyEvent *event);
 
     /** The name of this output, as returned by the X device driver.
@@ -61,19 +65,36 @@ public:
      * display. */
     QString name() const;
 
+    /** A fingerprint of the EDID of the connected monitor, or an empty
+     * string if it does not provide one. */
+    QString fingerprint() const;
+
+    /** The key the settings of this output are saved under: the
+     * fingerprint of the monitor, or the output name without one. */
+    QString settingsKey() const;
+
     /** Return the icon name according to the device type. */
     QString icon() const;
 
     /** List possible CRT controllers for this output. */
     CrtcList possibleCrtcs() const;
 
+    /** The outputs that can share a CRTC with this one. */
+    OutputList clones() const;
+
     /** Returns the current CRTC for this output. */
     RandRCrtc *crtc() const;
 
     void disconnectFromCrtc();
+    /** Drive this output from @p crtc, as chosen by
+     * RandRScreen::assignCrtcs(). Nothing is applied. */
+    void moveToCrtc(RandRCrtc *crtc);
 
     /** Returns a list of all RRModes supported by this output. */
-    ModeList modes() const;
+    const ModeList &modes() const;
+
+    /** The modes of this output indexed by size and refresh rate. */
+    const RandRModeCatalog &modeCatalog() const;
 
     /** Returns the current mode for this output. */
     RandRMode mode() const;
@@ -83,10 +104,10 @@ public:
     RandRMode preferredMode() const;
 
     /** The list of supported sizes */
-    SizeList sizes() const;
+    const SizeList &sizes() const;
     QRect rect() const;
 
-    /** The list of refresh rates for the given size.
+    /** The list of refresh rates for the given size, highest first.
      * If no size is specified, it will use the current size */
     RateList refreshRates(const QSize &s = QSize()) const;
 
@@ -126,7 +147,16 @@ public:
     bool isActive() const;
 
     bool applyProposed(int changes = 0xffffff, bool confirm = false);
+    /** Choose a CRTC for the proposed changes and add it to @p transaction,
+     * without applying anything. */
+    bool stageProposed(RandRTransaction &transaction, int changes = 0xffffff);
     void proposeOriginal();
+    /** Propose to turn the output off. Unlike slotDisable() this does not
+     * apply anything. */
+    void proposeDisable();
+
+    QRect proposedRect() const;
+    int proposedRotation() const;
 
     // proposal functions
     void proposeRefreshRate(float rate);
@@ -137,9 +167,11 @@ public:
     void proposeVirtualSize(const QSize &size);
     void proposeVirtualModeEnabled(bool enabled);
 
-    void load(QSettings &config);
-    void save(QSettings &config);
-    QStringList startupCommands() const;
+    /** Propose the settings saved for this output in @p layout. */
+    void load(const RandRLayoutStore &store, const QString &layout = QString());
+    /** Save the settings of this output in @p layout, @p primary tells
+     * whether it is the primary output of the screen. */
+    void save(RandRLayoutStore &store, const QString &layout = QString(), bool primary = false);
 
 public slots:
     void slotChangeSize(QAction *action);
@@ -163,24 +195,28 @@ protected:
     /** Query Xrandr for information about this output, and set
      * up this instance accordingly. */
     void queryOutputInfo(void);
-
-    /** Find the first CRTC that is not controlling any
-     * display devices. */
-    RandRCrtc *findEmptyCrtc(void);
-    bool tryCrtc(RandRCrtc *crtc, int changes);
+    void queryOutputInfo(const RandROutputInfo &info);
 
     /** Set the current CRT controller for this output.
      * The CRTC should never be set directly; it should be added through
      * this function to properly manage signals related to this output. */
     bool setCrtc(RandRCrtc *crtc, bool applyNow = true);
 
+    /** Read the EDID fingerprint if it is not known yet. */
+    void updateFingerprint();
+    const RandRLayoutStore::Record *findSettings(const RandRLayoutStore &store,
+                                                 const QString &layout) const;
+
 private:
     RROutput m_id;
     XRROutputInfo* m_info;
     QString m_name;
     QString m_alias;
+    QString m_fingerprint;
+    bool m_fingerprintValid;
 
     CrtcList m_possibleCrtcs;
+    OutputList m_clones;
 
     RandRScreen *m_screen;
     RandRCrtc *m_crtc;
@@ -203,6 +239,7 @@ private:
     bool m_originalVirtualModeEnabled;
 
     ModeList m_modes;
+    RandRModeCatalog m_catalog;
     RandRMode m_preferredMode;
 
     int m_rotations;
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "randrprobe.h"
+#include "randrstats.h"
+#include "randrtrace.h"
+#include "randrbackend.h"
+
+#ifdef HAS_XCB_RANDR
+#include <X11/Xlib-xcb.h>
+#include <xcb/randr.h>
+#endif
+
+RandRProbe::RandRProbe(XRRScreenResources *resources, RandRBackend *backend)
+    : m_backend(backend ? backend : RandRBackend::instance()),
+      m_resources(resources),
+      m_requests(0),
+      m_roundTrips(0)
+{
+    Q_ASSERT(m_resources);
+    m_dpy = m_backend->display();
+}
+
+void RandRProbe::addCrtc(RRCrtc id, bool gamma, Time gammaTimestamp)
+{
+    if (id == None)
+        return;
+
+    m_queuedCrtcs[id] = gamma;
+    if (gammaTimestamp != CurrentTime)
+        m_gammaTimestamps[id] = gammaTimestamp;
+    else
+        m_gammaTimestamps.remove(id);
+}
+
+void RandRProbe::addOutput(RROutput id)
+{
+    if (id != None && !m_queuedOutputs.contains(id))
+        m_queuedOutputs.append(id);
+}
+
+void RandRProbe::addAll()
+{
+    for (int i = 0; i < m_resources->ncrtc; ++i)
+        addCrtc(m_resources->crtcs[i]);
+    for (int i = 0; i < m_resources->noutput; ++i)
+        addOutput(m_resources->outputs[i]);
+}
+
+void RandRProbe::run()
+{
+    RandRStats::Scope scope(RandRStats::Probe);
+    RandRTrace::Span span("probe");
+    m_requests = 0;
+    m_roundTrips = 0;
+    m_crtcs.clear();
+    m_outputs.clear();
+
+#ifdef HAS_XCB_RANDR
+    if (m_dpy)
+        runXcb();
+    else
+#endif
+        runSerial();
+
+    m_queuedCrtcs.clear();
+    m_gammaTimestamps.clear();
+    m_queuedOutputs.clear();
+
+    qDebug() << "Probed" << m_crtcs.count() << "CRTCs and" << m_outputs.count() << "outputs:"
+             << m_requests << "requests," << m_roundTrips << "round trips";
+}
+
+const RandRCrtcInfo *RandRProbe::crtc(RRCrtc id) const
+{
+    QMap<RRCrtc, RandRCrtcInfo>::const_iterator it = m_crtcs.constFind(id);
+    if (it == m_crtcs.constEnd())
+        return 0;
+    return &it.value();
+}
+
+const RandROutputInfo *RandRProbe::output(RROutput id) const
+{
+    QMap<RROutput, RandROutputInfo>::const_iterator it = m_outputs.constFind(id);
+    if (it == m_outputs.constEnd())
+        return 0;
+    return &it.value();
+}
+
+const QMap<RRCrtc, RandRCrtcInfo> &RandRProbe::crtcs() const
+{
+    return m_crtcs;
+}
+
+const QMap<RROutput, RandROutputInfo> &RandRProbe::outputs() const
+{
+    return m_outputs;
+}
+
+int RandRProbe::requests() const
+{
+    return m_requests;
+}
+
+int RandRProbe::roundTrips() const
+{
+    return m_roundTrips;
+}
+
+bool RandRProbe::needsGamma(const RandRCrtcInfo &crtc) const
+{
+    if (!m_queuedCrtcs.value(crtc.id))
+        return false;
+
+    // the ramps of a disabled crtc don't matter, they are set again when
+    // it is enabled
+    if (crtc.mode == None)
+        return false;
+
+    QMap<RRCrtc, Time>::const_iterator it = m_gammaTimestamps.constFind(crtc.id);
+    return it == m_gammaTimestamps.constEnd() || it.value() != crtc.timestamp;
+}
+
+void RandRProbe::runSerial()
+{
+    QMap<RRCrtc, bool>::const_iterator it;
+    for (it = m_queuedCrtcs.constBegin(); it != m_queuedCrtcs.constEnd(); ++it)
+    {
+        RandRCrtcInfo crtc;
+        bool found = m_backend->crtcInfo(m_resources, it.key(), crtc);
+        m_requests++;
+        m_roundTrips++;
+        if (!found)
+        {
+            qDebug() << "Failed to query CRTC" << it.key();
+            continue;
+        }
+
+#ifdef HAS_RANDR_1_3
+        if (m_backend->has_1_3())
+        {
+            crtc.hasPanning = m_backend->crtcPanning(m_resources, it.key(), crtc.panning);
+            m_requests++;
+            m_roundTrips++;
+        }
+#endif
+
+        if (needsGamma(crtc))
+        {
+            m_backend->crtcGamma(it.key(), crtc);
+            m_requests++;
+            m_roundTrips++;
+        }
+        m_crtcs.insert(it.key(), crtc);
+    }
+
+    foreach(RROutput id, m_queuedOutputs)
+    {
+        RandROutputInfo output;
+        bool found = m_backend->outputInfo(m_resources, id, output);
+        m_requests++;
+        m_roundTrips++;
+        if (!found)
+        {
+            qDebug() << "Failed to query output" << id;
+            continue;
+        }
+        m_outputs.insert(id, output);
+    }
+}
+
+#ifdef HAS_XCB_RANDR
+namespace
+{
+    struct CrtcCookies
+    {
+        RRCrtc id;
+        xcb_randr_get_crtc_info_cookie_t info;
+        xcb_randr_get_panning_cookie_t panning;
+    };
+
+    struct GammaCookie
+    {
+        RRCrtc id;
+        xcb_randr_get_crtc_gamma_cookie_t ramps;
+    };
+}
+
+void RandRProbe::runXcb()
+{
+    xcb_connection_t *conn = XGetXCBConnection(m_dpy);
+    if (!conn)
+    {
+        runSerial();
+        return;
+    }
+
+    bool panning = false;
+#ifdef HAS_RANDR_1_3
+    panning = m_backend->has_1_3();
+#endif
+
+    // send every request before waiting for any reply
+    QVector<CrtcCookies> crtcCookies;
+    crtcCookies.reserve(m_queuedCrtcs.count());
+    QMap<RRCrtc, bool>::const_iterator it;
+    for (it = m_queuedCrtcs.constBegin(); it != m_queuedCrtcs.constEnd(); ++it)
+    {
+        CrtcCookies c;
+        c.id = it.key();
+        c.info = xcb_randr_get_crtc_info(conn, c.id, m_resources->configTimestamp);
+        m_requests++;
+        RandRStats::request(12);
+        if (panning)
+        {
+            c.panning = xcb_randr_get_panning(conn, c.id);
+            m_requests++;
+            RandRStats::request(8);
+        }
+        crtcCookies.append(c);
+    }
+
+    QVector<xcb_randr_get_output_info_cookie_t> outputCookies;
+    outputCookies.reserve(m_queuedOutputs.count());
+    foreach(RROutput id, m_queuedOutputs)
+    {
+        outputCookies.append(xcb_randr_get_output_info(conn, id, m_resources->configTimestamp));
+        m_requests++;
+        RandRStats::request(12);
+    }
+
+    xcb_flush(conn);
+    if (m_requests)
+    {
+        m_roundTrips = 1;
+        RandRStats::roundTrip();
+    }
+
+    // now collect the replies, they arrive in the order they were sent.
+    // The gamma ramps are only needed for some active crtcs, which is not
+    // known before the crtc replies are in, so they are requested in a
+    // second batch
+    QVector<GammaCookie> gammaCookies;
+    foreach(const CrtcCookies &c, crtcCookies)
+    {
+        xcb_generic_error_t *error = 0;
+        xcb_randr_get_crtc_info_reply_t *info = xcb_randr_get_crtc_info_reply(conn, c.info, &error);
+        if (error)
+            free(error);
+
+        xcb_randr_get_panning_reply_t *pan = 0;
+        if (panning)
+        {
+            error = 0;
+            pan = xcb_randr_get_panning_reply(conn, c.panning, &error);
+            if (error)
+                free(error);
+        }
+
+        if (pan)
+            RandRStats::reply(32 + 4 * pan->length);
+        if (!info)
+        {
+            qDebug() << "Failed to query CRTC" << c.id;
+            free(pan);
+            continue;
+        }
+        RandRStats::reply(32 + 4 * info->length);
+
+        RandRCrtcInfo &crtc = m_crtcs[c.id];
+        crtc.id = c.id;
+        crtc.timestamp = info->timestamp;
+        crtc.rect = QRect(info->x, info->y, info->width, info->height);
+        crtc.mode = info->mode;
+        crtc.rotation = info->rotation;
+        crtc.rotations = info->rotations;
+
+        const xcb_randr_output_t *outputs = xcb_randr_get_crtc_info_outputs(info);
+        int count = xcb_randr_get_crtc_info_outputs_length(info);
+        for (int i = 0; i < count; ++i)
+            crtc.outputs.append(outputs[i]);
+
+        outputs = xcb_randr_get_crtc_info_possible(info);
+        count = xcb_randr_get_crtc_info_possible_length(info);
+        for (int i = 0; i < count; ++i)
+            crtc.possible.append(outputs[i]);
+        free(info);
+
+        if (pan)
+        {
+            crtc.hasPanning = true;
+            crtc.panning = QRect(pan->left, pan->top, pan->width, pan->height);
+            free(pan);
+        }
+
+        if (needsGamma(crtc))
+        {
+            GammaCookie g;
+            g.id = c.id;
+            g.ramps = xcb_randr_get_crtc_gamma(conn, c.id);
+            gammaCookies.append(g);
+            m_requests++;
+            RandRStats::request(8);
+        }
+    }
+
+    if (!gammaCookies.isEmpty())
+    {
+        xcb_flush(conn);
+        m_roundTrips++;
+        RandRStats::roundTrip();
+    }
+
+    for (int i = 0; i < outputCookies.count(); ++i)
+    {
+        RROutput id = m_queuedOutputs.at(i);
+        xcb_generic_error_t *error = 0;
+        xcb_randr_get_output_info_reply_t *info =
+            xcb_randr_get_output_info_reply(conn, outputCookies.at(i), &error);
+        if (error)
+            free(error);
+        if (!info)
+        {
+            qDebug() << "Failed to query output" << id;
+            continue;
+        }
+        RandRStats::reply(32 + 4 * info->length);
+
+        RandROutputInfo &output = m_outputs[id];
+        output.id = id;
+        output.timestamp = info->timestamp;
+        output.crtc = info->crtc;
+        output.connection = info->connection;
+        output.name = QString::fromLocal8Bit((const char *) xcb_randr_get_output_info_name(info),
+                                             xcb_randr_get_output_info_name_length(info));
+
+        const xcb_randr_crtc_t *crtcs = xcb_randr_get_output_info_crtcs(info);
+        for (int j = 0; j < info->num_crtcs; ++j)
+            output.crtcs.append(crtcs[j]);
+
+        const xcb_randr_output_t *clones = xcb_randr_get_output_info_clones(info);
+        for (int j = 0; j < info->num_clones; ++j)
+            output.clones.append(clones[j]);
+
+        const xcb_randr_mode_t *modes = xcb_randr_get_output_info_modes(info);
+        for (int j = 0; j < info->num_modes; ++j)
+            output.modes.append(modes[j]);
+
+        output.npreferred = info->num_preferred;
+        free(info);
+    }
+
+    foreach(const GammaCookie &g, gammaCookies)
+    {
+        xcb_generic_error_t *error = 0;
+        xcb_randr_get_crtc_gamma_reply_t *ramps = xcb_randr_get_crtc_gamma_reply(conn, g.ramps, &error);
+        if (error)
+            free(error);
+        if (!ramps)
+            continue;
+        RandRStats::reply(32 + 4 * ramps->length);
+
+        // the reply carries the ramp size, no need for a GetCrtcGammaSize
+        RandRCrtcInfo &crtc = m_crtcs[g.id];
+        int size = ramps->size;
+        const uint16_t *red = xcb_randr_get_crtc_gamma_red(ramps);
+        const uint16_t *green = xcb_randr_get_crtc_gamma_green(ramps);
+        const uint16_t *blue = xcb_randr_get_crtc_gamma_blue(ramps);
+        crtc.red = QVector<unsigned short>(size);
+        crtc.green = QVector<unsigned short>(size);
+        crtc.blue = QVector<unsigned short>(size);
+        for (int i = 0; i < size; ++i)
+        {
+            crtc.red[i] = red[i];
+            crtc.green[i] = green[i];
+            crtc.blue[i] = blue[i];
+        }
+        free(ramps);
+    }
+}
+#endif
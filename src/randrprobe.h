@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRPROBE_H
+#define RANDRPROBE_H
+
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QVector>
+
+#include "randr.h"
+
+class RandRBackend;
+
+/** Server state of a CRTC, as returned by a RandRProbe. */
+struct RandRCrtcInfo
+{
+    RandRCrtcInfo();
+
+    RRCrtc id;
+    Time timestamp;
+    QRect rect;
+    RRMode mode;
+    int rotation;
+    int rotations;
+    OutputList outputs;
+    OutputList possible;
+
+    bool hasPanning;
+    QRect panning;
+
+    /** Gamma ramps. Empty if the gamma was not needed (see
+     * RandRProbe::addCrtc()) or the CRTC has no gamma support. */
+    QVector<unsigned short> red;
+    QVector<unsigned short> green;
+    QVector<unsigned short> blue;
+};
+
+/** Server state of an output, as returned by a RandRProbe. */
+struct RandROutputInfo
+{
+    RandROutputInfo();
+
+    RROutput id;
+    Time timestamp;
+    RRCrtc crtc;
+    QString name;
+    int connection;
+    CrtcList crtcs;
+    OutputList clones;
+    ModeList modes;
+    int npreferred;
+};
+
+// inline, the startup program fills them in through the Xlib backend
+// without linking the probe
+inline RandRCrtcInfo::RandRCrtcInfo()
+    : id(None),
+      timestamp(0),
+      mode(None),
+      rotation(RandR::Rotate0),
+      rotations(RandR::Rotate0),
+      hasPanning(false)
+{
+}
+
+inline RandROutputInfo::RandROutputInfo()
+    : id(None),
+      timestamp(0),
+      crtc(None),
+      connection(RR_Disconnected),
+      npreferred(0)
+{
+}
+
+/** Queries the state of several CRTCs and outputs at once.
+ *
+ * All requests are queued first and sent together, then the replies are
+ * collected, so probing a whole screen costs about one round trip to the
+ * server instead of several per CRTC and output. This needs xcb-randr and
+ * a backend on an X display; otherwise every request is a blocking call of
+ * the backend. */
+class RandRProbe
+{
+public:
+    /** Probe @p resources through @p backend, RandRBackend::instance() by
+     * default. */
+    RandRProbe(XRRScreenResources *resources, RandRBackend *backend = 0);
+
+    /** Queue a CRTC. If @p gamma is set, its gamma ramps are read as well,
+     * but only if the CRTC is active and its timestamp differs from
+     * @p gammaTimestamp, the time at which the caller's copy of the ramps
+     * was last known to be current. */
+    void addCrtc(RRCrtc id, bool gamma = true, Time gammaTimestamp = CurrentTime);
+    void addOutput(RROutput id);
+
+    /** Queue every CRTC and output of the screen resources. */
+    void addAll();
+
+    /** Send all queued requests and collect the replies. */
+    void run();
+
+    const RandRCrtcInfo *crtc(RRCrtc id) const;
+    const RandROutputInfo *output(RROutput id) const;
+
+    /** Every CRTC and output probed by the last run(). */
+    const QMap<RRCrtc, RandRCrtcInfo> &crtcs() const;
+    const QMap<RROutput, RandROutputInfo> &outputs() const;
+
+    /** Number of requests sent by the last run(). */
+    int requests() const;
+    /** Number of times the last run() had to wait for the server. */
+    int roundTrips() const;
+
+private:
+    /** Whether the ramps of a probed CRTC have to be read. */
+    bool needsGamma(const RandRCrtcInfo &crtc) const;
+    void runSerial();
+#ifdef HAS_XCB_RANDR
+    void runXcb();
+#endif
+
+    RandRBackend *m_backend;
+    /** The display of the backend, if it has one */
+    Display *m_dpy;
+    XRRScreenResources *m_resources;
+
+    QMap<RRCrtc, bool> m_queuedCrtcs;
+    QMap<RRCrtc, Time> m_gammaTimestamps;
+    OutputList m_queuedOutputs;
+
+    QMap<RRCrtc, RandRCrtcInfo> m_crtcs;
+    QMap<RROutput, RandROutputInfo> m_outputs;
+
+    int m_requests;
+    int m_roundTrips;
+};
+
+#endif // RANDRPROBE_H
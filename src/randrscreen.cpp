@@ -17,30 +17,85 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <QtCore/QSettings>
+#include <QtCore/QSet>
+#include <QtCore/QElapsedTimer>
 #include <QtGui/QAction>
 
 #include "randrscreen.h"
 #include "randrcrtc.h"
 #include "randroutput.h"
 #include "randrmode.h"
+#include "randrprobe.h"
+#include "randrsnapshot.h"
+#include "randrworker.h"
+#include "randrtransaction.h"
+#include "randrconfirmation.h"
+#include "randrlayoutstore.h"
+#include "randrapplyplan.h"
+#include "randrcrtcsolver.h"
+#include "randrbackend.h"
+#include "randrstats.h"
+#include "randrtrace.h"
 #include <X11/extensions/Xrandr.h>
 
-RandRScreen::RandRScreen(int screenIndex)
-: m_originalPrimaryOutput(0),
+// docking and undocking send dozens of events in a row, wait this many ms
+// for the burst to end before reloading
+static const int UpdateDelay = 100;
+
+RandRChangeSet::RandRChangeSet()
+    : resized(false)
+{
+}
+
+bool RandRChangeSet::isEmpty() const
+{
+    return added.isEmpty() && removed.isEmpty() && changed.isEmpty() && crtcs.isEmpty() && !resized;
+}
+
+void RandRChangeSet::clear()
+{
+    added.clear();
+    removed.clear();
+    changed.clear();
+    crtcs.clear();
+    resized = false;
+    since.invalidate();
+}
+
+RandRScreen::RandRScreen(int screenIndex, RandRBackend *backend, const RandRSnapshot &snapshot)
+: m_backend(backend ? backend : RandRBackend::instance()),
+  m_timestamp(0),
+  m_originalPrimaryOutput(0),
   m_proposedPrimaryOutput(0),
-  m_resources(0)
+  m_confirmation(0),
+  m_needsReprobe(false),
+  m_worker(0),
+  m_probing(false),
+  m_applying(0),
+  m_applyConfirm(false),
+  m_reloadPending(false),
+  m_reloading(false),
+  m_persistent(true)
 {
     m_index = screenIndex;
-    m_rect = QRect(0, 0, XDisplayWidth(QX11Info::display(), m_index),
-                 XDisplayHeight(QX11Info::display(), m_index));
+    m_rect = QRect(QPoint(0, 0), m_backend->screenSize(m_index));
 
     m_connectedCount = 0;
     m_activeCount = 0;
 
-    loadSettings();
-    QSettings cfg;
-    load(cfg, true);
+    m_updateTimer.setSingleShot(true);
+    m_updateTimer.setInterval(UpdateDelay);
+    connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(slotUpdate()));
+
+    // the display may have probed all of its screens at once
+    if (snapshot.isValid())
+        loadSnapshot(snapshot);
+    else
+        loadSettings();
+    m_pendingChanges.clear();
+    RandRLayoutStore store;
+    store.open();
+    load(store, QString(), true);
 
     m_originalPrimaryOutput = primaryOutput();
 
@@ -50,14 +105,13 @@ RandRScreen::RandRScreen(int screenIndex)
            RROutputChangeNotifyMask |
            RROutputPropertyNotifyMask;
 
-    XRRSelectInput(QX11Info::display(), rootWindow(), 0);
-    XRRSelectInput(QX11Info::display(), rootWindow(), mask);
+    m_backend->selectInput(rootWindow(), 0);
+    m_backend->selectInput(rootWindow(), mask);
 }
 
 RandRScreen::~RandRScreen()
 {
-    if (m_resources)
-        XRRFreeScreenResources(m_resources);
+    delete m_applying;
 
     //qDeleteAll(m_crtcs);
     //qDeleteAll(m_outputs);
@@ -69,42 +123,72 @@ int RandRScreen::index() const
     return m_index;
 }
 
+RandRBackend *RandRScreen::backend() const
+{
+    return m_backend;
+}
+
+Time RandRScreen::timestamp() const
+{
+    return m_timestamp;
+}
+
+void RandRScreen::setTimestamp(Time timestamp)
+{
+    m_timestamp = timestamp;
+}
+
 XRRScreenResources* RandRScreen::resources() const
+{
+    return m_resources.data();
+}
+
+QSharedPointer<XRRScreenResources> RandRScreen::sharedResources() const
 {
     return m_resources;
 }
 
 Window RandRScreen::rootWindow() const
 {
-    return RootWindow(QX11Info::display(), m_index);
+    return m_backend->rootWindow(m_index);
 }
 
 void RandRScreen::loadSettings(bool notify)
 {
-    bool changed = false;
-    int minW, minH, maxW, maxH;
-
-    Status status = XRRGetScreenSizeRange(QX11Info::display(), rootWindow(),
-                     &minW, &minH, &maxW, &maxH);
-    //FIXME: we should check the status here
-    Q_UNUSED(status);
-    QSize minSize = QSize(minW, minH);
-    QSize maxSize = QSize(maxW, maxH);
+    RandRStats::Scope scope(RandRStats::Probe);
+    bool poll = RandR::reprobe || m_needsReprobe;
+    m_needsReprobe = false;
+    loadSnapshot(RandRSnapshot::probe(m_backend, m_index, poll, gammaTimestamps()), notify);
+}
 
-    if (minSize != m_minSize || maxSize != m_maxSize)
+QMap<RRCrtc, Time> RandRScreen::gammaTimestamps() const
+{
+    QMap<RRCrtc, Time> timestamps;
+    foreach(RandRCrtc *c, m_crtcs)
     {
-        m_minSize = minSize;
-        m_maxSize = maxSize;
-        changed = true;
+        if (c->id() != None)
+            timestamps.insert(c->id(), c->gammaTimestamp());
     }
+    return timestamps;
+}
 
-    if (m_resources)
-        XRRFreeScreenResources(m_resources);
+void RandRScreen::loadSnapshot(const RandRSnapshot &snapshot, bool notify)
+{
+    RandRTrace::Span span("reload");
+    Q_ASSERT(snapshot.isValid());
+    if (!snapshot.isValid())
+        return;
 
-    m_resources = XRRGetScreenResources(QX11Info::display(), rootWindow());
-    Q_ASSERT(m_resources);
+    bool changed = false;
+    if (snapshot.minSize != m_minSize || snapshot.maxSize != m_maxSize)
+    {
+        m_minSize = snapshot.minSize;
+        m_maxSize = snapshot.maxSize;
+        changed = true;
+    }
 
-    RandR::timestamp = m_resources->timestamp;
+    m_resources = snapshot.resources;
+    m_timestamp = m_resources->timestamp;
 
     // get all modes
     for (int i = 0; i < m_resources->nmode; ++i)
@@ -116,61 +200,239 @@ void RandRScreen::loadSettings(bool notify)
         }
     }
 
+    m_reloading = true;
+
     //get all crtcs
-    qDebug() << "Creating CRTC object for XID 0 (\"None\")";
-    RandRCrtc *c_none = new RandRCrtc(this, None);
-    m_crtcs[None] = c_none;
+    if (!m_crtcs.contains(None))
+    {
+        qDebug() << "Creating CRTC object for XID 0 (\"None\")";
+        m_crtcs[None] = new RandRCrtc(this, None);
+    }
 
+    QSet<RRCrtc> crtcIds;
     for (int i = 0; i < m_resources->ncrtc; ++i)
     {
-        if (m_crtcs.contains(m_resources->crtcs[i]))
-            m_crtcs[m_resources->crtcs[i]]->loadSettings(notify);
-        else
+        RRCrtc id = m_resources->crtcs[i];
+        crtcIds.insert(id);
+        QMap<RRCrtc, RandRCrtcInfo>::const_iterator info = snapshot.crtcs.constFind(id);
+        RandRCrtc *c = m_crtcs.value(id);
+        if (!c)
         {
-            qDebug() << "Creating CRTC object for XID" << m_resources->crtcs[i];
-            RandRCrtc *c = new RandRCrtc(this, m_resources->crtcs[i]);
-            connect(c, SIGNAL(crtcChanged(RRCrtc,int)), this, SIGNAL(configChanged()));
-            connect(c, SIGNAL(crtcChanged(RRCrtc,int)), this, SLOT(save()));
-            c->loadSettings(notify);
-            m_crtcs[m_resources->crtcs[i]] = c;
+            qDebug() << "Creating CRTC object for XID" << id;
+            c = new RandRCrtc(this, id);
+            connect(c, SIGNAL(crtcChanged(RRCrtc,int)), this, SLOT(slotCrtcChanged(RRCrtc,int)));
+            m_crtcs[id] = c;
             changed = true;
         }
+        // the ramps were all read again
+        else if (snapshot.polled)
+            c->invalidateGamma();
+
+        if (info != snapshot.crtcs.constEnd())
+            c->loadSettings(info.value(), notify);
+        else
+            c->loadSettings(notify);
     }
 
     //get all outputs
+    QSet<RROutput> outputIds;
     for (int i = 0; i < m_resources->noutput; ++i)
     {
-        if (m_outputs.contains(m_resources->outputs[i]))
-            ;//m_outputs[m_resources->outputs[i]]->loadSettings(notify);
+        RROutput id = m_resources->outputs[i];
+        outputIds.insert(id);
+        QMap<RROutput, RandROutputInfo>::const_iterator it = snapshot.outputs.constFind(id);
+        const RandROutputInfo *info = it != snapshot.outputs.constEnd() ? &it.value() : 0;
+        RandROutput *o = m_outputs.value(id);
+        if (o)
+        {
+            // reports its differences through outputChanged()
+            if (info)
+                o->loadSettings(*info, notify);
+        }
         else
         {
-            qDebug() << "Creating output object for XID" << m_resources->outputs[i];
-            RandROutput *o = new RandROutput(this, m_resources->outputs[i]);
+            qDebug() << "Creating output object for XID" << id;
+            o = new RandROutput(this, id, info);
             connect(o, SIGNAL(outputChanged(RROutput,int)), this,
                       SLOT(slotOutputChanged(RROutput,int)));
-            m_outputs[m_resources->outputs[i]] = o;
-            if (o->isConnected())
-                m_connectedCount++;
-            if (o->isActive())
-                m_activeCount++;
-
+            m_outputs[id] = o;
+            m_pendingChanges.added.append(id);
             changed = true;
         }
     }
 
-    if (notify && changed)
-        emit configChanged();
+    // forget the outputs and crtcs the server no longer knows, e.g. the
+    // ones of a docking station that was unplugged
+    foreach(RandROutput *o, m_outputs)
+    {
+        if (outputIds.contains(o->id()))
+            continue;
+
+        qDebug() << "Removing output object for XID" << o->id();
+        m_outputs.remove(o->id());
+        m_modeMatrix.removeOutput(o->id());
+        m_pendingChanges.added.removeAll(o->id());
+        m_pendingChanges.changed.removeAll(o->id());
+        m_pendingChanges.removed.append(o->id());
+        if (m_proposedPrimaryOutput == o)
+            m_proposedPrimaryOutput = 0;
+        if (m_originalPrimaryOutput == o)
+            m_originalPrimaryOutput = 0;
+        o->disconnect(this);
+        o->deleteLater();
+        changed = true;
+    }
 
+    foreach(RandRCrtc *c, m_crtcs)
+    {
+        if (c->id() == None || crtcIds.contains(c->id()))
+            continue;
+
+        qDebug() << "Removing CRTC object for XID" << c->id();
+        m_crtcs.remove(c->id());
+        m_pendingChanges.crtcs.removeAll(c->id());
+        c->disconnect(this);
+        c->deleteLater();
+        changed = true;
+    }
+
+    updateCounts();
+    m_reloading = false;
+
+    if (notify)
+    {
+        // e.g. only the size limits changed
+        if (changed && m_pendingChanges.isEmpty())
+            emit configChanged();
+        flushChanges();
+    }
 }
 
-void RandRScreen::handleEvent(XRRScreenChangeNotifyEvent* event)
+void RandRScreen::scheduleUpdate(bool reload)
 {
-    m_rect.setWidth(event->width);
-    m_rect.setHeight(event->height);
+    if (reload)
+        m_reloadPending = true;
+    if (!m_pendingChanges.since.isValid())
+        m_pendingChanges.since.start();
+    if (!m_updateTimer.isActive())
+        m_updateTimer.start();
+}
+
+void RandRScreen::slotUpdate()
+{
+    if (m_reloadPending && m_worker)
+    {
+        // the events received meanwhile are handled once it is back
+        if (m_probing)
+            return;
+
+        m_reloadPending = false;
+        m_probing = true;
+        m_worker->requestProbe(m_index, RandR::reprobe || m_needsReprobe, gammaTimestamps());
+        m_needsReprobe = false;
+        return;
+    }
+
+    if (m_reloadPending)
+    {
+        m_reloadPending = false;
+        // reports everything that was pending as well
+        loadSettings(true);
+        return;
+    }
+
+    flushChanges();
+}
+
+void RandRScreen::setPersistent(bool persistent)
+{
+    m_persistent = persistent;
+}
 
+void RandRScreen::setWorker(RandRWorker *worker)
+{
+    if (m_worker)
+        m_worker->disconnect(this);
+
+    m_worker = worker;
+    if (!m_worker)
+        return;
+
+    connect(m_worker, SIGNAL(probed(RandRSnapshot)), this, SLOT(slotProbed(RandRSnapshot)));
+    connect(m_worker, SIGNAL(progress(int,int,int)), this, SLOT(slotApplyProgress(int,int,int)));
+    connect(m_worker, SIGNAL(applied(int,bool)), this, SLOT(slotApplied(int,bool)));
+}
+
+void RandRScreen::slotProbed(const RandRSnapshot &snapshot)
+{
+    if (snapshot.screen != m_index)
+        return;
+    m_probing = false;
+
+    // the model may have been reloaded on the spot in the meantime, the
+    // server's timestamps tell which state is the latest
+    if (snapshot.isValid() && (!m_resources ||
+        (snapshot.resources->timestamp >= m_resources->timestamp &&
+         snapshot.resources->configTimestamp >= m_resources->configTimestamp)))
+    {
+        // reports everything that was pending as well
+        loadSnapshot(snapshot, true);
+    }
+    else
+        flushChanges();
+
+    if (m_reloadPending)
+        scheduleUpdate(true);
+}
+
+void RandRScreen::flushChanges()
+{
+    m_updateTimer.stop();
+    if (m_pendingChanges.isEmpty())
+        return;
+
+    RandRChangeSet changes = m_pendingChanges;
+    m_pendingChanges.clear();
+
+    qDebug() << "Screen" << m_index << "changed:" << changes.added.count() << "outputs added,"
+             << changes.removed.count() << "removed," << changes.changed.count() << "changed,"
+             << changes.crtcs.count() << "crtcs changed";
+
+    if (!changes.crtcs.isEmpty())
+        save();
+
+    emit changed(changes);
     emit configChanged();
 }
 
+void RandRScreen::slotCrtcChanged(RRCrtc id, int changes)
+{
+    Q_UNUSED(changes);
+
+    if (!m_pendingChanges.crtcs.contains(id))
+        m_pendingChanges.crtcs.append(id);
+    // a reload reports its changes itself
+    if (!m_reloading)
+        scheduleUpdate(false);
+}
+
+void RandRScreen::requestReprobe()
+{
+    m_needsReprobe = true;
+}
+
+void RandRScreen::handleEvent(XRRScreenChangeNotifyEvent* event)
+{
+    if (event->width != m_rect.width() || event->height != m_rect.height())
+    {
+        m_rect.setWidth(event->width);
+        m_rect.setHeight(event->height);
+        m_pendingChanges.resized = true;
+    }
+
+    scheduleUpdate(true);
+}
+
 void RandRScreen::handleRandREvent(XRRNotifyEvent* event)
 {
     RandRCrtc *c;
@@ -179,27 +441,33 @@ void RandRScreen::handleRandREvent(XRRNotifyEvent* event)
     XRROutputChangeNotifyEvent *outputEvent;
     XRROutputPropertyNotifyEvent *propertyEvent;
 
-    // forward events to crtcs and outputs
+    // crtc events are cheap to apply, output changes are picked up by the
+    // next reload. Objects the model does not know yet show up after it.
     switch (event->subtype) {
         case RRNotify_CrtcChange:
             crtcEvent = (XRRCrtcChangeNotifyEvent*)event;
             c = crtc(crtcEvent->crtc);
-            Q_ASSERT(c);
-            c->handleEvent(crtcEvent);
+            if (c)
+                c->handleEvent(crtcEvent);
+            else
+                scheduleUpdate(true);
             return;
 
         case RRNotify_OutputChange:
             outputEvent = (XRROutputChangeNotifyEvent*)event;
             o = output(outputEvent->output);
-            Q_ASSERT(o);
-            o->handleEvent(outputEvent);
+            // a monitor was plugged or unplugged, its modes have to be
+            // read again from the hardware
+            if (!o || (outputEvent->connection == RR_Connected) != o->isConnected())
+                requestReprobe();
+            scheduleUpdate(true);
             return;
 
         case RRNotify_OutputProperty:
             propertyEvent = (XRROutputPropertyNotifyEvent*)event;
             o = output(propertyEvent->output);
-            Q_ASSERT(o);
-            o->handlePropertyEvent(propertyEvent);
+            if (o)
+                o->handlePropertyEvent(propertyEvent);
             return;
     }
 }
@@ -214,40 +482,34 @@ QSize RandRScreen::maxSize() const
     return m_maxSize;
 }
 
-CrtcMap RandRScreen::crtcs() const
+const CrtcMap &RandRScreen::crtcs() const
 {
     return m_crtcs;
 }
 
 RandRCrtc* RandRScreen::crtc(RRCrtc id) const
 {
-    if (m_crtcs.contains(id))
-        return m_crtcs[id];
-
-    return 0;
+    return m_crtcs.value(id, 0);
 }
 
-OutputMap RandRScreen::outputs() const
+const OutputMap &RandRScreen::outputs() const
 {
     return m_outputs;
 }
 
 RandROutput* RandRScreen::output(RROutput id) const
 {
-    if (m_outputs.contains(id))
-        return m_outputs[id];
-
-    return 0;
+    return m_outputs.value(id, 0);
 }
 
 void RandRScreen::setPrimaryOutput(RandROutput* output)
 {
-    if (RandR::has_1_3)
+    if (m_backend->has_1_3())
     {
         RROutput id = None;
         if (output)
             id = output->id();
-        XRRSetOutputPrimary(QX11Info::display(), rootWindow(), id);
+        m_backend->setOutputPrimary(rootWindow(), id);
     }
 }
 
@@ -258,24 +520,31 @@ void RandRScreen::proposePrimaryOutput(RandROutput* output)
 
 RandROutput* RandRScreen::primaryOutput()
 {
-    if (RandR::has_1_3)
+    if (m_backend->has_1_3())
     {
-        return output(XRRGetOutputPrimary(QX11Info::display(), rootWindow()));
+        return output(m_backend->outputPrimary(rootWindow()));
     }
     return 0;
 }
 
-ModeMap RandRScreen::modes() const
+const ModeMap &RandRScreen::modes() const
 {
     return m_modes;
 }
 
-RandRMode RandRScreen::mode(RRMode id) const
+const RandRModeMatrix &RandRScreen::modeMatrix() const
+{
+    return m_modeMatrix;
+}
+
+void RandRScreen::setOutputModes(RROutput output, const ModeList &modes)
 {
-    if (m_modes.contains(id))
-        return m_modes[id];
+    m_modeMatrix.setOutputModes(output, modes, m_modes);
+}
 
-    return RandRMode(0);
+RandRMode RandRScreen::mode(RRMode id) const
+{
+    return m_modes.value(id);
 }
 
 bool RandRScreen::adjustSize(const QRect &minimumSize)
@@ -314,27 +583,39 @@ bool RandRScreen::setSize(const QSize &s)
     if (s == m_rect.size())
         return true;
 
+    RandRTrace::Span span("resize");
+
     if (s.width() < m_minSize.width() ||
         s.height() < m_minSize.height() ||
         s.width() > m_maxSize.width() ||
         s.height() > m_maxSize.height())
         return false;
 
+    QSize mm = sizeMM(s);
+    m_backend->setScreenSize(rootWindow(), s, mm);
+    m_rect.setSize(s);
+    
+    qDebug() << "[RandRScreen::setSize] width=" << s.width() << "height=" << s.height() << "widthMM=" << mm.width() << "heightMM=" << mm.height();
+     
+    
+    return true;
+}
+
+QSize RandRScreen::sizeMM(const QSize &s) const
+{
     int widthMM, heightMM;
     float dpi;
 
     /* values taken from xrandr */
-    dpi = (25.4 * DisplayHeight(QX11Info::display(), m_index)) / DisplayHeightMM(QX11Info::display(), m_index);
+    dpi = (25.4 * m_backend->screenSize(m_index).height()) / m_backend->screenSizeMM(m_index).height();
     widthMM =  (int) ((25.4 * s.width()) / dpi);
     heightMM = (int) ((25.4 * s.height()) / dpi);
+    return QSize(widthMM, heightMM);
+}
 
-    XRRSetScreenSize(QX11Info::display(), rootWindow(), s.width(), s.height(), widthMM, heightMM);
+void RandRScreen::commitSize(const QSize &s)
+{
     m_rect.setSize(s);
-    
-    qDebug() << "[RandRScreen::setSize] width=" << s.width() << "height=" << s.height() << "widthMM=" << widthMM << "heightMM=" << heightMM;
-     
-    
-    return true;
 }
 
 int RandRScreen::connectedCount() const
@@ -385,34 +666,15 @@ int RandRScreen::unifiedRotations() const
 
 SizeList RandRScreen::unifiedSizes() const
 {
-    SizeList sizeList;
-    bool first = true;
-
+    OutputList connected;
     foreach(RandROutput *output, m_outputs)
     {
-        if (!output->isConnected())
-            continue;
-
-        if (first)
-        {
-            // we start using the list from the first output
-            sizeList = output->sizes();
-            first = false;
-        }
-        else
-        {
-            SizeList outputSizes = output->sizes();
-            for (int i = sizeList.count() - 1; i >=0; --i)
-            {
-                // check if the current output has the i-th size of the sizeList
-                // if not, remove from the list
-                if (outputSizes.indexOf(sizeList[i]) == -1)
-                    sizeList.removeAt(i);
-            }
-        }
+        if (output->isConnected())
+            connected.append(output->id());
     }
 
-    return sizeList;
+    // in the order of the first connected output
+    return m_modeMatrix.sharedSizes(connected);
 }
 
 QRect RandRScreen::rect() const
@@ -420,150 +682,468 @@ QRect RandRScreen::rect() const
     return m_rect;
 }
 
-void RandRScreen::load(QSettings &config, bool skipOutputs)
+void RandRScreen::load(const RandRLayoutStore &store, const QString &layout, bool skipOutputs)
 {
-    config.beginGroup("Screen_" + QString::number(m_index));
-    m_outputsUnified = config.value("OutputsUnified", false).toBool();
-    m_unifiedRect = ((config.value("UnifiedRect", "0,0,0,0") == QVariant("0,0,0,0"))
-        ? QRect() : config.value("UnifiedRect", QRect())).toRect();
-            m_unifiedRotation = config.value("UnifiedRotation", (int) RandR::Rotate0).toInt();
-
-    config.endGroup();
+    const RandRLayoutStore::Record *settings = store.find(RandRLayoutStore::ScreenRecord, layout, m_index);
+    if (settings)
+    {
+        m_outputsUnified = settings->hasFlag(RandRLayoutStore::OutputsUnified);
+        m_unifiedRect = settings->rect();
+        m_unifiedRotation = settings->rotation;
+    }
+    else
+    {
+        m_outputsUnified = false;
+        m_unifiedRect = QRect();
+        m_unifiedRotation = RandR::Rotate0;
+    }
 
     if (skipOutputs)
         return;
 
+    // the saved primary output proposes itself while loading, older
+    // stores do not know it so the current one is kept
+    if (settings && settings->hasFlag(RandRLayoutStore::PrimarySaved))
+        proposePrimaryOutput(0);
+
     foreach(RandROutput *output, m_outputs)
     {
         if (output->isConnected())
-            output->load(config);
+            output->load(store, layout);
     }
 }
 
-void RandRScreen::save(QSettings &config)
+void RandRScreen::save(RandRLayoutStore &store, const QString &layout)
 {
-    config.beginGroup("Screen_" + QString::number(m_index));
-    config.setValue("OutputsUnified", m_outputsUnified);
-    config.setValue("OutputsUnified", m_outputsUnified);
-    config.setValue("UnifiedRect", m_unifiedRect);
-    config.setValue("UnifiedRotation", m_unifiedRotation);
-
-    config.endGroup();
+    RandRLayoutStore::Record settings = RandRLayoutStore::record(RandRLayoutStore::ScreenRecord,
+                                                                 layout, m_index);
+    settings.setFlag(RandRLayoutStore::OutputsUnified, m_outputsUnified);
+    settings.setRect(m_unifiedRect);
+    settings.rotation = m_unifiedRotation;
+    settings.setFlag(RandRLayoutStore::PrimarySaved, m_backend->has_1_3());
+    store.insert(settings);
+
+    RandROutput *primary = primaryOutput();
+    foreach(RandROutput *output, m_outputs)
+    {
+        if (output->isConnected())
+            output->save(store, layout, output == primary);
+    }
+}
 
+QString RandRScreen::layoutName() const
+{
+    QStringList names;
     foreach(RandROutput *output, m_outputs)
     {
         if (output->isConnected())
-            output->save(config);
+            names.append(output->settingsKey());
     }
+    names.sort();
+    return names.join("+");
+}
+
+bool RandRScreen::loadLayout(const RandRLayoutStore &store)
+{
+    QString layout = layoutName();
+    if (!store.hasLayout(layout))
+        return false;
+
+    load(store, layout);
+    return true;
+}
+
+void RandRScreen::saveLayout(RandRLayoutStore &store)
+{
+    save(store, layoutName());
 }
 
 void RandRScreen::save()
 {
-    QSettings config;
-    save(config);
+    // the store is shared by every display of the process
+    if (!m_persistent)
+        return;
+
+    RandRLayoutStore store;
+    store.open();
+    save(store);
+    store.save();
 }
 
-QStringList RandRScreen::startupCommands() const
+void RandRScreen::compilePlan(RandRApplyPlan &plan) const
 {
-    QStringList commands;
-    foreach(RandROutput *output, m_outputs)
+    plan.removeScreen(m_index);
+
+    RandRApplyPlan::Operation op = RandRApplyPlan::operation(RandRApplyPlan::CheckConfig, m_index);
+    op.timestamp = m_resources->configTimestamp;
+    plan.append(op);
+
+    // the plan does not depend on the state it is applied to: every crtc
+    // is either set or turned off
+    QList<RandRCrtc*> active;
+    CrtcList disabled;
+    QRect bounds;
+    foreach(RandRCrtc *crtc, m_crtcs)
     {
-        if (output->isConnected())
-            commands += output->startupCommands();
+        if (crtc->mode().isValid() && !crtc->currentOutputs().isEmpty())
+        {
+            active.append(crtc);
+            bounds |= crtc->rect();
+            if (crtc->virtualModeEnabled() && crtc->virtualRect().isValid())
+                bounds |= QRect(crtc->rect().topLeft(), crtc->virtualRect().size());
+        }
+        else
+        {
+            plan.append(RandRApplyPlan::operation(RandRApplyPlan::DisableCrtc, m_index, crtc->id()));
+            disabled.append(crtc->id());
+        }
     }
-    return commands;
+
+    // an output still driven by another crtc cannot be set on its new one,
+    // the server answers BadMatch. The crtc it had before the last change
+    // is turned off first, it is set again below if it stays on
+    foreach(RandRCrtc *crtc, active)
+    {
+        foreach(RROutput output, crtc->currentOutputs())
+        {
+            RRCrtc previous = m_previousCrtcs.value(output, None);
+            if (previous == None || previous == crtc->id() || disabled.contains(previous))
+                continue;
+            plan.append(RandRApplyPlan::operation(RandRApplyPlan::DisableCrtc, m_index, previous));
+            disabled.append(previous);
+        }
+    }
+
+    QSize size = bounds.isValid() ? QRect(QPoint(0, 0), bounds.bottomRight()).size() : m_rect.size();
+    size = size.expandedTo(m_minSize);
+
+    /* values taken from xrandr */
+    float dpi = (25.4 * m_backend->screenSize(m_index).height()) / m_backend->screenSizeMM(m_index).height();
+    RandRApplyPlan::Operation screenSize = RandRApplyPlan::operation(RandRApplyPlan::GrowScreen, m_index);
+    screenSize.geometry[0] = size.width();
+    screenSize.geometry[1] = size.height();
+    screenSize.geometry[2] = (int) ((25.4 * size.width()) / dpi);
+    screenSize.geometry[3] = (int) ((25.4 * size.height()) / dpi);
+    plan.append(screenSize);
+
+    foreach(RandRCrtc *crtc, active)
+    {
+        // see RandRCrtc::applyProposedTransform()
+        if (m_backend->has_1_3())
+        {
+            float width = 1.0;
+            float height = 1.0;
+            if (!crtc->tracking() && crtc->virtualModeEnabled() && !crtc->rect().isEmpty())
+            {
+                width = (float) crtc->virtualRect().width() / (float) crtc->rect().width();
+                height = (float) crtc->virtualRect().height() / (float) crtc->rect().height();
+            }
+            op = RandRApplyPlan::operation(RandRApplyPlan::SetTransform, m_index, crtc->id());
+            op.geometry[0] = XDoubleToFixed(width);
+            op.geometry[1] = XDoubleToFixed(height);
+            plan.append(op);
+        }
+
+        op = RandRApplyPlan::operation(RandRApplyPlan::SetCrtc, m_index, crtc->id());
+        op.mode = crtc->mode().id();
+        op.rotation = crtc->rotation();
+        op.geometry[0] = crtc->rect().x();
+        op.geometry[1] = crtc->rect().y();
+        foreach(RROutput output, crtc->currentOutputs())
+        {
+            if (op.outputCount < (quint32) RandRApplyPlan::MaxOutputs)
+                op.outputs[op.outputCount++] = output;
+        }
+        plan.append(op);
+    }
+
+    screenSize.type = RandRApplyPlan::SetScreenSize;
+    plan.append(screenSize);
+
+    foreach(RandRCrtc *crtc, active)
+    {
+        if (m_backend->has_1_3() && crtc->virtualModeEnabled() && crtc->virtualRect().isValid())
+        {
+            op = RandRApplyPlan::operation(RandRApplyPlan::SetPanning, m_index, crtc->id());
+            op.geometry[2] = crtc->virtualRect().width();
+            op.geometry[3] = crtc->virtualRect().height();
+            plan.append(op);
+        }
+
+        op = RandRApplyPlan::operation(RandRApplyPlan::SetGamma, m_index, crtc->id());
+        op.gamma[0] = crtc->brightness();
+        op.gamma[1] = crtc->red;
+        op.gamma[2] = crtc->green;
+        op.gamma[3] = crtc->blue;
+        plan.append(op);
+    }
+
+#ifdef HAS_RANDR_1_3
+    if (m_backend->has_1_3())
+        plan.append(RandRApplyPlan::operation(RandRApplyPlan::SetPrimary, m_index,
+                                              m_backend->outputPrimary(rootWindow())));
+#endif
 }
 
 void RandRScreen::load()
 {
-    QSettings config;
-    load(config);
+    RandRLayoutStore store;
+    store.open();
+    load(store);
+}
+
+bool RandRScreen::assignCrtcs(RandROutput *output, RandRTransaction *transaction)
+{
+    RandRStats::Scope scope(RandRStats::Plan);
+    RandRCrtcSolver solver;
+    QMap<RROutput, RRCrtc> lit;
+    foreach(RandRCrtc *crtc, m_crtcs)
+    {
+        if (!crtc->isValid())
+            continue;
+        solver.addCrtc(crtc->id(), !crtc->currentOutputs().isEmpty());
+        foreach(RROutput id, crtc->currentOutputs())
+            lit.insert(id, crtc->id());
+    }
+
+    // outputs proposed with the same rect and rotation may be cloned
+    QList<QPair<QRect, int> > groups;
+    QList<RandROutput*> outputs;
+    foreach(RandROutput *o, m_outputs)
+    {
+        if (!o->isConnected() || (o != output && !o->proposedRect().isValid()))
+            continue;
+
+        int group = -1;
+        if (o->proposedRect().isValid())
+        {
+            QPair<QRect, int> key(o->proposedRect(), o->proposedRotation());
+            group = groups.indexOf(key);
+            if (group == -1)
+            {
+                groups.append(key);
+                group = groups.count() - 1;
+            }
+        }
+
+        // the crtc driving the output on the server, keeping it avoids a modeset
+        solver.addOutput(o->id(), o->possibleCrtcs(), o->clones(), lit.value(o->id(), None), group);
+        outputs.append(o);
+    }
+
+    if (!solver.solve())
+    {
+        foreach(RROutput id, solver.unassigned())
+            qDebug() << "No CRTC can drive output" << m_outputs.value(id)->name();
+        return false;
+    }
+
+    foreach(RandROutput *o, outputs)
+    {
+        RandRCrtc *crtc = m_crtcs.value(solver.crtc(o->id()));
+        RandRCrtc *previous = o->crtc();
+        if (!crtc || crtc == previous)
+            continue;
+
+        qDebug() << "Assigning CRTC" << crtc->id() << "to output" << o->name();
+        o->moveToCrtc(crtc);
+        if (transaction)
+        {
+            transaction->addCrtc(previous);
+            if (o != output)
+                o->stageProposed(*transaction);
+        }
+    }
+    return true;
 }
 
 bool RandRScreen::applyProposed(bool confirm)
 {
     qDebug() << "Applying proposed changes for screen" << m_index << "...";
 
-    bool succeed = true;
-    QRect r;
+    // a change waiting for confirmation is kept when the next one is made
+    if (m_confirmation)
+        m_confirmation->accept();
 
-    foreach(RandROutput *output, m_outputs) {
-        /*
-        r = output->rect();
-        RandROutput::Relation outputRelation;
-        RandROutput *related = output->relation(&outputRelation);
+    RandRTransaction transaction(this);
+    bool succeed = stageProposed(transaction) && transaction.commit();
+    return finishApply(transaction, succeed, confirm);
+}
 
-        if(!related) {
-            r.setTopLeft(QPoint(0, 0));
-        }
-        QRect relativeRect = related->rect();
-
-        switch(outputRelation) {
-        case RandROutput::LeftOf:
-            r.setTopLeft(QPoint(relativeRect.x() - r.x(),
-                                relativeRect.y()));
-        case RandROutput::RightOf:
-            r.setTopLeft(QPoint(relativeRect.x() + r.x(),
-                                relativeRect.y()));
-        case RandROutput::Over:
-            r.setTopLeft(QPoint(relativeRect.x(),
-                                relativeRect.y() - r.y()));
-        case RandROutput::Under:
-            r.setTopLeft(QPoint(relativeRect.x(),
-                                relativeRect.y() + r.y()));
-
-        case RandROutput::SameAs:
-            r.setTopLeft(related->rect().topLeft());
-            break;
-        }
-        output->proposeRect(r);
-        */
-        if(!output->applyProposed()) {
-            succeed = false;
-            break;
-        }
+bool RandRScreen::applyProposedAsync(bool confirm)
+{
+    if (m_applying)
+    {
+        qDebug() << "The previous changes of screen" << m_index << "are still being applied";
+        return false;
     }
-    /*
+
+    if (!m_worker)
+    {
+        bool succeed = applyProposed(confirm);
+        emit applied(succeed);
+        return succeed;
+    }
+
+    qDebug() << "Applying proposed changes for screen" << m_index << "on the worker thread...";
+    if (m_confirmation)
+        m_confirmation->accept();
+
+    // the plan is made here, from the model; the worker only sends it
+    RandRTransaction *transaction = new RandRTransaction(this);
+    bool succeed;
+    {
+        RandRStats::Scope scope(RandRStats::Commit);
+        succeed = stageProposed(*transaction) && transaction->prepare();
+    }
+    if (!succeed || transaction->isEmpty())
+    {
+        succeed = finishApply(*transaction, succeed, confirm);
+        delete transaction;
+        emit applied(succeed);
+        return succeed;
+    }
+
+    m_applying = transaction;
+    m_applyConfirm = confirm;
+    m_worker->requestApply(m_index, m_applying);
+    return true;
+}
+
+bool RandRScreen::isApplying() const
+{
+    return m_applying != 0;
+}
+
+void RandRScreen::slotApplyProgress(int screen, int done, int total)
+{
+    if (screen == m_index && m_applying)
+        emit applyProgress(done, total);
+}
+
+void RandRScreen::slotApplied(int screen, bool sent)
+{
+    if (screen != m_index || !m_applying)
+        return;
+
+    RandRTransaction *transaction = m_applying;
+    m_applying = 0;
+
+    bool succeed = transaction->finish(sent);
+    succeed = finishApply(*transaction, succeed, m_applyConfirm);
+    delete transaction;
+    emit applied(succeed);
+}
+
+bool RandRScreen::stageProposed(RandRTransaction &transaction)
+{
+    RandRStats::Scope scope(RandRStats::Plan);
+    RandRTrace::Span span("plan");
+
+    // stage every output first, the whole layout is then applied at once.
+    // The crtcs are chosen before anything is sent to the server
+    if (!assignCrtcs())
+        return false;
     foreach(RandROutput *output, m_outputs)
     {
-        r = output->rect();
-        if (!output->applyProposed())
-        {
-            succeed = false;
-            break;
-        }
-    }*/
+        if (!output->stageProposed(transaction))
+            return false;
+    }
+
+    // crtcs that lost their outputs have to be turned off too
+    foreach(RandRCrtc *crtc, m_crtcs)
+    {
+        if (crtc->isValid() && crtc->proposedChanged())
+            transaction.addCrtc(crtc);
+    }
+    return true;
+}
+
+bool RandRScreen::finishApply(const RandRTransaction &transaction, bool succeed, bool confirm)
+{
     if (succeed)
     {
         setPrimaryOutput(m_proposedPrimaryOutput);
+        m_previousCrtcs = transaction.originalCrtcs();
+        qDebug() << "Changes have been applied to all outputs.";
     }
 
-    qDebug() << "Changes have been applied to all outputs.";
-
-    // if we could apply the config clean, ask for confirmation
+    // if we could apply the config clean, ask for confirmation. The
+    // settings are saved once the user keeps them
     if (succeed && confirm)
-        succeed = RandR::confirm(r);
+    {
+        startConfirmation(transaction);
+        return true;
+    }
 
-    // if we succeeded applying and the user confirmed the changes,
-    // just return from here
     if (succeed)
+    {
+        persist();
         return true;
+    }
 
-    qDebug() << "Changes canceled, reverting to original setup.";
+    // a failed commit has already restored the previous configuration
+    restoreProposed();
+    return false;
+}
+
+void RandRScreen::startConfirmation(const RandRTransaction &transaction)
+{
+    if (m_confirmation)
+        m_confirmation->accept();
+
+    m_confirmation = new RandRConfirmation(transaction, this);
+    connect(m_confirmation, SIGNAL(finished(bool)), this, SLOT(slotConfirmationFinished(bool)));
+    m_confirmation->start();
+}
+
+void RandRScreen::slotConfirmationFinished(bool accepted)
+{
+    m_confirmation->deleteLater();
+    m_confirmation = 0;
+
+    // the rollback already put the previous configuration back on the
+    // server and in the model
+    if (accepted)
+        persist();
+    else
+        restoreProposed();
+
+    emit confirmed(accepted);
+}
 
-    //Revert changes if not succeed
+void RandRScreen::persist()
+{
+    m_originalPrimaryOutput = m_proposedPrimaryOutput;
+    if (!m_persistent)
+        return;
+
+    RandRStats::Scope scope(RandRStats::Plan);
+    RandRTrace::Span span("persist");
+    RandRLayoutStore store;
+    store.open();
+    save(store);
+    // remembered for the next time the same outputs get connected
+    saveLayout(store);
+    store.save();
+
+    // --startup sends the compiled configuration as it is
+    RandRApplyPlan plan;
+    plan.load();
+    compilePlan(plan);
+    plan.save();
+}
+
+void RandRScreen::restoreProposed()
+{
     foreach(RandROutput *o, m_outputs)
     {
         if (o->isConnected())
-        {
             o->proposeOriginal();
-            o->applyProposed();
-        }
     }
 
     m_proposedPrimaryOutput = m_originalPrimaryOutput;
     setPrimaryOutput(m_proposedPrimaryOutput);
-    return false;
 }
 
 void RandRScreen::unifyOutputs()
@@ -585,6 +1165,7 @@ void RandRScreen::unifyOutputs()
     qDebug() << "Unifying outputs using rect " << m_unifiedRect;
     // iterate over all outputs and make sure all connected outputs get activated
     // and use the right size
+    RandRTransaction transaction(this);
     foreach(RandROutput *o, m_outputs)
     {
         // if the output is not connected we don't need to do anything
@@ -601,8 +1182,9 @@ void RandRScreen::unifyOutputs()
         //o->load(cfg);
         o->proposeRect(m_unifiedRect);
         o->proposeRotation(m_unifiedRotation);
-        o->applyProposed(RandR::ChangeRect | RandR::ChangeRotation, false);
+        o->stageProposed(transaction, RandR::ChangeRect | RandR::ChangeRotation);
     }
+    transaction.commit();
 
     // FIXME: if by any reason we were not able to unify the outputs, we should
     // do something
@@ -619,16 +1201,24 @@ void RandRScreen::slotResizeUnified(QAction *action)
 void RandRScreen::slotUnifyOutputs(bool unified)
 {
     m_outputsUnified = unified;
-    QSettings cfg;
 
     if (!unified || m_connectedCount <= 1)
     {
+        RandRLayoutStore store;
+        store.open();
+
+        RandRTransaction transaction(this);
         foreach(RandROutput *output, m_outputs)
             if (output->isConnected())
             {
-                output->load(cfg);
-                output->applyProposed();
+                output->load(store);
+                output->stageProposed(transaction);
             }
+        if (transaction.commit())
+        {
+            save(store);
+            store.save();
+        }
     }
     else
     {
@@ -655,9 +1245,21 @@ void RandRScreen::slotRotateUnified(QAction *action)
 
 void RandRScreen::slotOutputChanged(RROutput id, int changes)
 {
-    Q_UNUSED(id);
     Q_UNUSED(changes);
 
+    if (!m_pendingChanges.added.contains(id) && !m_pendingChanges.changed.contains(id))
+        m_pendingChanges.changed.append(id);
+
+    // a reload counts and reports everything once it is done
+    if (m_reloading)
+        return;
+
+    updateCounts();
+    scheduleUpdate(false);
+}
+
+void RandRScreen::updateCounts()
+{
     int connected = 0, active = 0;
     foreach(RandROutput *output, m_outputs)
     {
@@ -669,8 +1271,4 @@ void RandRScreen::slotOutputChanged(RROutput id, int changes)
 
     m_connectedCount = connected;
     m_activeCount = active;
-
-    // if there is less than 2 outputs connected, there is no need to unify
-    if (connected <= 1)
-        return;
 }
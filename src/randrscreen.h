@@ -21,53 +21,127 @@
 #define RANDRSCREEN_H
 
 #include "randr.h"
+#include "randrmodematrix.h"
+#include "randrsnapshot.h"
 #include <QtGui/QX11Info>
 #include <QtCore/QObject>
 #include <QtCore/QMap>
+#include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QSharedPointer>
 
 class QSize;
 class QAction;
-class QSettings;
+class RandRLayoutStore;
+class RandRApplyPlan;
+class RandRTransaction;
+class RandRConfirmation;
+class RandRBackend;
+class RandRWorker;
+
+/** What changed in a screen since the last notification. */
+struct RandRChangeSet
+{
+    RandRChangeSet();
+    bool isEmpty() const;
+    void clear();
+
+    OutputList added;
+    OutputList removed;
+    OutputList changed;
+    CrtcList crtcs;
+    /** The screen size changed */
+    bool resized;
+    /** Started when the first event of the batch was received */
+    QElapsedTimer since;
+};
 
 class RandRScreen : public QObject
 {
     Q_OBJECT
 
 public:
-    RandRScreen(int screenIndex);
+    /** The screen @p screenIndex of @p backend, RandRBackend::instance()
+     * by default. It is loaded from @p snapshot if it is valid, probed
+     * otherwise. */
+    RandRScreen(int screenIndex, RandRBackend *backend = 0,
+                const RandRSnapshot &snapshot = RandRSnapshot());
     ~RandRScreen();
 
     int index() const;
+    /** The server of the screen, used by its outputs and CRTCs too. */
+    RandRBackend *backend() const;
+
+    /** The last time the configuration of the screen was changed, as
+     * reported by the server. Each screen keeps its own. */
+    Time timestamp() const;
+    void setTimestamp(Time timestamp);
 
     XRRScreenResources* resources() const;
+    /** The same resources, kept alive for as long as the caller holds
+     * them even if the screen is reloaded. */
+    QSharedPointer<XRRScreenResources> sharedResources() const;
     Window rootWindow() const;
 
     QSize minSize() const;
     QSize maxSize() const;
 
+    /** Bring the screen in sync with the server. Outputs and CRTCs that
+     * appeared are created, the ones that vanished are deleted and the
+     * others updated. With @p notify, the differences are reported through
+     * changed() right away. */
     void loadSettings(bool notify = false);
-
+    /** Bring the screen in line with @p snapshot, as loadSettings() does
+     * with a probe made on the spot. */
+    void loadSnapshot(const RandRSnapshot &snapshot, bool notify = false);
+
+    /** Once set, the reloads asked for by the server's events are probed
+     * by @p worker, and applyProposedAsync() sends the changes through
+     * it. */
+    void setWorker(RandRWorker *worker);
+
+    /** Whether the changes that are kept are saved in the layout store
+     * and the apply plan. They are keyed by the screen index only, so a
+     * single display of the process may save them. Set by default. */
+    void setPersistent(bool persistent);
+
+    /** Ask for the next loadSettings() to poll the outputs again instead of
+     * using the server's cached configuration. */
+    void requestReprobe();
+
+    /** Events only mark the screen as out of date, every event received
+     * within UpdateDelay ms is handled by a single reload. */
     void handleEvent(XRRScreenChangeNotifyEvent* event);
     void handleRandREvent(XRRNotifyEvent* event);
 
-    CrtcMap  crtcs() const;
+    const CrtcMap &crtcs() const;
     RandRCrtc *crtc(RRCrtc id) const;
 
-    OutputMap outputs() const;
+    const OutputMap &outputs() const;
     RandROutput *output(RROutput id) const;
 
-#ifdef HAS_RANDR_1_3
+    /** The primary output, set on the server. Only RandR 1.3 has one,
+     * with an older server there is none and nothing is set. */
     void setPrimaryOutput(RandROutput* output);
     RandROutput* primaryOutput();
-#endif
 
     void proposePrimaryOutput(RandROutput* output);
 
-    ModeMap modes() const;
+    const ModeMap &modes() const;
     RandRMode mode(RRMode id) const;
 
+    /** The modes and sizes supported by every output. */
+    const RandRModeMatrix &modeMatrix() const;
+    /** Called by an output whose mode list changed. */
+    void setOutputModes(RROutput output, const ModeList &modes);
+
     bool adjustSize(const QRect &minimumSize = QRect(0,0,0,0));
     bool setSize(const QSize &s);
+    /** The physical size in millimeters setSize() gives the screen for
+     * @p s, keeping its DPI. */
+    QSize sizeMM(const QSize &s) const;
+    /** Take note of the size a RandRTransaction gave the screen. */
+    void commitSize(const QSize &s);
 
     /**
      * Return the number of connected outputs
@@ -87,11 +161,51 @@ public:
 
     QRect rect() const;
 
+    /** Apply the proposed configuration of every output at once. With
+     * @p confirm, it returns as soon as the change is in place and the
+     * user is asked to keep it in the background; the settings are saved,
+     * or the previous configuration restored, when confirmed() is
+     * emitted. */
     bool applyProposed(bool confirm);
-
-    void load(QSettings &config, bool skipOutputs = false);
-    void save(QSettings  &config);
-    QStringList startupCommands() const;
+    /** Same as applyProposed(), but the changes are sent by the worker
+     * thread while the event loop keeps running. applyProgress() reports
+     * how far it got and applied() its result. Without a worker it is
+     * done on the spot. Returns false if the changes could not be
+     * planned, or others are still being sent. */
+    bool applyProposedAsync(bool confirm);
+    /** Whether applyProposedAsync() is waiting for the worker. */
+    bool isApplying() const;
+
+    /** Ask the user to keep the configuration set by @p transaction, it
+     * is rolled back otherwise. A confirmation still pending is accepted
+     * first. */
+    void startConfirmation(const RandRTransaction &transaction);
+
+    /** Assign a CRTC to every connected output that is proposed to be on,
+     * and to @p output, without sending anything. Outputs are moved to
+     * another CRTC only if that is needed to drive all of them. With a
+     * @p transaction, the outputs moved and the CRTCs they leave are
+     * staged in it. Returns false, leaving the outputs as they are, if
+     * there is no assignment for all of them. */
+    bool assignCrtcs(RandROutput *output = 0, RandRTransaction *transaction = 0);
+
+    /** Load the settings saved in @p layout, the default ones if it is
+     * empty. */
+    void load(const RandRLayoutStore &store, const QString &layout = QString(),
+              bool skipOutputs = false);
+    void save(RandRLayoutStore &store, const QString &layout = QString());
+
+    /** The name the settings of the currently connected outputs are
+     * saved under, made of the sorted settings keys of the outputs. */
+    QString layoutName() const;
+    /** Load the settings saved for the currently connected outputs.
+     * @returns false if there are none */
+    bool loadLayout(const RandRLayoutStore &store);
+    void saveLayout(RandRLayoutStore &store);
+
+    /** Replace the operations of this screen in @p plan with the ones
+     * setting its current configuration. */
+    void compilePlan(RandRApplyPlan &plan) const;
 
 public slots:
     void slotUnifyOutputs(bool unify);
@@ -105,11 +219,33 @@ public slots:
 
 signals:
     void configChanged();
+    /** Emitted once per batch of changes, together with configChanged(). */
+    void changed(const RandRChangeSet &changes);
+    /** The user kept the last applied configuration, or it was rolled
+     * back. */
+    void confirmed(bool accepted);
+    /** @p done of the @p total CRTC and size changes of
+     * applyProposedAsync() are in place. */
+    void applyProgress(int done, int total);
+    /** applyProposedAsync() is over. With a confirmation, confirmed()
+     * follows. */
+    void applied(bool succeeded);
 
 protected slots:
     void unifyOutputs();
 
+private slots:
+    void slotCrtcChanged(RRCrtc id, int changes);
+    /** Reload if an event asked for it and report the pending changes. */
+    void slotUpdate();
+    void slotConfirmationFinished(bool accepted);
+    void slotProbed(const RandRSnapshot &snapshot);
+    void slotApplyProgress(int screen, int done, int total);
+    void slotApplied(int screen, bool sent);
+
 private:
+    RandRBackend *m_backend;
+    Time m_timestamp;
     int m_index;
     QSize m_minSize;
     QSize m_maxSize;
@@ -122,16 +258,51 @@ private:
     int m_connectedCount;
     int m_activeCount;
 
-#ifdef HAS_RANDR_1_3
     RandROutput* m_originalPrimaryOutput;
     RandROutput* m_proposedPrimaryOutput;
-#endif //HAS_RANDR_1_3
 
-    XRRScreenResources* m_resources;
+    /** The last change, while the user has not confirmed it */
+    RandRConfirmation *m_confirmation;
+    /** The CRTC each output had before the last change, compilePlan()
+     * turns it off before moving the output */
+    QMap<RROutput, RRCrtc> m_previousCrtcs;
+
+    /** Stage the proposed configuration of every output in
+     * @p transaction. */
+    bool stageProposed(RandRTransaction &transaction);
+    /** What is left to do once @p transaction was committed, or not. */
+    bool finishApply(const RandRTransaction &transaction, bool succeed, bool confirm);
+    /** Save the current configuration for the next time and for
+     * --startup. */
+    void persist();
+    /** Propose again the configuration before the last change. */
+    void restoreProposed();
+    /** The gamma timestamps of the CRTCs, see RandRCrtc::gammaTimestamp() */
+    QMap<RRCrtc, Time> gammaTimestamps() const;
+    void scheduleUpdate(bool reload);
+    void flushChanges();
+    void updateCounts();
+
+    QSharedPointer<XRRScreenResources> m_resources;
+    bool m_needsReprobe;
+
+    RandRWorker *m_worker;
+    /** A probe was sent to the worker and did not come back yet */
+    bool m_probing;
+    /** The transaction the worker is sending */
+    RandRTransaction *m_applying;
+    bool m_applyConfirm;
+
+    QTimer m_updateTimer;
+    bool m_reloadPending;
+    bool m_reloading;
+    bool m_persistent;
+    RandRChangeSet m_pendingChanges;
 
     CrtcMap m_crtcs;
     OutputMap m_outputs;
     ModeMap m_modes;
+    RandRModeMatrix m_modeMatrix;
 
 };
 
@@ -0,0 +1,614 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <unistd.h>
+#include <string.h>
+
+#include "randrsimbackend.h"
+
+// the simulated screen 0
+static const Window SimRootWindow = 0x100;
+// first XID given to the modes, CRTCs and outputs
+static const XID SimFirstId = 0x200;
+// used for the physical size until setScreenSize() gives one
+static const double SimDpi = 96.0;
+
+RandRSimBackend::RandRSimBackend()
+    : m_nextId(SimFirstId),
+      m_timestamp(1),
+      m_configTimestamp(1),
+      m_size(1024, 768),
+      m_minSize(320, 200),
+      m_maxSize(8192, 8192),
+      m_primary(None),
+      m_grabs(0),
+      m_roundTripDelay(0),
+      m_requests(0),
+      m_roundTrips(0),
+      m_modesets(0)
+{
+    m_sizeMM = QSize(qRound(m_size.width() * 25.4 / SimDpi),
+                     qRound(m_size.height() * 25.4 / SimDpi));
+}
+
+RandRSimBackend::~RandRSimBackend()
+{
+}
+
+RRMode RandRSimBackend::addMode(int width, int height, float refresh)
+{
+    Mode mode;
+    mode.size = QSize(width, height);
+    mode.refresh = refresh;
+    mode.name = QString("%1x%2").arg(width).arg(height).toLatin1();
+
+    RRMode id = m_nextId++;
+    m_modes.insert(id, mode);
+    m_configTimestamp = ++m_timestamp;
+    return id;
+}
+
+RRCrtc RandRSimBackend::addCrtc(int gammaSize, int rotations)
+{
+    Crtc crtc;
+    crtc.mode = None;
+    crtc.rotation = RR_Rotate_0;
+    crtc.rotations = rotations;
+    memset(&crtc.transform, 0, sizeof(crtc.transform));
+    crtc.transform.matrix[0][0] = crtc.transform.matrix[1][1] = crtc.transform.matrix[2][2] = XDoubleToFixed(1.0);
+    crtc.gamma = QVector<unsigned short>(gammaSize * 3);
+    for (int i = 0; i < gammaSize; ++i)
+    {
+        unsigned short value = gammaSize > 1 ? (i * 65535) / (gammaSize - 1) : 65535;
+        crtc.gamma[i] = crtc.gamma[gammaSize + i] = crtc.gamma[2 * gammaSize + i] = value;
+    }
+
+    RRCrtc id = m_nextId++;
+    m_crtcs.insert(id, crtc);
+    m_configTimestamp = ++m_timestamp;
+    return id;
+}
+
+RROutput RandRSimBackend::addOutput(const QString &name, const CrtcList &possible,
+                                    const ModeList &modes, bool connected, int npreferred,
+                                    const QByteArray &edid)
+{
+    Output output;
+    output.name = name;
+    output.possible = possible;
+    output.modes = modes;
+    output.connected = connected;
+    output.npreferred = qMin(npreferred, modes.count());
+    output.edid = edid;
+
+    RROutput id = m_nextId++;
+    m_outputs.insert(id, output);
+    m_configTimestamp = ++m_timestamp;
+    return id;
+}
+
+void RandRSimBackend::setClones(const OutputList &outputs)
+{
+    foreach(RROutput id, outputs)
+    {
+        Q_ASSERT(m_outputs.contains(id));
+        OutputList clones = outputs;
+        clones.removeAll(id);
+        m_outputs[id].clones = clones;
+    }
+    m_configTimestamp = ++m_timestamp;
+}
+
+void RandRSimBackend::setScreenSizeRange(const QSize &minSize, const QSize &maxSize)
+{
+    m_minSize = minSize;
+    m_maxSize = maxSize;
+    m_size = m_size.expandedTo(minSize).boundedTo(maxSize);
+}
+
+void RandRSimBackend::setConnected(RROutput output, bool connected)
+{
+    Q_ASSERT(m_outputs.contains(output));
+    m_outputs[output].connected = connected;
+    m_configTimestamp = ++m_timestamp;
+}
+
+void RandRSimBackend::setRoundTripDelay(int usec)
+{
+    m_roundTripDelay = usec;
+}
+
+int RandRSimBackend::requests() const
+{
+    return m_requests;
+}
+
+int RandRSimBackend::roundTrips() const
+{
+    return m_roundTrips;
+}
+
+int RandRSimBackend::modesets() const
+{
+    return m_modesets;
+}
+
+void RandRSimBackend::resetCounters()
+{
+    m_requests = 0;
+    m_roundTrips = 0;
+    m_modesets = 0;
+}
+
+void RandRSimBackend::request(bool reply)
+{
+    ++m_requests;
+    if (!reply)
+        return;
+
+    ++m_roundTrips;
+    if (m_roundTripDelay > 0)
+        usleep(m_roundTripDelay);
+}
+
+QSize RandRSimBackend::crtcSize(const Crtc &crtc) const
+{
+    if (crtc.mode == None || !m_modes.contains(crtc.mode))
+        return QSize();
+
+    QSize size = m_modes.value(crtc.mode).size;
+    if (crtc.rotation & (RR_Rotate_90 | RR_Rotate_270))
+        size.transpose();
+    return size;
+}
+
+RRCrtc RandRSimBackend::crtcOf(RROutput output) const
+{
+    QMap<RRCrtc, Crtc>::const_iterator it;
+    for (it = m_crtcs.constBegin(); it != m_crtcs.constEnd(); ++it)
+    {
+        if (it.value().outputs.contains(output))
+            return it.key();
+    }
+    return None;
+}
+
+Display *RandRSimBackend::display() const
+{
+    return 0;
+}
+
+bool RandRSimBackend::queryExtension(int &eventBase, int &errorBase)
+{
+    request(true);
+    eventBase = 89;
+    errorBase = 147;
+    return true;
+}
+
+bool RandRSimBackend::queryVersion(int &major, int &minor)
+{
+    request(true);
+    major = 1;
+    minor = 3;
+    return true;
+}
+
+int RandRSimBackend::screenCount()
+{
+    return 1;
+}
+
+int RandRSimBackend::defaultScreen()
+{
+    return 0;
+}
+
+Window RandRSimBackend::rootWindow(int screen)
+{
+    Q_ASSERT(screen == 0);
+    Q_UNUSED(screen);
+    return SimRootWindow;
+}
+
+QSize RandRSimBackend::screenSize(int screen)
+{
+    Q_UNUSED(screen);
+    return m_size;
+}
+
+QSize RandRSimBackend::screenSizeMM(int screen)
+{
+    Q_UNUSED(screen);
+    return m_sizeMM;
+}
+
+bool RandRSimBackend::screenSizeRange(Window root, QSize &minSize, QSize &maxSize)
+{
+    Q_UNUSED(root);
+    request(true);
+    minSize = m_minSize;
+    maxSize = m_maxSize;
+    return true;
+}
+
+void RandRSimBackend::setScreenSize(Window root, const QSize &size, const QSize &sizeMM)
+{
+    Q_UNUSED(root);
+    request(false);
+
+    if (size.width() < m_minSize.width() || size.height() < m_minSize.height() ||
+        size.width() > m_maxSize.width() || size.height() > m_maxSize.height())
+    {
+        qDebug() << "[RandRSimBackend] Screen size" << size << "out of range";
+        return;
+    }
+
+    // like the server, refuse to cut off an active CRTC
+    foreach(const Crtc &crtc, m_crtcs)
+    {
+        if (crtc.mode != None && !QRect(QPoint(0, 0), size).contains(QRect(crtc.pos, crtcSize(crtc))))
+        {
+            qDebug() << "[RandRSimBackend] Screen size" << size << "smaller than the CRTCs";
+            return;
+        }
+    }
+
+    m_size = size;
+    m_sizeMM = sizeMM;
+    m_timestamp++;
+}
+
+void RandRSimBackend::selectInput(Window root, int mask)
+{
+    Q_UNUSED(root);
+    Q_UNUSED(mask);
+    request(false);
+}
+
+XRRScreenResources *RandRSimBackend::screenResources(Window root, bool poll)
+{
+    Q_UNUSED(root);
+    Q_UNUSED(poll);
+    request(true);
+
+    XRRScreenResources *res = new XRRScreenResources;
+    memset(res, 0, sizeof(XRRScreenResources));
+    res->timestamp = m_timestamp;
+    res->configTimestamp = m_configTimestamp;
+
+    res->ncrtc = m_crtcs.count();
+    res->crtcs = new RRCrtc[res->ncrtc];
+    int i = 0;
+    foreach(RRCrtc id, m_crtcs.keys())
+        res->crtcs[i++] = id;
+
+    res->noutput = m_outputs.count();
+    res->outputs = new RROutput[res->noutput];
+    i = 0;
+    foreach(RROutput id, m_outputs.keys())
+        res->outputs[i++] = id;
+
+    res->nmode = m_modes.count();
+    res->modes = new XRRModeInfo[res->nmode];
+    i = 0;
+    QMap<RRMode, Mode>::const_iterator it;
+    for (it = m_modes.constBegin(); it != m_modes.constEnd(); ++it, ++i)
+    {
+        const Mode &mode = it.value();
+        XRRModeInfo &info = res->modes[i];
+        memset(&info, 0, sizeof(XRRModeInfo));
+        info.id = it.key();
+        info.width = mode.size.width();
+        info.height = mode.size.height();
+        // no blanking, the dot clock gives the refresh rate
+        info.hTotal = info.width;
+        info.vTotal = info.height;
+        info.dotClock = (unsigned long) (mode.refresh * info.hTotal * info.vTotal);
+        info.name = qstrdup(mode.name.constData());
+        info.nameLength = mode.name.length();
+    }
+
+    return res;
+}
+
+void RandRSimBackend::freeScreenResources(XRRScreenResources *resources)
+{
+    if (!resources)
+        return;
+
+    for (int i = 0; i < resources->nmode; ++i)
+        delete [] resources->modes[i].name;
+    delete [] resources->modes;
+    delete [] resources->outputs;
+    delete [] resources->crtcs;
+    delete resources;
+}
+
+bool RandRSimBackend::crtcInfo(XRRScreenResources *resources, RRCrtc crtc, RandRCrtcInfo &info)
+{
+    Q_UNUSED(resources);
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return false;
+
+    const Crtc &c = m_crtcs[crtc];
+    info.id = crtc;
+    info.timestamp = m_timestamp;
+    info.rect = QRect(c.pos, crtcSize(c));
+    info.mode = c.mode;
+    info.rotation = c.rotation;
+    info.rotations = c.rotations;
+    info.outputs = c.outputs;
+
+    info.possible.clear();
+    QMap<RROutput, Output>::const_iterator it;
+    for (it = m_outputs.constBegin(); it != m_outputs.constEnd(); ++it)
+    {
+        if (it.value().possible.contains(crtc))
+            info.possible.append(it.key());
+    }
+    return true;
+}
+
+bool RandRSimBackend::crtcPanning(XRRScreenResources *resources, RRCrtc crtc, QRect &panning)
+{
+    Q_UNUSED(resources);
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return false;
+
+    panning = m_crtcs[crtc].panning;
+    return true;
+}
+
+bool RandRSimBackend::crtcTransform(RRCrtc crtc, XTransform &transform, QByteArray &filter)
+{
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return false;
+
+    transform = m_crtcs[crtc].transform;
+    filter = m_crtcs[crtc].filter;
+    return true;
+}
+
+bool RandRSimBackend::crtcGamma(RRCrtc crtc, RandRCrtcInfo &info)
+{
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return false;
+
+    const QVector<unsigned short> &gamma = m_crtcs[crtc].gamma;
+    int size = gamma.count() / 3;
+    info.red = gamma.mid(0, size);
+    info.green = gamma.mid(size, size);
+    info.blue = gamma.mid(2 * size, size);
+    return true;
+}
+
+int RandRSimBackend::crtcGammaSize(RRCrtc crtc)
+{
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return 0;
+
+    return m_crtcs[crtc].gamma.count() / 3;
+}
+
+bool RandRSimBackend::outputInfo(XRRScreenResources *resources, RROutput output, RandROutputInfo &info)
+{
+    Q_UNUSED(resources);
+    request(true);
+    if (!m_outputs.contains(output))
+        return false;
+
+    const Output &o = m_outputs[output];
+    info.id = output;
+    info.timestamp = m_timestamp;
+    info.crtc = crtcOf(output);
+    info.name = o.name;
+    info.connection = o.connected ? RR_Connected : RR_Disconnected;
+    info.crtcs = o.possible;
+    info.clones = o.clones;
+    info.modes = o.connected ? o.modes : ModeList();
+    info.npreferred = o.connected ? o.npreferred : 0;
+    return true;
+}
+
+QByteArray RandRSimBackend::edid(RROutput output)
+{
+    request(true);
+    if (!m_outputs.contains(output) || !m_outputs[output].connected)
+        return QByteArray();
+
+    return m_outputs[output].edid;
+}
+
+bool RandRSimBackend::isEdidProperty(Atom property)
+{
+    // there are no property events
+    Q_UNUSED(property);
+    return false;
+}
+
+RROutput RandRSimBackend::outputPrimary(Window root)
+{
+    Q_UNUSED(root);
+    request(true);
+    return m_primary;
+}
+
+Status RandRSimBackend::setCrtcConfig(XRRScreenResources *resources, RRCrtc crtc, const QPoint &pos,
+                                      RRMode mode, int rotation, const OutputList &outputs)
+{
+    request(true);
+
+    if (!resources || resources->configTimestamp != m_configTimestamp)
+        return RRSetConfigInvalidConfigTime;
+    if (!m_crtcs.contains(crtc))
+        return RRSetConfigFailed;
+
+    Crtc &c = m_crtcs[crtc];
+    if (mode == None || outputs.isEmpty())
+    {
+        if (mode != None || !outputs.isEmpty())
+            return RRSetConfigFailed;
+
+        if (c.mode != None)
+            ++m_modesets;
+        c.mode = None;
+        c.outputs.clear();
+        m_timestamp++;
+        return RRSetConfigSuccess;
+    }
+
+    if (!m_modes.contains(mode) || !(c.rotations & rotation))
+        return RRSetConfigFailed;
+
+    foreach(RROutput id, outputs)
+    {
+        if (!m_outputs.contains(id))
+            return RRSetConfigFailed;
+
+        const Output &o = m_outputs[id];
+        if (!o.possible.contains(crtc) || !o.modes.contains(mode))
+        {
+            qDebug() << "[RandRSimBackend] Output" << o.name << "can't take mode" << mode
+                     << "on CRTC" << crtc;
+            return RRSetConfigFailed;
+        }
+        foreach(RROutput other, outputs)
+        {
+            if (other != id && !o.clones.contains(other))
+                return RRSetConfigFailed;
+        }
+    }
+
+    Crtc proposed = c;
+    proposed.pos = pos;
+    proposed.mode = mode;
+    proposed.rotation = rotation;
+    if (!QRect(QPoint(0, 0), m_size).contains(QRect(pos, crtcSize(proposed))))
+    {
+        qDebug() << "[RandRSimBackend] CRTC" << crtc << "doesn't fit in the screen";
+        return RRSetConfigFailed;
+    }
+
+    // an output taken from another CRTC leaves it, turning it off if it
+    // was the last one
+    QMap<RRCrtc, Crtc>::iterator it;
+    for (it = m_crtcs.begin(); it != m_crtcs.end(); ++it)
+    {
+        if (it.key() == crtc)
+            continue;
+
+        Crtc &other = it.value();
+        foreach(RROutput id, outputs)
+            other.outputs.removeAll(id);
+        if (other.mode != None && other.outputs.isEmpty())
+        {
+            other.mode = None;
+            ++m_modesets;
+        }
+    }
+
+    proposed.outputs = outputs;
+    c = proposed;
+    ++m_modesets;
+    m_timestamp++;
+    return RRSetConfigSuccess;
+}
+
+void RandRSimBackend::setCrtcTransform(RRCrtc crtc, XTransform *transform, const char *filter)
+{
+    // the transform is only applied with the next configuration, which
+    // the simulation does not scale; it is kept to be read back
+    request(false);
+    if (!m_crtcs.contains(crtc) || !transform)
+        return;
+
+    m_crtcs[crtc].transform = *transform;
+    m_crtcs[crtc].filter = filter;
+}
+
+Status RandRSimBackend::setPanning(XRRScreenResources *resources, RRCrtc crtc, const QRect &area)
+{
+    Q_UNUSED(resources);
+    request(true);
+    if (!m_crtcs.contains(crtc))
+        return RRSetConfigFailed;
+
+    m_crtcs[crtc].panning = area;
+    m_timestamp++;
+    return RRSetConfigSuccess;
+}
+
+void RandRSimBackend::setCrtcGamma(RRCrtc crtc, int size, const unsigned short *ramps)
+{
+    request(false);
+    if (!m_crtcs.contains(crtc) || m_crtcs[crtc].gamma.count() != size * 3)
+    {
+        qDebug() << "[RandRSimBackend] Bad gamma size" << size << "for CRTC" << crtc;
+        return;
+    }
+
+    QVector<unsigned short> &gamma = m_crtcs[crtc].gamma;
+    for (int i = 0; i < gamma.count(); ++i)
+        gamma[i] = ramps[i];
+}
+
+void RandRSimBackend::setOutputPrimary(Window root, RROutput output)
+{
+    Q_UNUSED(root);
+    request(false);
+    if (output == None || m_outputs.contains(output))
+        m_primary = output;
+}
+
+void RandRSimBackend::grabServer()
+{
+    request(false);
+    ++m_grabs;
+}
+
+void RandRSimBackend::ungrabServer()
+{
+    request(false);
+    Q_ASSERT(m_grabs > 0);
+    --m_grabs;
+}
+
+void RandRSimBackend::sync()
+{
+    request(true);
+}
+
+void RandRSimBackend::flush()
+{
+}
+
+void RandRSimBackend::waitForCrtcChanges(const CrtcList &crtcs, int timeout)
+{
+    // the changes are applied as soon as they are requested
+    Q_UNUSED(crtcs);
+    Q_UNUSED(timeout);
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRSIMBACKEND_H
+#define RANDRSIMBACKEND_H
+
+#include <QtCore/QMap>
+#include <QtCore/QString>
+#include <QtCore/QVector>
+
+#include "randrbackend.h"
+
+/** A RandR server simulated in the process, with a single screen.
+ *
+ * The server is built with addMode(), addCrtc() and addOutput(). It checks
+ * the configurations it is given the way a real server does (config time,
+ * modes and CRTCs possible for the outputs, rotations, screen size) and
+ * counts the requests and round trips the model needs, optionally taking
+ * setRoundTripDelay() for every round trip. There are no events and no X
+ * display, display() returns 0. */
+class RandRSimBackend : public RandRBackend
+{
+public:
+    RandRSimBackend();
+    ~RandRSimBackend();
+
+    /** Add a mode of @p width x @p height at @p refresh Hz. */
+    RRMode addMode(int width, int height, float refresh = 60.0);
+    RRCrtc addCrtc(int gammaSize = 256, int rotations = RR_Rotate_0 | RR_Rotate_90 |
+                                                         RR_Rotate_180 | RR_Rotate_270);
+    /** Add an output that can be driven by the CRTCs in @p possible, the
+     * first @p npreferred modes of @p modes being the preferred ones. */
+    RROutput addOutput(const QString &name, const CrtcList &possible, const ModeList &modes,
+                       bool connected = true, int npreferred = 1,
+                       const QByteArray &edid = QByteArray());
+    /** Make the outputs in @p outputs clones of each other. */
+    void setClones(const OutputList &outputs);
+    void setScreenSizeRange(const QSize &minSize, const QSize &maxSize);
+    /** Plug or unplug the monitor of @p output. Like a hotplug on a real
+     * server, it changes the configuration time. */
+    void setConnected(RROutput output, bool connected);
+    /** Time taken by every round trip, in microseconds. */
+    void setRoundTripDelay(int usec);
+
+    /** Number of requests received since the last resetCounters(). */
+    int requests() const;
+    /** Number of requests that had to wait for a reply. */
+    int roundTrips() const;
+    /** Number of CRTC configurations changed. */
+    int modesets() const;
+    void resetCounters();
+
+    Display *display() const;
+
+    bool queryExtension(int &eventBase, int &errorBase);
+    bool queryVersion(int &major, int &minor);
+
+    int screenCount();
+    int defaultScreen();
+    Window rootWindow(int screen);
+    QSize screenSize(int screen);
+    QSize screenSizeMM(int screen);
+    bool screenSizeRange(Window root, QSize &minSize, QSize &maxSize);
+    void setScreenSize(Window root, const QSize &size, const QSize &sizeMM);
+    void selectInput(Window root, int mask);
+
+    XRRScreenResources *screenResources(Window root, bool poll);
+    void freeScreenResources(XRRScreenResources *resources);
+
+    bool crtcInfo(XRRScreenResources *resources, RRCrtc crtc, RandRCrtcInfo &info);
+    bool crtcPanning(XRRScreenResources *resources, RRCrtc crtc, QRect &panning);
+    bool crtcTransform(RRCrtc crtc, XTransform &transform, QByteArray &filter);
+    bool crtcGamma(RRCrtc crtc, RandRCrtcInfo &info);
+    int crtcGammaSize(RRCrtc crtc);
+    bool outputInfo(XRRScreenResources *resources, RROutput output, RandROutputInfo &info);
+    QByteArray edid(RROutput output);
+    bool isEdidProperty(Atom property);
+    RROutput outputPrimary(Window root);
+
+    Status setCrtcConfig(XRRScreenResources *resources, RRCrtc crtc, const QPoint &pos,
+                         RRMode mode, int rotation, const OutputList &outputs);
+    void setCrtcTransform(RRCrtc crtc, XTransform *transform, const char *filter);
+    Status setPanning(XRRScreenResources *resources, RRCrtc crtc, const QRect &area);
+    void setCrtcGamma(RRCrtc crtc, int size, const unsigned short *ramps);
+    void setOutputPrimary(Window root, RROutput output);
+
+    void grabServer();
+    void ungrabServer();
+    void sync();
+    void flush();
+    void waitForCrtcChanges(const CrtcList &crtcs, int timeout);
+
+private:
+    struct Mode
+    {
+        QSize size;
+        float refresh;
+        QByteArray name;
+    };
+
+    struct Crtc
+    {
+        QPoint pos;
+        RRMode mode;
+        int rotation;
+        int rotations;
+        OutputList outputs;
+        QRect panning;
+        XTransform transform;
+        QByteArray filter;
+        QVector<unsigned short> gamma;
+    };
+
+    struct Output
+    {
+        QString name;
+        CrtcList possible;
+        ModeList modes;
+        OutputList clones;
+        bool connected;
+        int npreferred;
+        QByteArray edid;
+    };
+
+    /** Count a request, and a round trip if it waits for a reply. */
+    void request(bool reply);
+    /** Size of the area scanned out by @p crtc. */
+    QSize crtcSize(const Crtc &crtc) const;
+    RRCrtc crtcOf(RROutput output) const;
+
+    XID m_nextId;
+    Time m_timestamp;
+    Time m_configTimestamp;
+
+    QSize m_size;
+    QSize m_sizeMM;
+    QSize m_minSize;
+    QSize m_maxSize;
+    RROutput m_primary;
+    int m_grabs;
+
+    QMap<RRMode, Mode> m_modes;
+    QMap<RRCrtc, Crtc> m_crtcs;
+    QMap<RROutput, Output> m_outputs;
+
+    int m_roundTripDelay;
+    int m_requests;
+    int m_roundTrips;
+    int m_modesets;
+};
+
+#endif // RANDRSIMBACKEND_H
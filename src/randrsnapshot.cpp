@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+
+#include "randrsnapshot.h"
+#include "randrbackend.h"
+#include "randrstats.h"
+#include "randrtrace.h"
+
+namespace
+{
+
+/** Gives the resources back to the backend that returned them. */
+struct ResourcesDeleter
+{
+    RandRBackend *backend;
+
+    void operator()(XRRScreenResources *resources) const
+    {
+        backend->freeScreenResources(resources);
+    }
+};
+
+}
+
+RandRSnapshot::RandRSnapshot()
+    : screen(-1),
+      polled(false)
+{
+}
+
+RandRSnapshot RandRSnapshot::probe(RandRBackend *backend, int screen, bool poll,
+                                   const QMap<RRCrtc, Time> &gammaTimestamps)
+{
+    RandRStats::Scope scope(RandRStats::Probe);
+    RandRTrace::Span span("snapshot", screen);
+    RandRSnapshot snapshot;
+    snapshot.screen = screen;
+
+    Window root = backend->rootWindow(screen);
+    //FIXME: we should check the status here
+    backend->screenSizeRange(root, snapshot.minSize, snapshot.maxSize);
+
+    QElapsedTimer probeTimer;
+    probeTimer.start();
+    XRRScreenResources *resources = 0;
+
+#ifdef HAS_RANDR_1_3
+    // XRRGetScreenResources makes the server poll every output (reading
+    // EDID over DDC), which is slow. Use the cached configuration unless a
+    // full probe was explicitly asked for.
+    if (backend->has_1_3() && !poll)
+    {
+        resources = backend->screenResources(root, false);
+        // the server has not probed the outputs yet, do it now
+        if (resources && !resources->nmode)
+        {
+            backend->freeScreenResources(resources);
+            resources = 0;
+        }
+    }
+#endif
+
+    if (!resources)
+    {
+        poll = true;
+        resources = backend->screenResources(root, true);
+    }
+    if (!resources)
+        return snapshot;
+
+    // Xlib's resources do not depend on the connection, which may well be
+    // closed before the last copy of the snapshot is gone
+    if (backend->display())
+        snapshot.resources = QSharedPointer<XRRScreenResources>(resources, XRRFreeScreenResources);
+    else
+    {
+        ResourcesDeleter deleter = { backend };
+        snapshot.resources = QSharedPointer<XRRScreenResources>(resources, deleter);
+    }
+    snapshot.polled = poll;
+
+    qDebug() << "Probed screen" << screen << (poll ? "(full reprobe)" : "(cached)")
+             << "in" << probeTimer.elapsed() << "ms";
+
+    // query every crtc and output in one go. After a full probe every
+    // gamma ramp is read again, otherwise only the ones of active crtcs
+    // that changed since the caller last read them
+    RandRProbe probe(resources, backend);
+    for (int i = 0; i < resources->ncrtc; ++i)
+    {
+        RRCrtc id = resources->crtcs[i];
+        probe.addCrtc(id, true, poll ? CurrentTime : gammaTimestamps.value(id, CurrentTime));
+    }
+    for (int i = 0; i < resources->noutput; ++i)
+        probe.addOutput(resources->outputs[i]);
+    probe.run();
+
+    snapshot.crtcs = probe.crtcs();
+    snapshot.outputs = probe.outputs();
+    return snapshot;
+}
+
+bool RandRSnapshot::isValid() const
+{
+    return !resources.isNull();
+}
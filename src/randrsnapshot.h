@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRSNAPSHOT_H
+#define RANDRSNAPSHOT_H
+
+#include <QtCore/QMap>
+#include <QtCore/QMetaType>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QSize>
+
+#include "randrprobe.h"
+
+/** The state of a screen as read from the server at one moment.
+ *
+ * A snapshot is a plain value that is never changed once probe() made it:
+ * RandRWorker takes it on its own thread and hands it to the GUI thread,
+ * where RandRScreen::loadSnapshot() brings the model in line with it. */
+struct RandRSnapshot
+{
+    RandRSnapshot();
+
+    /** Read the state of @p screen through @p backend. With @p poll the
+     * outputs are polled again, otherwise the server's cached
+     * configuration is used if it has one. The gamma ramps of an active
+     * CRTC are only read if it changed after its time in
+     * @p gammaTimestamps. */
+    static RandRSnapshot probe(RandRBackend *backend, int screen, bool poll,
+                               const QMap<RRCrtc, Time> &gammaTimestamps = QMap<RRCrtc, Time>());
+
+    /** Whether the screen resources could be read. */
+    bool isValid() const;
+
+    int screen;
+    /** The outputs were polled */
+    bool polled;
+    QSize minSize;
+    QSize maxSize;
+    /** Released by the backend that returned them once the last copy of
+     * the snapshot is gone */
+    QSharedPointer<XRRScreenResources> resources;
+    QMap<RRCrtc, RandRCrtcInfo> crtcs;
+    QMap<RROutput, RandROutputInfo> outputs;
+};
+
+Q_DECLARE_METATYPE(RandRSnapshot)
+
+#endif // RANDRSNAPSHOT_H
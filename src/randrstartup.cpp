@@ -0,0 +1,605 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QSet>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+#include <string.h>
+
+#include "randrstartup.h"
+#include "randredid.h"
+#include "randrlayoutstore.h"
+#include "randrapplyplan.h"
+#include "randrcrtcsolver.h"
+#include "randrgammalut.h"
+#include "randrtrace.h"
+#include "randrxlibbackend.h"
+
+RandRStartup::OutputState::OutputState()
+    : id(None),
+      connected(false),
+      crtc(None),
+      hasSettings(false),
+      active(false),
+      rotation(RR_Rotate_0),
+      rate(0),
+      brightness(0),
+      red(0),
+      green(0),
+      blue(0),
+      tracking(false),
+      virtualModeEnabled(false),
+      primary(false)
+{
+}
+
+RandRStartup::CrtcExtras::CrtcExtras()
+    : tracking(false),
+      brightness(1.0),
+      red(1.0),
+      green(1.0),
+      blue(1.0)
+{
+}
+
+RandRStartup::RandRStartup(bool reprobe)
+    : m_dpy(0),
+      m_backend(0),
+      m_has_1_3(false),
+      m_reprobe(reprobe)
+{
+    m_total.start();
+    m_timer.start();
+}
+
+RandRStartup::~RandRStartup()
+{
+    delete m_backend;
+    if (m_dpy)
+        XCloseDisplay(m_dpy);
+}
+
+void RandRStartup::phase(const char *name)
+{
+    m_timings.append(qMakePair(QString(name), m_timer.restart()));
+}
+
+void RandRStartup::printTimings() const
+{
+    for (int i = 0; i < m_timings.count(); ++i)
+        qDebug() << "  " << qPrintable(m_timings.at(i).first) << m_timings.at(i).second << "ms";
+    qDebug() << "Startup took" << m_total.elapsed() << "ms";
+}
+
+bool RandRStartup::reprobeRequested(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "-r") || !strcmp(argv[i], "--reprobe"))
+            return true;
+    }
+    return false;
+}
+
+int RandRStartup::run(bool reprobe)
+{
+    RandRTrace::Span span("startup");
+    RandRStartup startup(reprobe);
+    RandRApplyPlan plan;
+    plan.load();
+    RandRLayoutStore store;
+    store.open();
+    startup.phase("store");
+
+    if (store.isEmpty() && plan.isEmpty())
+    {
+        qDebug() << "No settings saved in" << RandRLayoutStore::defaultFileName();
+        qDebug() << "Not load config. Exit without change";
+        return 0;
+    }
+
+    if (!startup.open())
+    {
+        startup.printTimings();
+        return 1;
+    }
+
+    // the plan is only executed if the outputs are the ones it was
+    // compiled for, otherwise the settings are looked up again
+    if (!plan.isEmpty() && startup.executePlan(plan))
+    {
+        startup.printTimings();
+        return 0;
+    }
+
+    bool succeed = startup.apply(store);
+    startup.printTimings();
+    return succeed ? 0 : 1;
+}
+
+bool RandRStartup::executePlan(const RandRApplyPlan &plan)
+{
+    RandRTrace::Span span("execute plan");
+    RandRApplyPlan::Result result = plan.execute(m_backend, m_reprobe);
+    phase("plan");
+
+    if (result == RandRApplyPlan::Outdated)
+        qDebug() << "The apply plan is out of date, applying the saved settings";
+    else if (result == RandRApplyPlan::Failed)
+        qDebug() << "The apply plan failed, applying the saved settings";
+    return result == RandRApplyPlan::Applied;
+}
+
+bool RandRStartup::open(const char *displayName)
+{
+    m_dpy = XOpenDisplay(displayName);
+    if (!m_dpy)
+    {
+        qDebug() << "Cannot open display" << XDisplayName(displayName);
+        return false;
+    }
+    m_backend = new RandRXlibBackend(m_dpy);
+
+    int eventBase, errorBase;
+    if (!m_backend->queryExtension(eventBase, errorBase) || !m_backend->has_1_2())
+    {
+        qDebug() << "RandR 1.2 is not available, the settings cannot be applied.";
+        return false;
+    }
+    m_has_1_3 = m_backend->has_1_3();
+
+    phase("connect");
+    return true;
+}
+
+bool RandRStartup::apply(const RandRLayoutStore &store)
+{
+    bool succeed = true;
+    for (int i = 0; i < m_backend->screenCount(); ++i)
+    {
+        if (!applyScreen(i, store))
+            succeed = false;
+    }
+    return succeed;
+}
+
+bool RandRStartup::applyScreen(int screen, const RandRLayoutStore &store)
+{
+    RandRTrace::Span span("apply screen", screen);
+    Window root = m_backend->rootWindow(screen);
+
+    XRRScreenResources *resources = RandRApplyEngine::readResources(m_backend, root, m_has_1_3, m_reprobe);
+    if (!resources)
+    {
+        qDebug() << "Cannot read the resources of screen" << screen;
+        return false;
+    }
+    RandRApplyEngine engine(m_backend, root, resources);
+    phase("resources");
+
+    QList<OutputState> outputs;
+    readOutputs(resources, outputs);
+    phase("outputs");
+
+    bool primarySaved = readSettings(screen, outputs, store);
+    phase("settings");
+
+    // a crtc that is on drives at least one output, the others don't need
+    // to be read
+    CrtcList used;
+    foreach(const OutputState &output, outputs)
+    {
+        if (output.crtc != None && !used.contains(output.crtc))
+            used.append(output.crtc);
+    }
+    ConfigMap current, target;
+    if (!used.isEmpty())
+        engine.readCrtcs(current, used);
+    phase("crtcs");
+
+    ExtrasMap extras;
+    plan(engine, resources, outputs, current, target, extras);
+
+    // the screen has to hold every crtc that stays on
+    ConfigMap wanted = current;
+    bool changed = false;
+    ConfigMap::const_iterator it;
+    for (it = target.constBegin(); it != target.constEnd(); ++it)
+    {
+        wanted[it.key()] = it.value();
+        if (it.value() != current.value(it.key()))
+            changed = true;
+    }
+    // the panning is not read back, it is set again
+    foreach(const CrtcExtras &crtc, extras)
+    {
+        if (crtc.virtualRect.isValid())
+            changed = true;
+    }
+
+    QSize currentSize = m_backend->screenSize(screen);
+    QSize currentSizeMM = m_backend->screenSizeMM(screen);
+    QSize size = RandRApplyEngine::screenSize(wanted);
+    if (size.isEmpty())
+        size = currentSize;
+    QSize minSize, maxSize;
+    if (m_backend->screenSizeRange(root, minSize, maxSize))
+        size = size.expandedTo(minSize);
+    if (size != currentSize)
+        changed = true;
+    phase("plan");
+
+    bool succeed = true;
+    if (!changed)
+    {
+        qDebug() << "Screen" << screen << "already has the saved configuration";
+        // the modes usually match at login, the colours are set all the same
+        if (hasColours(extras))
+            applyExtras(resources, extras);
+        if (primarySaved)
+            setPrimary(root, outputs);
+    }
+    else if (maxSize.isValid() && (size.width() > maxSize.width() || size.height() > maxSize.height()))
+    {
+        qDebug() << "Screen size" << size << "is larger than the maximum" << maxSize;
+        succeed = false;
+    }
+    else
+    {
+        engine.setState(current, currentSize, currentSizeMM);
+        if (m_has_1_3)
+            engine.setTransforms(transforms(engine, target, extras));
+        succeed = engine.apply(target, size, RandRApplyEngine::sizeMM(size, currentSize, currentSizeMM));
+        if (succeed)
+        {
+            applyExtras(resources, extras);
+            if (primarySaved)
+                setPrimary(root, outputs);
+        }
+    }
+    m_backend->flush();
+    phase("apply");
+
+    m_backend->freeScreenResources(resources);
+    return succeed;
+}
+
+void RandRStartup::readOutputs(XRRScreenResources *resources, QList<OutputState> &outputs)
+{
+    for (int i = 0; i < resources->noutput; ++i)
+    {
+        RandROutputInfo info;
+        if (!m_backend->outputInfo(resources, resources->outputs[i], info))
+            continue;
+
+        OutputState output;
+        output.id = info.id;
+        output.name = info.name;
+        output.connected = (info.connection == RR_Connected);
+        output.crtc = info.crtc;
+        output.crtcs = info.crtcs;
+        output.modes = info.modes;
+        output.clones = info.clones;
+
+        // the same keys as RandROutput::settingsKey()
+        if (output.connected)
+        {
+            output.key = RandREdid::fingerprint(m_backend->edid(output.id));
+            if (output.key.isEmpty())
+                output.key = output.name;
+        }
+
+        outputs.append(output);
+    }
+}
+
+bool RandRStartup::readSettings(int screen, QList<OutputState> &outputs, const RandRLayoutStore &store)
+{
+    // the same lookup as RandRScreen::loadLayout() and RandROutput::load()
+    QStringList keys;
+    foreach(const OutputState &output, outputs)
+    {
+        if (output.connected)
+            keys.append(output.key);
+    }
+    keys.sort();
+
+    QString layout = keys.join("+");
+    if (!store.hasLayout(layout))
+        layout = QString();
+
+    const RandRLayoutStore::Record *settings = store.find(RandRLayoutStore::ScreenRecord, layout, screen);
+    bool unified = settings && settings->hasFlag(RandRLayoutStore::OutputsUnified) && keys.count() > 1;
+    QRect unifiedRect = settings ? settings->rect() : QRect();
+    int unifiedRotation = settings ? settings->rotation : (int) RR_Rotate_0;
+    bool primarySaved = settings && settings->hasFlag(RandRLayoutStore::PrimarySaved);
+
+    for (int i = 0; i < outputs.count(); ++i)
+    {
+        OutputState &output = outputs[i];
+        if (!output.connected)
+            continue;
+
+        settings = 0;
+        if (output.key != output.name)
+            settings = store.find(RandRLayoutStore::MonitorRecord, layout, screen, output.key);
+        if (!settings)
+            settings = store.find(RandRLayoutStore::OutputRecord, layout, screen, output.name);
+        if (!settings)
+            continue;
+
+        output.active = settings->hasFlag(RandRLayoutStore::Active) || unified;
+        if (!unified)
+        {
+            output.rect = settings->rect();
+            output.rotation = settings->rotation;
+        }
+        else if (unifiedRect.isValid())
+        {
+            output.rect = QRect(QPoint(0, 0), unifiedRect.size());
+            output.rotation = unifiedRotation;
+        }
+        output.rate = settings->rate;
+        output.brightness = settings->brightness;
+        output.red = settings->red;
+        output.green = settings->green;
+        output.blue = settings->blue;
+        output.tracking = settings->hasFlag(RandRLayoutStore::Tracking);
+        output.virtualRect = settings->virtualRect();
+        output.virtualModeEnabled = settings->hasFlag(RandRLayoutStore::VirtualModeEnabled);
+        output.primary = settings->hasFlag(RandRLayoutStore::Primary);
+
+        // without a geometry there is nothing to apply to an active output
+        output.hasSettings = !output.active || output.rect.isValid();
+    }
+    return primarySaved;
+}
+
+RRMode RandRStartup::findMode(const RandRApplyEngine &engine, const OutputState &output) const
+{
+    // the modes of an output are listed in order of preference, a saved
+    // rate of 0 means the preferred one
+    RRMode fallback = None;
+    foreach(RRMode mode, output.modes)
+    {
+        const XRRModeInfo *info = engine.modeInfo(mode);
+        if (!info || engine.modeSize(mode, output.rotation) != output.rect.size())
+            continue;
+
+        float rate = 0;
+        if (info->hTotal && info->vTotal)
+            rate = (float) info->dotClock / ((float) info->hTotal * (float) info->vTotal);
+
+        if (output.rate == 0 || qAbs(rate - output.rate) < 0.01)
+            return mode;
+        if (fallback == None)
+            fallback = mode;
+    }
+    return fallback;
+}
+
+void RandRStartup::plan(const RandRApplyEngine &engine, XRRScreenResources *resources,
+                        const QList<OutputState> &outputs, const ConfigMap &current,
+                        ConfigMap &target, ExtrasMap &extras)
+{
+    // every output that stays on gets a crtc before anything is planned,
+    // outputs keep theirs unless another one could not be driven otherwise
+    RandRCrtcSolver solver;
+    for (int i = 0; i < resources->ncrtc; ++i)
+    {
+        RRCrtc crtc = resources->crtcs[i];
+        solver.addCrtc(crtc, current.contains(crtc) && current.value(crtc).mode != None);
+    }
+
+    QList<RROutput> off;
+    QMap<RROutput, RRMode> modes;
+    QList<QPair<QRect, int> > groups;
+    foreach(const OutputState &output, outputs)
+    {
+        if (!output.connected || (output.hasSettings && !output.active))
+        {
+            if (output.crtc != None)
+                off.append(output.id);
+            continue;
+        }
+
+        RRMode mode = output.hasSettings ? findMode(engine, output) : (RRMode) None;
+        if (output.hasSettings && mode == None)
+            qDebug() << "No mode of" << output.name << "matches" << output.rect.size()
+                     << "at" << output.rate << "Hz, leaving it as it is";
+        if (mode == None)
+        {
+            // the output is left as it is, so is its crtc
+            if (output.crtc != None)
+                solver.addOutput(output.id, QList<RRCrtc>() << output.crtc, QList<RROutput>(), output.crtc);
+            continue;
+        }
+        modes.insert(output.id, mode);
+
+        QPair<QRect, int> key(output.rect, output.rotation);
+        int group = groups.indexOf(key);
+        if (group == -1)
+        {
+            groups.append(key);
+            group = groups.count() - 1;
+        }
+        solver.addOutput(output.id, output.crtcs, output.clones, output.crtc, group);
+    }
+
+    if (!solver.solve())
+    {
+        foreach(RROutput id, solver.unassigned())
+        {
+            foreach(const OutputState &output, outputs)
+            {
+                if (output.id == id)
+                    qDebug() << "No free CRTC for" << output.name;
+            }
+        }
+    }
+
+    foreach(const OutputState &output, outputs)
+    {
+        if (!modes.contains(output.id))
+            continue;
+
+        RRCrtc crtc = solver.crtc(output.id);
+        if (crtc == None)
+            continue;
+        // the crtc the output leaves is changed like for the outputs turned off
+        if (output.crtc != None && output.crtc != crtc)
+            off.append(output.id);
+
+        RRMode mode = modes.value(output.id);
+        CrtcConfig config;
+        config.mode = mode;
+        config.pos = output.rect.topLeft();
+        config.rotation = output.rotation;
+        config.outputs.append(output.id);
+        config.extents = QRect(config.pos, engine.modeSize(mode, output.rotation));
+
+        CrtcExtras extra;
+        if (output.virtualModeEnabled && output.virtualRect.isValid())
+        {
+            extra.virtualRect = QRect(config.pos, output.virtualRect.size());
+            extra.tracking = output.tracking;
+            config.extents = extra.virtualRect;
+        }
+        if (output.brightness > 0)
+            extra.brightness = output.brightness;
+        // stores written before the colours were saved have none
+        if (output.red > 0 && output.green > 0 && output.blue > 0)
+        {
+            extra.red = output.red;
+            extra.green = output.green;
+            extra.blue = output.blue;
+        }
+
+        // outputs cloned on the same crtc must agree on its configuration
+        if (target.contains(crtc))
+        {
+            CrtcConfig &shared = target[crtc];
+            if (shared.mode != config.mode || shared.pos != config.pos ||
+                shared.rotation != config.rotation)
+            {
+                qDebug() << "Conflicting settings for the outputs of CRTC" << crtc;
+                continue;
+            }
+            shared.outputs.append(output.id);
+        }
+        else
+        {
+            target.insert(crtc, config);
+            extras.insert(crtc, extra);
+        }
+    }
+
+    // take the outputs that are turned off away from their crtcs, crtcs
+    // without outputs are turned off
+    foreach(RROutput id, off)
+    {
+        foreach(const OutputState &output, outputs)
+        {
+            if (output.id != id)
+                continue;
+
+            if (!target.contains(output.crtc))
+                target.insert(output.crtc, current.value(output.crtc));
+            CrtcConfig &config = target[output.crtc];
+            config.outputs.removeAll(id);
+            if (config.outputs.isEmpty())
+            {
+                config = CrtcConfig();
+                extras.remove(output.crtc);
+            }
+        }
+    }
+}
+
+QMap<RRCrtc, XTransform> RandRStartup::transforms(const RandRApplyEngine &engine, const ConfigMap &target,
+                                                 const ExtrasMap &extras) const
+{
+    // see RandRCrtc::proposedTransform()
+    QMap<RRCrtc, XTransform> transforms;
+    ExtrasMap::const_iterator it;
+    for (it = extras.constBegin(); it != extras.constEnd(); ++it)
+    {
+        const CrtcExtras &extra = it.value();
+        if (!extra.virtualRect.isValid())
+            continue;
+
+        double width = 1.0;
+        double height = 1.0;
+        const CrtcConfig config = target.value(it.key());
+        QSize size = engine.modeSize(config.mode, config.rotation);
+        if (!extra.tracking && size.isValid())
+        {
+            width = (double) extra.virtualRect.width() / (double) size.width();
+            height = (double) extra.virtualRect.height() / (double) size.height();
+        }
+        transforms.insert(it.key(), RandRApplyEngine::scale(width, height));
+    }
+    return transforms;
+}
+
+bool RandRStartup::hasColours(const ExtrasMap &extras)
+{
+    foreach(const CrtcExtras &extra, extras)
+    {
+        if (extra.brightness != 1.0 || extra.red != 1.0 || extra.green != 1.0 || extra.blue != 1.0)
+            return true;
+    }
+    return false;
+}
+
+void RandRStartup::applyExtras(XRRScreenResources *resources, const ExtrasMap &extras)
+{
+    ExtrasMap::const_iterator it;
+    for (it = extras.constBegin(); it != extras.constEnd(); ++it)
+    {
+        const CrtcExtras &extra = it.value();
+        int size = m_backend->crtcGammaSize(it.key());
+        QVector<unsigned short> ramp = RandRGammaLut::ramp(size, extra.brightness,
+                                                           extra.red, extra.green, extra.blue);
+        if (!ramp.isEmpty())
+            m_backend->setCrtcGamma(it.key(), size, ramp.constData());
+
+        if (m_has_1_3 && extra.virtualRect.isValid() &&
+            m_backend->setPanning(resources, it.key(), QRect(QPoint(0, 0), extra.virtualRect.size())) != RRSetConfigSuccess)
+            qDebug() << "Failed to set the panning of CRTC" << it.key();
+    }
+}
+
+void RandRStartup::setPrimary(Window root, const QList<OutputState> &outputs)
+{
+    // see RandRScreen::setPrimaryOutput()
+    if (!m_has_1_3)
+        return;
+
+    RROutput primary = None;
+    foreach(const OutputState &output, outputs)
+    {
+        if (output.connected && output.primary)
+            primary = output.id;
+    }
+
+    if (m_backend->outputPrimary(root) != primary)
+        m_backend->setOutputPrimary(root, primary);
+}
@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef RANDRSTARTUP_H
+#define RANDRSTARTUP_H
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QPair>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <X11/Xlib.h>
+#include <X11/extensions/Xrandr.h>
+#include <config-randr.h>
+
+#include "randrapplyengine.h"
+
+class RandRLayoutStore;
+class RandRApplyPlan;
+class RandRBackend;
+
+/** Applies the saved settings at login without building the model.
+ *
+ * RandRDisplay probes every CRTC and output, including the gamma ramps,
+ * and needs QtGui. This only uses QtCore and Xrandr: it reads the outputs,
+ * the CRTCs that are in use and the settings of the connected monitors,
+ * works out the final configuration and has a RandRApplyEngine send it
+ * only if it differs from the current one.
+ *
+ * When the apply plan compiled by the last change still matches the
+ * server, its requests are sent instead and nothing else is read. */
+class RandRStartup
+{
+public:
+    /** With @p reprobe the outputs are polled instead of using the
+     * server's cached state, see RandR::reprobe. */
+    explicit RandRStartup(bool reprobe = false);
+    ~RandRStartup();
+
+    /** Connect to the X server. @p displayName defaults to $DISPLAY. */
+    bool open(const char *displayName = 0);
+
+    /** Apply the saved settings to every screen. */
+    bool apply(const RandRLayoutStore &store);
+
+    /** Send the requests compiled in @p plan, without reading anything
+     * but the config timestamps. Returns false if it did not apply. */
+    bool executePlan(const RandRApplyPlan &plan);
+
+    /** Print the wall-clock time spent in each phase. */
+    void printTimings() const;
+
+    /** Apply the saved settings, if there are any, to $DISPLAY and print
+     * the timings. The apply plan is used if it is up to date. Returns
+     * the exit code for the startup program. */
+    static int run(bool reprobe = false);
+
+    /** Whether -r or --reprobe is in the arguments. */
+    static bool reprobeRequested(int argc, char **argv);
+
+private:
+    struct OutputState
+    {
+        OutputState();
+
+        RROutput id;
+        QString name;
+        /** The settings key, see RandROutput::settingsKey() */
+        QString key;
+        bool connected;
+        RRCrtc crtc;
+        CrtcList crtcs;
+        ModeList modes;
+        OutputList clones;
+
+        bool hasSettings;
+        bool active;
+        QRect rect;
+        int rotation;
+        float rate;
+        float brightness;
+        float red;
+        float green;
+        float blue;
+        bool tracking;
+        QRect virtualRect;
+        bool virtualModeEnabled;
+        bool primary;
+    };
+
+    typedef RandRApplyEngine::CrtcConfig CrtcConfig;
+    typedef RandRApplyEngine::ConfigMap ConfigMap;
+
+    /** What is set once the CRTC has its configuration */
+    struct CrtcExtras
+    {
+        CrtcExtras();
+
+        /** The panning area, if the virtual mode is enabled */
+        QRect virtualRect;
+        bool tracking;
+        float brightness;
+        float red;
+        float green;
+        float blue;
+    };
+    typedef QMap<RRCrtc, CrtcExtras> ExtrasMap;
+
+    bool applyScreen(int screen, const RandRLayoutStore &store);
+    void readOutputs(XRRScreenResources *resources, QList<OutputState> &outputs);
+    /** Returns whether the settings know which output is the primary one. */
+    bool readSettings(int screen, QList<OutputState> &outputs, const RandRLayoutStore &store);
+    void plan(const RandRApplyEngine &engine, XRRScreenResources *resources,
+              const QList<OutputState> &outputs, const ConfigMap &current,
+              ConfigMap &target, ExtrasMap &extras);
+    RRMode findMode(const RandRApplyEngine &engine, const OutputState &output) const;
+    /** The scaling of the CRTCs that have a panning area, see
+     * RandRCrtc::proposedTransform(). */
+    QMap<RRCrtc, XTransform> transforms(const RandRApplyEngine &engine, const ConfigMap &target,
+                                        const ExtrasMap &extras) const;
+    /** Whether a saved brightness or colour balance differs from 1.0. */
+    static bool hasColours(const ExtrasMap &extras);
+    /** Set the gamma and panning of the CRTCs once they are configured. */
+    void applyExtras(XRRScreenResources *resources, const ExtrasMap &extras);
+    /** Make the output saved as the primary one primary again. */
+    void setPrimary(Window root, const QList<OutputState> &outputs);
+
+    /** Record the time since the previous phase. */
+    void phase(const char *name);
+
+    Display *m_dpy;
+    RandRBackend *m_backend;
+    bool m_has_1_3;
+    bool m_reprobe;
+
+    QElapsedTimer m_total;
+    QElapsedTimer m_timer;
+    QList<QPair<QString, qint64> > m_timings;
+};
+
+#endif // RANDRSTARTUP_H
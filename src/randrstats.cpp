@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QFile>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "randrstats.h"
+
+bool RandRStats::s_enabled = false;
+QString RandRStats::s_fileName;
+QElapsedTimer RandRStats::s_clock;
+QThreadStorage<RandRStats::ThreadState*> RandRStats::s_threads;
+QMutex RandRStats::s_mutex;
+RandRStats::Counters RandRStats::s_counters[RandRStats::OperationCount];
+
+static const char *const operationNames[RandRStats::OperationCount] = {
+    "other", "probe", "plan", "commit", "gamma"
+};
+
+RandRStats::ThreadState::ThreadState()
+    : current(Other),
+      mark(s_clock.isValid() ? s_clock.nsecsElapsed() : 0)
+{
+}
+
+RandRStats::ThreadState *RandRStats::threadState()
+{
+    if (!s_threads.hasLocalData())
+        s_threads.setLocalData(new ThreadState);
+    return s_threads.localData();
+}
+
+RandRStats::Scope::Scope(Operation operation)
+    : m_previous(Other),
+      m_switched(false)
+{
+    if (!s_enabled)
+        return;
+
+    ThreadState *state = threadState();
+    m_previous = state->current;
+    m_switched = operation != state->current;
+    if (!m_switched)
+        return;
+
+    QMutexLocker locker(&s_mutex);
+    switchTo(state, operation);
+    s_counters[operation].calls++;
+}
+
+RandRStats::Scope::~Scope()
+{
+    if (!m_switched)
+        return;
+
+    QMutexLocker locker(&s_mutex);
+    switchTo(threadState(), m_previous);
+}
+
+bool RandRStats::isEnabled()
+{
+    return s_enabled;
+}
+
+void RandRStats::enable(const QString &fileName)
+{
+    if (!s_enabled)
+    {
+        reset();
+        atexit(writeReport);
+    }
+    s_enabled = true;
+    s_fileName = fileName;
+}
+
+void RandRStats::parseArguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strcmp(argv[i], "--stats"))
+            enable();
+        else if (!strncmp(argv[i], "--stats=", 8))
+            enable(QFile::decodeName(argv[i] + 8));
+    }
+}
+
+void RandRStats::switchTo(ThreadState *state, Operation operation)
+{
+    qint64 now = s_clock.nsecsElapsed();
+    s_counters[state->current].nsecs += now - state->mark;
+    state->mark = now;
+    state->current = operation;
+}
+
+void RandRStats::request(int bytes)
+{
+    if (!s_enabled)
+        return;
+
+    Operation current = threadState()->current;
+    QMutexLocker locker(&s_mutex);
+    s_counters[current].requests++;
+    s_counters[current].bytesSent += bytes;
+}
+
+void RandRStats::reply(int bytes)
+{
+    if (!s_enabled)
+        return;
+
+    Operation current = threadState()->current;
+    QMutexLocker locker(&s_mutex);
+    s_counters[current].bytesReceived += bytes;
+}
+
+void RandRStats::roundTrip()
+{
+    if (!s_enabled)
+        return;
+
+    Operation current = threadState()->current;
+    QMutexLocker locker(&s_mutex);
+    s_counters[current].roundTrips++;
+}
+
+void RandRStats::call(int requestBytes, int replyBytes)
+{
+    request(requestBytes);
+    roundTrip();
+    reply(replyBytes);
+}
+
+QString RandRStats::report()
+{
+    QMutexLocker locker(&s_mutex);
+    // account the time of the operation in progress
+    ThreadState *state = threadState();
+    switchTo(state, state->current);
+
+    const QString row("%1 %2 %3 %4 %5 %6 %7\n");
+    QString result = row.arg("operation", -10).arg("calls", 8).arg("requests", 10)
+                        .arg("round trips", 12).arg("bytes sent", 12).arg("bytes recv", 12)
+                        .arg("ms", 10);
+
+    Counters total;
+    memset(&total, 0, sizeof(total));
+    for (int i = 0; i < OperationCount; ++i)
+    {
+        const Counters &c = s_counters[i];
+        // the time outside of any operation is the life of the process
+        QString ms = i == Other ? QString("-") : QString::number(c.nsecs / 1000000.0, 'f', 3);
+        result += row.arg(operationNames[i], -10).arg(c.calls, 8).arg(c.requests, 10)
+                     .arg(c.roundTrips, 12).arg(c.bytesSent, 12).arg(c.bytesReceived, 12)
+                     .arg(ms, 10);
+
+        total.requests += c.requests;
+        total.roundTrips += c.roundTrips;
+        total.bytesSent += c.bytesSent;
+        total.bytesReceived += c.bytesReceived;
+    }
+    result += row.arg("total", -10).arg("", 8).arg(total.requests, 10)
+                 .arg(total.roundTrips, 12).arg(total.bytesSent, 12).arg(total.bytesReceived, 12)
+                 .arg("", 10);
+    return result;
+}
+
+void RandRStats::reset()
+{
+    QMutexLocker locker(&s_mutex);
+    memset(s_counters, 0, sizeof(s_counters));
+    s_clock.start();
+    threadState()->mark = 0;
+}
+
+void RandRStats::writeReport()
+{
+    QByteArray text = report().toLocal8Bit();
+    if (s_fileName.isEmpty() || s_fileName == "-")
+    {
+        fputs(text.constData(), stderr);
+        return;
+    }
+
+    QFile file(s_fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        fprintf(stderr, "Can't write the RandR statistics to %s\n", qPrintable(s_fileName));
+        return;
+    }
+    file.write(text);
+}
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRSTATS_H
+#define RANDRSTATS_H
+
+#include <QtCore/QString>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMutex>
+#include <QtCore/QThreadStorage>
+
+/** Counts what is sent to the RandR server, per logical operation.
+ *
+ * The code talking to the server reports its requests, the replies it
+ * reads and the round trips it waits for; a Scope tells which operation
+ * they belong to and measures the wall time spent in it. Nothing is
+ * counted unless --stats enabled it, the totals are written when the
+ * process exits.
+ *
+ * Every thread has its own current operation; the time of an operation is
+ * the sum over the threads that were in it. */
+class RandRStats
+{
+public:
+    enum Operation
+    {
+        /** Whatever is sent outside of the operations below */
+        Other,
+        /** Reading the configuration of the server */
+        Probe,
+        /** Choosing the CRTCs and compiling the startup plan */
+        Plan,
+        /** Sending a configuration, reverting it included */
+        Commit,
+        /** Reading and setting gamma ramps */
+        Gamma,
+        OperationCount
+    };
+
+    /** Counts the requests sent during its lifetime as part of
+     * @p operation. Scopes nest, the innermost one gets the requests and
+     * the time; an operation nested in itself is only counted once. */
+    class Scope
+    {
+    public:
+        Scope(Operation operation);
+        ~Scope();
+
+    private:
+        Operation m_previous;
+        bool m_switched;
+    };
+
+    static bool isEnabled();
+    /** Start counting. At exit, the totals are written to @p fileName,
+     * to stderr if it is empty or "-". */
+    static void enable(const QString &fileName = QString());
+    /** Enable the counters if --stats or --stats=FILE is in @p argv. */
+    static void parseArguments(int argc, char **argv);
+
+    /** A request of @p bytes was sent. */
+    static void request(int bytes);
+    /** A reply or event of @p bytes was read. */
+    static void reply(int bytes);
+    /** The client waited for the server. */
+    static void roundTrip();
+    /** A request of @p requestBytes was sent and its reply of
+     * @p replyBytes waited for. */
+    static void call(int requestBytes, int replyBytes);
+
+    /** The totals, as a table. */
+    static QString report();
+    static void reset();
+
+private:
+    struct Counters
+    {
+        qint64 calls;
+        qint64 requests;
+        qint64 roundTrips;
+        qint64 bytesSent;
+        qint64 bytesReceived;
+        qint64 nsecs;
+    };
+
+    /** The operation a thread is in */
+    struct ThreadState
+    {
+        ThreadState();
+
+        Operation current;
+        /** s_clock when the current operation was entered */
+        qint64 mark;
+    };
+
+    static ThreadState *threadState();
+    /** Called with s_mutex held. */
+    static void switchTo(ThreadState *state, Operation operation);
+    static void writeReport();
+
+    static bool s_enabled;
+    static QString s_fileName;
+    static QElapsedTimer s_clock;
+    static QThreadStorage<ThreadState*> s_threads;
+    /** Protects the counters */
+    static QMutex s_mutex;
+    static Counters s_counters[OperationCount];
+};
+
+#endif // RANDRSTATS_H
@@ -0,0 +1,154 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "randrtrace.h"
+
+namespace
+{
+    struct Event
+    {
+        const char *name;
+        unsigned long id;
+        qint64 start;
+        qint64 duration;
+        quint64 thread;
+    };
+
+    // a daemon running for days would otherwise grow without bounds
+    const int MaxEvents = 1 << 20;
+
+    bool enabled = false;
+    QString fileName;
+    QElapsedTimer clock;
+    QMutex mutex;
+    QVector<Event> events;
+    int dropped = 0;
+}
+
+RandRTrace::Span::Span(const char *name, unsigned long id)
+    : m_name(name),
+      m_id(id),
+      m_start(enabled ? now() : 0)
+{
+}
+
+RandRTrace::Span::~Span()
+{
+    if (enabled)
+        record(m_name, m_id, m_start, now());
+}
+
+bool RandRTrace::isEnabled()
+{
+    return enabled;
+}
+
+void RandRTrace::enable(const QString &file)
+{
+    if (!enabled)
+    {
+        clock.start();
+        atexit(writeAtExit);
+    }
+    fileName = file;
+    enabled = true;
+}
+
+void RandRTrace::parseArguments(int argc, char **argv)
+{
+    QByteArray env = qgetenv("LXQT_RANDR_TRACE");
+    if (!env.isEmpty())
+        enable(QFile::decodeName(env));
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!strncmp(argv[i], "--trace=", 8) && argv[i][8])
+            enable(QFile::decodeName(argv[i] + 8));
+    }
+}
+
+qint64 RandRTrace::now()
+{
+    return clock.nsecsElapsed() / 1000;
+}
+
+void RandRTrace::record(const char *name, unsigned long id, qint64 start, qint64 end)
+{
+    QMutexLocker locker(&mutex);
+    if (events.count() >= MaxEvents)
+    {
+        dropped++;
+        return;
+    }
+
+    Event event;
+    event.name = name;
+    event.id = id;
+    event.start = start;
+    event.duration = end - start;
+    event.thread = (quint64) (quintptr) QThread::currentThreadId();
+    events.append(event);
+}
+
+bool RandRTrace::write(const QString &file)
+{
+    QFile out(file);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        fprintf(stderr, "Can't write the trace to %s\n", qPrintable(file));
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    int pid = getpid();
+    out.write("{\"traceEvents\": [\n");
+    for (int i = 0; i < events.count(); ++i)
+    {
+        const Event &e = events.at(i);
+        QByteArray line = QString("  {\"name\": \"%1\", \"cat\": \"randr\", \"ph\": \"X\", "
+                                  "\"ts\": %2, \"dur\": %3, \"pid\": %4, \"tid\": %5")
+                          .arg(e.name).arg(e.start).arg(e.duration).arg(pid).arg(e.thread)
+                          .toLatin1();
+        if (e.id)
+            line += QString(", \"args\": {\"id\": \"0x%1\"}").arg(e.id, 0, 16).toLatin1();
+        line += i + 1 < events.count() ? "},\n" : "}\n";
+        out.write(line);
+    }
+    out.write(QString("], \"displayTimeUnit\": \"ms\", \"otherData\": {\"dropped\": %1}}\n")
+              .arg(dropped).toLatin1());
+    return true;
+}
+
+void RandRTrace::writeAtExit()
+{
+    if (write(fileName))
+        fprintf(stderr, "Trace of %d spans written to %s\n", events.count(), qPrintable(fileName));
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRTRACE_H
+#define RANDRTRACE_H
+
+#include <QtCore/QString>
+
+/** Records how long the stages of a configuration change take, as a
+ * trace that chrome://tracing and Perfetto can open.
+ *
+ * Tracing is enabled by --trace=FILE or by LXQT_RANDR_TRACE=FILE in the
+ * environment; the trace is written to FILE when the process exits. When
+ * it is disabled a Span costs one branch. */
+class RandRTrace
+{
+public:
+    /** A stage of the work, from its construction to its destruction.
+     * @p name has to be a string literal, it is kept as it is. */
+    class Span
+    {
+    public:
+        Span(const char *name, unsigned long id = 0);
+        ~Span();
+
+    private:
+        const char *m_name;
+        unsigned long m_id;
+        qint64 m_start;
+    };
+
+    static bool isEnabled();
+    /** Start recording, the trace is written to @p fileName at exit. */
+    static void enable(const QString &fileName);
+    /** Enable tracing if --trace=FILE is in @p argv or LXQT_RANDR_TRACE
+     * is set. */
+    static void parseArguments(int argc, char **argv);
+
+    /** Write the spans recorded so far. */
+    static bool write(const QString &fileName);
+
+private:
+    static void record(const char *name, unsigned long id, qint64 start, qint64 end);
+    static qint64 now();
+    static void writeAtExit();
+};
+
+#endif // RANDRTRACE_H
@@ -0,0 +1,368 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QVector>
+
+#include "randrtransaction.h"
+#include "randrscreen.h"
+#include "randrcrtc.h"
+#include "randroutput.h"
+#include "randrmode.h"
+#include "randrprobe.h"
+#include "randrbackend.h"
+#include "randrstats.h"
+#include "randrtrace.h"
+#include "randrworker.h"
+
+// how long to wait for the server to report the crtc changes before
+// setting the gamma ramps anyway
+static const int CrtcChangeTimeout = 250;
+
+RandRTransaction::RandRTransaction(RandRScreen *screen)
+    : m_screen(screen),
+      m_index(screen ? screen->index() : -1),
+      m_root(None),
+      m_configTimestamp(0),
+      m_worker(0),
+      m_sentByWorker(false),
+      m_steps(0),
+      m_totalSteps(0),
+      m_committed(false),
+      m_invalidConfigTime(false),
+      m_modesets(0),
+      m_resizes(0)
+{
+    Q_ASSERT(m_screen);
+}
+
+void RandRTransaction::addCrtc(RandRCrtc *crtc)
+{
+    if (crtc && crtc->isValid() && !m_staged.contains(crtc->id()))
+        m_staged.append(crtc->id());
+}
+
+bool RandRTransaction::isEmpty() const
+{
+    return m_staged.isEmpty();
+}
+
+QMap<RROutput, RRCrtc> RandRTransaction::originalCrtcs() const
+{
+    QMap<RROutput, RRCrtc> crtcs;
+    ConfigMap::const_iterator it;
+    for (it = m_original.constBegin(); it != m_original.constEnd(); ++it)
+    {
+        if (it.value().mode == None)
+            continue;
+        foreach(RROutput output, it.value().outputs)
+            crtcs.insert(output, it.key());
+    }
+    return crtcs;
+}
+
+int RandRTransaction::modesets() const
+{
+    return m_modesets;
+}
+
+int RandRTransaction::resizes() const
+{
+    return m_resizes;
+}
+
+bool RandRTransaction::plan()
+{
+    RandRTrace::Span span("transaction plan");
+    m_original.clear();
+    m_target.clear();
+    m_transforms.clear();
+    m_originalSize = m_screen->rect().size();
+
+    QRect bounds;
+
+    foreach(RandRCrtc *crtc, m_screen->crtcs())
+    {
+        if (!crtc->isValid())
+            continue;
+
+        CrtcConfig current;
+        current.mode = crtc->mode().id();
+        current.pos = crtc->rect().topLeft();
+        current.rotation = crtc->rotation();
+        current.outputs = crtc->currentOutputs();
+        current.extents = crtc->rect();
+        m_original[crtc->id()] = current;
+
+        if (!m_staged.contains(crtc->id()))
+        {
+            m_target[crtc->id()] = current;
+            if (current.mode != None)
+                bounds |= current.extents;
+            continue;
+        }
+
+        CrtcConfig target;
+        RandRMode mode = crtc->proposedMode();
+        if (!crtc->connectedOutputs().isEmpty())
+        {
+            if (!mode.isValid())
+            {
+                qDebug() << "No mode of size" << crtc->proposedRect().size()
+                         << "for CRTC" << crtc->id();
+                return false;
+            }
+
+            QSize size = mode.size();
+            if (crtc->proposedRotation() & (RandR::Rotate90 | RandR::Rotate270))
+                size.transpose();
+
+            target.mode = mode.id();
+            target.pos = crtc->proposedRect().topLeft();
+            target.rotation = crtc->proposedRotation();
+            target.outputs = crtc->connectedOutputs();
+            target.extents = QRect(target.pos, size);
+            bounds |= target.extents;
+
+            if (crtc->proposedVirtualModeEnabled() && crtc->proposedVirtualRect().isValid())
+                bounds |= QRect(target.pos, crtc->proposedVirtualRect().size());
+            if (m_screen->backend()->has_1_3())
+                m_transforms[crtc->id()] = crtc->proposedTransform();
+        }
+        m_target[crtc->id()] = target;
+
+        qDebug() << "CRTC" << crtc->id() << ":" << m_original[crtc->id()].extents
+                 << "->" << target.extents << "rotation" << target.rotation
+                 << "outputs" << target.outputs;
+    }
+
+    // find a size in which all enabled crtcs fit, like compilePlan() the
+    // screen always starts at the origin
+    QSize size = bounds.isValid() ? QRect(QPoint(0, 0), bounds.bottomRight()).size() : QSize(0, 0);
+    size = size.expandedTo(m_screen->minSize());
+    if (size.width() > m_screen->maxSize().width() || size.height() > m_screen->maxSize().height())
+    {
+        qDebug() << "Layout of size" << size << "does not fit in the maximum screen size"
+                 << m_screen->maxSize();
+        return false;
+    }
+    m_targetSize = size;
+
+    return true;
+}
+
+void RandRTransaction::waitForCrtcChanges()
+{
+    RandRTrace::Span span("wait for crtcs");
+    m_screen->backend()->waitForCrtcChanges(m_changed, CrtcChangeTimeout);
+}
+
+void RandRTransaction::step()
+{
+    m_steps++;
+    if (m_worker)
+        m_worker->reportProgress(m_index, qMin(m_steps, m_totalSteps), m_totalSteps);
+}
+
+void RandRTransaction::collect(const RandRApplyEngine &engine)
+{
+    m_stateSize = engine.stateSize();
+    m_changed = engine.changed();
+    m_modesets = engine.modesets();
+    m_resizes = engine.resizes();
+    m_invalidConfigTime = engine.invalidConfigTime();
+}
+
+bool RandRTransaction::commit()
+{
+    RandRStats::Scope scope(RandRStats::Commit);
+    RandRTrace::Span span("commit");
+    if (m_staged.isEmpty())
+        return true;
+
+    if (!prepare())
+        return false;
+
+    return finish(send(m_screen->backend(), m_screen->resources()));
+}
+
+bool RandRTransaction::prepare()
+{
+    if (!plan())
+        return false;
+
+    m_root = m_screen->rootWindow();
+    m_preparedResources = m_screen->sharedResources();
+    m_configTimestamp = m_preparedResources->configTimestamp;
+    m_originalSizeMM = m_screen->sizeMM(m_originalSize);
+    m_targetSizeMM = m_screen->sizeMM(m_targetSize);
+
+    // every crtc that changes, and the screen size, is a step of send()
+    m_totalSteps = m_targetSize != m_originalSize ? 1 : 0;
+    ConfigMap::const_iterator it;
+    for (it = m_target.constBegin(); it != m_target.constEnd(); ++it)
+    {
+        if (it.value() != m_original.value(it.key()))
+            m_totalSteps++;
+    }
+    return true;
+}
+
+bool RandRTransaction::send(RandRBackend *backend, XRRScreenResources *resources, RandRWorker *worker)
+{
+    RandRStats::Scope scope(RandRStats::Commit);
+    RandRTrace::Span span("send", m_index);
+    Q_ASSERT(backend && resources);
+
+    m_modesets = 0;
+    m_resizes = 0;
+    m_steps = 0;
+    m_invalidConfigTime = false;
+    m_stateSize = m_originalSize;
+    m_changed.clear();
+    m_sentByWorker = worker != 0;
+
+    // the ids of the plan are those of the outputs and modes the model knew
+    if (resources->configTimestamp != m_configTimestamp)
+    {
+        qDebug() << "The outputs of screen" << m_index << "changed, not sending the configuration";
+        m_invalidConfigTime = true;
+        return false;
+    }
+
+    m_worker = worker;
+    RandRApplyEngine engine(backend, m_root, resources);
+    engine.setState(m_original, m_originalSize, m_originalSizeMM);
+    engine.setTransforms(m_transforms);
+    engine.setProgress(this);
+    bool succeed = engine.apply(m_target, m_targetSize, m_targetSizeMM);
+    collect(engine);
+
+    if (worker)
+        worker->reportProgress(m_index, m_totalSteps, m_totalSteps);
+    m_worker = 0;
+
+    qDebug() << "Commit" << (succeed ? "succeeded:" : "failed:") << m_modesets << "modesets,"
+             << m_resizes << "screen resizes";
+    return succeed;
+}
+
+bool RandRTransaction::finish(bool sent)
+{
+    RandRStats::Scope scope(RandRStats::Commit);
+    m_screen->commitSize(m_stateSize);
+
+    if (!sent)
+    {
+        reload();
+        return false;
+    }
+
+    // the gamma ramps are only set once the new crtc configuration is in
+    // place, otherwise the driver may reset them. A worker waited for the
+    // server to handle its requests, the events may already have been read
+    // by the event loop
+    if (!m_sentByWorker)
+        waitForCrtcChanges();
+
+    // the crtcs are looked up again, the model may have been reloaded
+    // while another thread sent the configuration. What they had until now
+    // is what rollback() proposes again
+    m_committed = true;
+    foreach(RRCrtc id, m_staged)
+    {
+        RandRCrtc *crtc = m_screen->crtc(id);
+        if (!crtc)
+            continue;
+        crtc->setOriginal();
+        crtc->commitProposed(m_target[id].mode);
+    }
+    m_screen->backend()->flush();
+
+    return true;
+}
+
+bool RandRTransaction::rollback()
+{
+    RandRStats::Scope scope(RandRStats::Commit);
+    RandRTrace::Span span("rollback");
+    if (!m_committed)
+        return true;
+
+    // the original configuration is restored as a whole too. It is sent
+    // with the resources it was prepared with: if the outputs changed in
+    // the meantime, the server refuses it and the model is probed again
+    CrtcList staged = m_staged;
+    m_staged.clear();
+
+    RandRApplyEngine engine(m_screen->backend(), m_root, m_preparedResources.data());
+    engine.setState(m_target, m_targetSize, m_targetSizeMM);
+    bool succeed = engine.apply(m_original, m_originalSize, m_originalSizeMM, false);
+    collect(engine);
+    m_screen->commitSize(m_stateSize);
+
+    qDebug() << "Rollback" << (succeed ? "succeeded:" : "failed:") << m_modesets << "modesets,"
+             << m_resizes << "screen resizes";
+
+    // gamma is not part of the crtc configuration, put it back separately
+    waitForCrtcChanges();
+    foreach(RRCrtc id, staged)
+    {
+        RandRCrtc *crtc = m_screen->crtc(id);
+        if (!crtc)
+            continue;
+        crtc->proposeOriginal();
+        if (succeed && m_original[id].mode != None)
+            crtc->applyProposedGamma();
+    }
+
+    m_committed = false;
+    reload();
+    return succeed;
+}
+
+void RandRTransaction::reload()
+{
+    // the resources are out of date, everything has to be queried again
+    if (m_invalidConfigTime)
+    {
+        m_screen->loadSettings(true);
+        return;
+    }
+
+    // bring the model back in sync with the server
+    RandRProbe probe(m_screen->resources(), m_screen->backend());
+    foreach(RRCrtc id, m_original.keys())
+        probe.addCrtc(id, false);
+    foreach(RandROutput *output, m_screen->outputs())
+        probe.addOutput(output->id());
+    probe.run();
+
+    foreach(RRCrtc id, m_original.keys())
+    {
+        const RandRCrtcInfo *info = probe.crtc(id);
+        RandRCrtc *crtc = m_screen->crtc(id);
+        if (info && crtc)
+            crtc->loadSettings(*info, true);
+    }
+    foreach(RandROutput *output, m_screen->outputs())
+    {
+        const RandROutputInfo *info = probe.output(output->id());
+        if (info)
+            output->loadSettings(*info, true);
+    }
+}
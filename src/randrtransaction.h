@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRTRANSACTION_H
+#define RANDRTRANSACTION_H
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QSize>
+
+#include "randr.h"
+#include "randrapplyengine.h"
+
+class RandRBackend;
+class RandRWorker;
+
+/** Applies the proposed configuration of several CRTCs as a whole.
+ *
+ * The final mode, position and rotation of every CRTC and the final screen
+ * size are computed before anything is sent to the server, a
+ * RandRApplyEngine then sends them under a server grab. If the server
+ * refuses any step, the previous configuration is restored.
+ *
+ * The requests can be sent from another thread than the one of the model,
+ * see RandRScreen::applyProposedAsync(). */
+class RandRTransaction : private RandRApplyEngine::Progress
+{
+public:
+    RandRTransaction(RandRScreen *screen);
+
+    /** Add a CRTC whose proposed configuration should be applied. */
+    void addCrtc(RandRCrtc *crtc);
+    bool isEmpty() const;
+
+    /** prepare(), send() and finish() in a row, on the backend of the
+     * model. */
+    bool commit();
+
+    /** Compute the final configuration from the proposed one of the
+     * model. Returns false if it does not fit in the screen. */
+    bool prepare();
+    /** Send the prepared configuration through @p backend, @p resources
+     * being the current screen resources of that backend. Only the data
+     * of the transaction is used, not the model, so this can run on the
+     * thread of a RandRWorker, which is given the progress if set.
+     * Nothing is sent if the outputs or modes of the server changed since
+     * prepare(). */
+    bool send(RandRBackend *backend, XRRScreenResources *resources, RandRWorker *worker = 0);
+    /** Bring the model in line with the result of send(). Returns false
+     * if nothing was @p sent. */
+    bool finish(bool sent);
+
+    /** Restore the configuration the screen had before commit(). The
+     * transaction may be kept for a while, the CRTCs that are gone from
+     * the model by then are left out. */
+    bool rollback();
+
+    /** The CRTC of each output that was on before the transaction. */
+    QMap<RROutput, RRCrtc> originalCrtcs() const;
+
+    int modesets() const;
+    int resizes() const;
+
+private:
+    typedef RandRApplyEngine::CrtcConfig CrtcConfig;
+    typedef RandRApplyEngine::ConfigMap ConfigMap;
+
+    bool plan();
+    /** Keep what @p engine did, once it sent the configuration. */
+    void collect(const RandRApplyEngine &engine);
+    /** One more CRTC, or the screen size, has its final configuration. */
+    void step();
+    /** Wait until the server reported the change of every modified crtc,
+     * or the timeout expires. */
+    void waitForCrtcChanges();
+    void reload();
+
+    RandRScreen *m_screen;
+    /** The ids only, the model may delete the CRTCs while the
+     * transaction is kept for a rollback */
+    CrtcList m_staged;
+
+    /** What send() needs to know about the screen */
+    int m_index;
+    Window m_root;
+    Time m_configTimestamp;
+    /** The resources the configuration was prepared with, rollback()
+     * sends the original configuration with them */
+    QSharedPointer<XRRScreenResources> m_preparedResources;
+
+    ConfigMap m_original;
+    QSize m_originalSize;
+    QSize m_originalSizeMM;
+    ConfigMap m_target;
+    QSize m_targetSize;
+    QSize m_targetSizeMM;
+    /** The scaling of the staged CRTCs, see RandRCrtc::proposedTransform() */
+    QMap<RRCrtc, XTransform> m_transforms;
+    QSize m_stateSize;
+    CrtcList m_changed;
+
+    /** Only set while the configuration is sent */
+    RandRWorker *m_worker;
+    /** The last send() was made by a worker */
+    bool m_sentByWorker;
+    int m_steps;
+    int m_totalSteps;
+
+    bool m_committed;
+    bool m_invalidConfigTime;
+    int m_modesets;
+    int m_resizes;
+};
+
+#endif // RANDRTRANSACTION_H
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+
+#include "randrworker.h"
+#include "randrxlibbackend.h"
+#include "randrconnectionpool.h"
+#include "randrtransaction.h"
+#include "randrtrace.h"
+
+RandRWorker::RandRWorker()
+    : m_dpy(0),
+      m_backend(0)
+{
+    qRegisterMetaType<RandRSnapshot>("RandRSnapshot");
+    qRegisterMetaType<RandRTimestampMap>("RandRTimestampMap");
+    qRegisterMetaType<RandRTransaction*>("RandRTransaction*");
+}
+
+RandRWorker::~RandRWorker()
+{
+    stop();
+}
+
+bool RandRWorker::start(const QByteArray &displayName)
+{
+    if (m_dpy)
+        return true;
+
+    m_dpy = RandRConnectionPool::instance()->acquire(displayName);
+    if (!m_dpy)
+    {
+        qDebug() << "Can't open a connection to" << displayName << "for the RandR worker";
+        return false;
+    }
+
+    m_backend = new RandRXlibBackend(m_dpy);
+    moveToThread(&m_thread);
+    m_thread.start();
+    return true;
+}
+
+void RandRWorker::stop()
+{
+    if (!m_dpy)
+        return;
+
+    m_thread.quit();
+    m_thread.wait();
+
+    delete m_backend;
+    m_backend = 0;
+    RandRConnectionPool::instance()->release(m_dpy);
+    m_dpy = 0;
+}
+
+bool RandRWorker::isRunning() const
+{
+    return m_dpy != 0;
+}
+
+void RandRWorker::requestProbe(int screen, bool poll, const RandRTimestampMap &gammaTimestamps)
+{
+    Q_ASSERT(m_dpy);
+    QMetaObject::invokeMethod(this, "probe", Qt::QueuedConnection, Q_ARG(int, screen),
+                              Q_ARG(bool, poll), Q_ARG(RandRTimestampMap, gammaTimestamps));
+}
+
+void RandRWorker::requestApply(int screen, RandRTransaction *transaction)
+{
+    Q_ASSERT(m_dpy && transaction);
+    QMetaObject::invokeMethod(this, "apply", Qt::QueuedConnection, Q_ARG(int, screen),
+                              Q_ARG(RandRTransaction*, transaction));
+}
+
+RandRSnapshot RandRWorker::snapshot(int screen, bool poll)
+{
+    Q_ASSERT(m_dpy);
+    return RandRSnapshot::probe(m_backend, screen, poll);
+}
+
+void RandRWorker::reportProgress(int screen, int done, int total)
+{
+    emit progress(screen, done, total);
+}
+
+void RandRWorker::probe(int screen, bool poll, const RandRTimestampMap &gammaTimestamps)
+{
+    emit probed(RandRSnapshot::probe(m_backend, screen, poll, gammaTimestamps));
+}
+
+void RandRWorker::apply(int screen, RandRTransaction *transaction)
+{
+    RandRTrace::Span span("apply", screen);
+    // the cached resources are enough to check that the outputs and modes
+    // are still those the transaction was prepared for
+    XRRScreenResources *resources = m_backend->screenResources(m_backend->rootWindow(screen), false);
+    bool sent = false;
+    if (resources)
+    {
+        sent = transaction->send(m_backend, resources, this);
+        m_backend->freeScreenResources(resources);
+    }
+    emit applied(screen, sent);
+}
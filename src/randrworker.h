@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRWORKER_H
+#define RANDRWORKER_H
+
+#include <QtCore/QMap>
+#include <QtCore/QMetaType>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+
+#include "randrsnapshot.h"
+
+class RandRXlibBackend;
+class RandRTransaction;
+
+typedef QMap<RRCrtc, Time> RandRTimestampMap;
+
+/** Talks to the X server from a thread of its own.
+ *
+ * Polling the outputs with XRRGetScreenResources and sending a layout can
+ * take seconds. The worker does both over a private connection to the
+ * display, so the event loop of the application keeps running. The
+ * requests are queued with requestProbe() and requestApply(), the results
+ * come back as signals: the probed state as a RandRSnapshot, the steps of
+ * an apply through progress() and its end through applied().
+ *
+ * The objects of the model are only used on the GUI thread, the worker
+ * only sees snapshots and prepared transactions. XInitThreads() has to be
+ * called before the first connection to the display is opened. */
+class RandRWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    RandRWorker();
+    ~RandRWorker();
+
+    /** Take a connection to @p displayName from the RandRConnectionPool
+     * and start the thread. Returns false if the display could not be
+     * opened. */
+    bool start(const QByteArray &displayName);
+    /** Wait for the queued requests and give the connection back. */
+    void stop();
+    bool isRunning() const;
+
+    /** Queue a probe of @p screen, see RandRSnapshot::probe(). */
+    void requestProbe(int screen, bool poll, const RandRTimestampMap &gammaTimestamps);
+    /** Queue RandRTransaction::send() of the prepared @p transaction. The
+     * caller must not use it until applied() is emitted for @p screen. */
+    void requestApply(int screen, RandRTransaction *transaction);
+
+    /** Probe @p screen on the connection of the worker, from the calling
+     * thread. Only while the worker has no request queued, as when the
+     * display probes its screens at once before they are built. */
+    RandRSnapshot snapshot(int screen, bool poll);
+
+    /** Called by the transaction being sent. */
+    void reportProgress(int screen, int done, int total);
+
+signals:
+    void probed(const RandRSnapshot &snapshot);
+    /** @p done of the @p total steps of the transaction are done. */
+    void progress(int screen, int done, int total);
+    /** The transaction of @p screen was sent; @p sent is false if it was
+     * refused or reverted. */
+    void applied(int screen, bool sent);
+
+private slots:
+    void probe(int screen, bool poll, const RandRTimestampMap &gammaTimestamps);
+    void apply(int screen, RandRTransaction *transaction);
+
+private:
+    QThread m_thread;
+    Display *m_dpy;
+    RandRXlibBackend *m_backend;
+};
+
+Q_DECLARE_METATYPE(RandRTimestampMap)
+Q_DECLARE_METATYPE(RandRTransaction*)
+
+#endif // RANDRWORKER_H
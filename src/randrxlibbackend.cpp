@@ -0,0 +1,429 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QVector>
+#include <poll.h>
+#include <string.h>
+
+#include "randrxlibbackend.h"
+#include "randredid.h"
+#include "randrgammainfo.h"
+#include "randrstats.h"
+
+namespace
+{
+    struct CrtcChangeFilter
+    {
+        int eventBase;
+        CrtcList pending;
+    };
+}
+
+/* The protocol pads every request and reply to 4 bytes */
+static int pad(int bytes)
+{
+    return (bytes + 3) & ~3;
+}
+
+static Bool isPendingCrtcChange(Display *dpy, XEvent *event, XPointer arg)
+{
+    Q_UNUSED(dpy);
+    CrtcChangeFilter *filter = (CrtcChangeFilter *) arg;
+
+    if (event->type != filter->eventBase + RRNotify)
+        return False;
+    if (((XRRNotifyEvent *) event)->subtype != RRNotify_CrtcChange)
+        return False;
+
+    return filter->pending.contains(((XRRCrtcChangeNotifyEvent *) event)->crtc);
+}
+
+RandRXlibBackend::RandRXlibBackend(Display *dpy)
+    : m_dpy(dpy)
+{
+    Q_ASSERT(m_dpy);
+}
+
+Display *RandRXlibBackend::display() const
+{
+    return m_dpy;
+}
+
+bool RandRXlibBackend::queryExtension(int &eventBase, int &errorBase)
+{
+    RandRStats::call(8 + pad(strlen("RANDR")), 32);
+    return XRRQueryExtension(m_dpy, &eventBase, &errorBase);
+}
+
+bool RandRXlibBackend::queryVersion(int &major, int &minor)
+{
+    RandRStats::call(12, 32);
+    return XRRQueryVersion(m_dpy, &major, &minor);
+}
+
+int RandRXlibBackend::screenCount()
+{
+    return ScreenCount(m_dpy);
+}
+
+int RandRXlibBackend::defaultScreen()
+{
+    return DefaultScreen(m_dpy);
+}
+
+Window RandRXlibBackend::rootWindow(int screen)
+{
+    return RootWindow(m_dpy, screen);
+}
+
+QSize RandRXlibBackend::screenSize(int screen)
+{
+    return QSize(DisplayWidth(m_dpy, screen), DisplayHeight(m_dpy, screen));
+}
+
+QSize RandRXlibBackend::screenSizeMM(int screen)
+{
+    return QSize(DisplayWidthMM(m_dpy, screen), DisplayHeightMM(m_dpy, screen));
+}
+
+bool RandRXlibBackend::screenSizeRange(Window root, QSize &minSize, QSize &maxSize)
+{
+    int minWidth, minHeight, maxWidth, maxHeight;
+    RandRStats::call(8, 32);
+    if (!XRRGetScreenSizeRange(m_dpy, root, &minWidth, &minHeight, &maxWidth, &maxHeight))
+        return false;
+
+    minSize = QSize(minWidth, minHeight);
+    maxSize = QSize(maxWidth, maxHeight);
+    return true;
+}
+
+void RandRXlibBackend::setScreenSize(Window root, const QSize &size, const QSize &sizeMM)
+{
+    RandRStats::request(20);
+    XRRSetScreenSize(m_dpy, root, size.width(), size.height(), sizeMM.width(), sizeMM.height());
+}
+
+void RandRXlibBackend::selectInput(Window root, int mask)
+{
+    RandRStats::request(12);
+    XRRSelectInput(m_dpy, root, mask);
+}
+
+XRRScreenResources *RandRXlibBackend::screenResources(Window root, bool poll)
+{
+    XRRScreenResources *resources;
+#ifdef HAS_RANDR_1_3
+    if (!poll)
+        resources = XRRGetScreenResourcesCurrent(m_dpy, root);
+    else
+#else
+    Q_UNUSED(poll);
+#endif
+        resources = XRRGetScreenResources(m_dpy, root);
+
+    if (RandRStats::isEnabled() && resources)
+    {
+        int names = 0;
+        for (int i = 0; i < resources->nmode; ++i)
+            names += resources->modes[i].nameLength;
+        RandRStats::call(8, 32 + 4 * (resources->ncrtc + resources->noutput) +
+                            32 * resources->nmode + pad(names));
+    }
+    return resources;
+}
+
+void RandRXlibBackend::freeScreenResources(XRRScreenResources *resources)
+{
+    XRRFreeScreenResources(resources);
+}
+
+bool RandRXlibBackend::crtcInfo(XRRScreenResources *resources, RRCrtc crtc, RandRCrtcInfo &info)
+{
+    XRRCrtcInfo *ci = XRRGetCrtcInfo(m_dpy, resources, crtc);
+    if (!ci)
+        return false;
+    RandRStats::call(12, 32 + 4 * (ci->noutput + ci->npossible));
+
+    info.id = crtc;
+    info.timestamp = ci->timestamp;
+    info.rect = QRect(ci->x, ci->y, ci->width, ci->height);
+    info.mode = ci->mode;
+    info.rotation = ci->rotation;
+    info.rotations = ci->rotations;
+    for (int i = 0; i < ci->noutput; ++i)
+        info.outputs.append(ci->outputs[i]);
+    for (int i = 0; i < ci->npossible; ++i)
+        info.possible.append(ci->possible[i]);
+    XRRFreeCrtcInfo(ci);
+    return true;
+}
+
+bool RandRXlibBackend::crtcPanning(XRRScreenResources *resources, RRCrtc crtc, QRect &panning)
+{
+#ifdef HAS_RANDR_1_3
+    XRRPanning *p = XRRGetPanning(m_dpy, resources, crtc);
+    RandRStats::call(8, 36);
+    if (!p)
+        return false;
+
+    panning = QRect(p->left, p->top, p->width, p->height);
+    XRRFreePanning(p);
+    return true;
+#else
+    Q_UNUSED(resources);
+    Q_UNUSED(crtc);
+    Q_UNUSED(panning);
+    return false;
+#endif
+}
+
+bool RandRXlibBackend::crtcTransform(RRCrtc crtc, XTransform &transform, QByteArray &filter)
+{
+#ifdef HAS_RANDR_1_3
+    XRRCrtcTransformAttributes *attributes = 0;
+    if (!XRRGetCrtcTransform(m_dpy, crtc, &attributes) || !attributes)
+        return false;
+    RandRStats::call(8, 96 + pad(strlen(attributes->pendingFilter)) + pad(strlen(attributes->currentFilter)) +
+                        4 * (attributes->pendingNparams + attributes->currentNparams));
+
+    transform = attributes->currentTransform;
+    filter = attributes->currentFilter;
+    XFree(attributes);
+    return true;
+#else
+    Q_UNUSED(crtc);
+    Q_UNUSED(transform);
+    Q_UNUSED(filter);
+    return false;
+#endif
+}
+
+bool RandRXlibBackend::crtcGamma(RRCrtc crtc, RandRCrtcInfo &info)
+{
+    RandRStats::Scope scope(RandRStats::Gamma);
+    XRRCrtcGamma *gamma = XRRGetCrtcGamma(m_dpy, crtc);
+    if (!gamma)
+        return false;
+    RandRStats::call(8, 32 + pad(6 * gamma->size));
+
+    info.red = QVector<unsigned short>(gamma->size);
+    info.green = QVector<unsigned short>(gamma->size);
+    info.blue = QVector<unsigned short>(gamma->size);
+    for (int i = 0; i < gamma->size; ++i)
+    {
+        info.red[i] = gamma->red[i];
+        info.green[i] = gamma->green[i];
+        info.blue[i] = gamma->blue[i];
+    }
+    XRRFreeGamma(gamma);
+    return true;
+}
+
+int RandRXlibBackend::crtcGammaSize(RRCrtc crtc)
+{
+    RandRStats::call(8, 32);
+    return XRRGetCrtcGammaSize(m_dpy, crtc);
+}
+
+bool RandRXlibBackend::outputInfo(XRRScreenResources *resources, RROutput output, RandROutputInfo &info)
+{
+    XRROutputInfo *oi = XRRGetOutputInfo(m_dpy, resources, output);
+    if (!oi)
+        return false;
+    RandRStats::call(12, 36 + 4 * (oi->ncrtc + oi->nmode + oi->nclone) + pad(oi->nameLen));
+
+    info.id = output;
+    info.timestamp = oi->timestamp;
+    info.crtc = oi->crtc;
+    info.name = QString::fromLocal8Bit(oi->name, oi->nameLen);
+    info.connection = oi->connection;
+    for (int i = 0; i < oi->ncrtc; ++i)
+        info.crtcs.append(oi->crtcs[i]);
+    for (int i = 0; i < oi->nclone; ++i)
+        info.clones.append(oi->clones[i]);
+    for (int i = 0; i < oi->nmode; ++i)
+        info.modes.append(oi->modes[i]);
+    info.npreferred = oi->npreferred;
+    XRRFreeOutputInfo(oi);
+    return true;
+}
+
+QByteArray RandRXlibBackend::edid(RROutput output)
+{
+    QByteArray data = RandREdid::read(m_dpy, output);
+    RandRStats::call(24, 32 + pad(data.size()));
+    return data;
+}
+
+bool RandRXlibBackend::isEdidProperty(Atom property)
+{
+    return RandREdid::isEdidProperty(m_dpy, property);
+}
+
+RROutput RandRXlibBackend::outputPrimary(Window root)
+{
+#ifdef HAS_RANDR_1_3
+    RandRStats::call(8, 32);
+    return XRRGetOutputPrimary(m_dpy, root);
+#else
+    Q_UNUSED(root);
+    return None;
+#endif
+}
+
+Status RandRXlibBackend::setCrtcConfig(XRRScreenResources *resources, RRCrtc crtc, const QPoint &pos,
+                                       RRMode mode, int rotation, const OutputList &outputs)
+{
+    QVector<RROutput> ids(outputs.count());
+    for (int i = 0; i < outputs.count(); ++i)
+        ids[i] = outputs.at(i);
+
+    RandRStats::call(28 + 4 * ids.count(), 32);
+    return XRRSetCrtcConfig(m_dpy, resources, crtc, CurrentTime, pos.x(), pos.y(), mode,
+                            rotation, ids.isEmpty() ? 0 : ids.data(), ids.count());
+}
+
+void RandRXlibBackend::setCrtcTransform(RRCrtc crtc, XTransform *transform, const char *filter)
+{
+#ifdef HAS_RANDR_1_3
+    RandRStats::request(48 + pad(filter ? strlen(filter) : 0));
+    XRRSetCrtcTransform(m_dpy, crtc, transform, (char*) filter, NULL, 0);
+#else
+    Q_UNUSED(crtc);
+    Q_UNUSED(transform);
+    Q_UNUSED(filter);
+#endif
+}
+
+Status RandRXlibBackend::setPanning(XRRScreenResources *resources, RRCrtc crtc, const QRect &area)
+{
+#ifdef HAS_RANDR_1_3
+    XRRPanning *panning = XRRGetPanning(m_dpy, resources, crtc);
+    RandRStats::call(8, 36);
+    if (!panning)
+        return RRSetConfigFailed;
+
+    panning->left = area.x();
+    panning->top = area.y();
+    panning->width = area.width();
+    panning->height = area.height();
+    panning->track_width = 0;
+    panning->track_height = 0;
+    panning->track_left = panning->track_top = 0;
+    panning->timestamp = CurrentTime;
+    RandRStats::call(36, 32);
+    Status s = XRRSetPanning(m_dpy, resources, crtc, panning);
+    XRRFreePanning(panning);
+    return s;
+#else
+    Q_UNUSED(resources);
+    Q_UNUSED(crtc);
+    Q_UNUSED(area);
+    return RRSetConfigFailed;
+#endif
+}
+
+void RandRXlibBackend::setCrtcGamma(RRCrtc crtc, int size, const unsigned short *ramps)
+{
+    set_gamma_ramp(m_dpy, crtc, size, ramps);
+}
+
+void RandRXlibBackend::setOutputPrimary(Window root, RROutput output)
+{
+#ifdef HAS_RANDR_1_3
+    RandRStats::request(12);
+    XRRSetOutputPrimary(m_dpy, root, output);
+#else
+    Q_UNUSED(root);
+    Q_UNUSED(output);
+#endif
+}
+
+void RandRXlibBackend::grabServer()
+{
+    RandRStats::request(4);
+    XGrabServer(m_dpy);
+}
+
+void RandRXlibBackend::ungrabServer()
+{
+    RandRStats::request(4);
+    XUngrabServer(m_dpy);
+}
+
+void RandRXlibBackend::sync()
+{
+    RandRStats::call(4, 32);
+    XSync(m_dpy, False);
+}
+
+void RandRXlibBackend::flush()
+{
+    XFlush(m_dpy);
+}
+
+void RandRXlibBackend::waitForCrtcChanges(const CrtcList &crtcs, int timeout)
+{
+    CrtcChangeFilter filter;
+    int errorBase;
+    if (crtcs.isEmpty() || !XRRQueryExtension(m_dpy, &filter.eventBase, &errorBase))
+        return;
+    filter.pending = crtcs;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // the events are taken out of the queue to find them without blocking,
+    // and put back afterwards so that the event loop still sees them
+    QVector<XEvent> events;
+    while (!filter.pending.isEmpty())
+    {
+        XEvent event;
+        if (XCheckIfEvent(m_dpy, &event, isPendingCrtcChange, (XPointer) &filter))
+        {
+            filter.pending.removeAll(((XRRCrtcChangeNotifyEvent *) &event)->crtc);
+            events.append(event);
+            continue;
+        }
+
+        int remaining = timeout - timer.elapsed();
+        if (remaining <= 0)
+            break;
+
+        struct pollfd fd;
+        fd.fd = ConnectionNumber(m_dpy);
+        fd.events = POLLIN;
+        fd.revents = 0;
+        if (poll(&fd, 1, remaining) > 0)
+            XEventsQueued(m_dpy, QueuedAfterReading);
+    }
+
+    RandRStats::reply(32 * events.count());
+    for (int i = events.count() - 1; i >= 0; --i)
+        XPutBackEvent(m_dpy, &events[i]);
+
+    if (filter.pending.isEmpty())
+        qDebug() << "CRTC changes confirmed by the server after" << timer.elapsed() << "ms";
+    else
+        qDebug() << "Timed out waiting for the changes of CRTCs" << filter.pending;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+
+#ifndef RANDRXLIBBACKEND_H
+#define RANDRXLIBBACKEND_H
+
+#include "randrbackend.h"
+
+/** The RandR server of an X display, through Xlib. */
+class RandRXlibBackend : public RandRBackend
+{
+public:
+    RandRXlibBackend(Display *dpy);
+
+    Display *display() const;
+
+    bool queryExtension(int &eventBase, int &errorBase);
+    bool queryVersion(int &major, int &minor);
+
+    int screenCount();
+    int defaultScreen();
+    Window rootWindow(int screen);
+    QSize screenSize(int screen);
+    QSize screenSizeMM(int screen);
+    bool screenSizeRange(Window root, QSize &minSize, QSize &maxSize);
+    void setScreenSize(Window root, const QSize &size, const QSize &sizeMM);
+    void selectInput(Window root, int mask);
+
+    XRRScreenResources *screenResources(Window root, bool poll);
+    void freeScreenResources(XRRScreenResources *resources);
+
+    bool crtcInfo(XRRScreenResources *resources, RRCrtc crtc, RandRCrtcInfo &info);
+    bool crtcPanning(XRRScreenResources *resources, RRCrtc crtc, QRect &panning);
+    bool crtcTransform(RRCrtc crtc, XTransform &transform, QByteArray &filter);
+    bool crtcGamma(RRCrtc crtc, RandRCrtcInfo &info);
+    int crtcGammaSize(RRCrtc crtc);
+    bool outputInfo(XRRScreenResources *resources, RROutput output, RandROutputInfo &info);
+    QByteArray edid(RROutput output);
+    bool isEdidProperty(Atom property);
+    RROutput outputPrimary(Window root);
+
+    Status setCrtcConfig(XRRScreenResources *resources, RRCrtc crtc, const QPoint &pos,
+                         RRMode mode, int rotation, const OutputList &outputs);
+    void setCrtcTransform(RRCrtc crtc, XTransform *transform, const char *filter);
+    Status setPanning(XRRScreenResources *resources, RRCrtc crtc, const QRect &area);
+    void setCrtcGamma(RRCrtc crtc, int size, const unsigned short *ramps);
+    void setOutputPrimary(Window root, RROutput output);
+
+    void grabServer();
+    void ungrabServer();
+    void sync();
+    void flush();
+    void waitForCrtcChanges(const CrtcList &crtcs, int timeout);
+
+private:
+    Display *m_dpy;
+};
+
+#endif // RANDRXLIBBACKEND_H
@@ -56,7 +56,11 @@ void LXQtRandrConfig::on_buttonBox_clicked(QAbstractButton *button)
     if(mUi->buttonBox->button(QDialogButtonBox::Ok) == button)
     {
         mRandrConfig->apply();
-        QApplication::quit();
+        // don't leave while the worker thread is sending the changes
+        if (mRandrConfig->isApplying())
+            connect(mRandrConfig, SIGNAL(applied(bool)), qApp, SLOT(quit()));
+        else
+            QApplication::quit();
     }
     else if(mUi->buttonBox->button(QDialogButtonBox::Apply) == button)
     {
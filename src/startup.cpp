@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSettings>
+
+#include "randrstartup.h"
+#include "randrstats.h"
+#include "randrtrace.h"
+
+/* lxqt-config-randr-startup applies the saved settings at login. It does
+ * the same as lxqt-config-randr --startup but only needs QtCore. */
+int main(int argc, char *argv[])
+{
+    // the settings of lxqt-config-randr
+    QCoreApplication::setApplicationName("lxqt-config-randr");
+    QCoreApplication::setOrganizationDomain("lxqt");
+    QSettings::setDefaultFormat(QSettings::NativeFormat);
+    RandRStats::parseArguments(argc, argv);
+    RandRTrace::parseArguments(argc, argv);
+
+    return RandRStartup::run(RandRStartup::reprobeRequested(argc, argv));
+}